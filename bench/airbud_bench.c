@@ -0,0 +1,294 @@
+/**
+ * @file airbud_bench.c
+ *
+ * Runs the real decoder and render threads end to end on a synthetic vob laid out like the game's,
+ * under SDL's dummy video and audio drivers so it needs neither a gpu nor a sound card.
+ * Plays through a fixed script of state changes and reports per state how long the decoder took to start
+ * the section and how long until its first frame was presented, or its first audio queued for audio only
+ * states, along with decode fps, dropped frames and peak memory. Fails if the pipeline stops, or if a section
+ * started from a committed prefetch presents no more video than was prefetched
+ *
+ * usage: airbud_bench [fixture.vob], the fixture is generated when it is missing or the wrong size
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include <init.h>
+#include <game_states.h>
+#include <frame_queue.h>
+#include <frame_pool.h>
+#include <pipeline_stats.h>
+#include <trace.h>
+#include <lock_profile.h>
+#include <vob_fixture.h>
+
+#define DEFAULT_FIXTURE "airbud_bench.vob"
+#define POLL_MS 1                      // how often the main thread checks on the pipeline
+#define STATE_NAME_WIDTH 12
+
+static const char VOB_PATH_ENV[] = "AIRBUD_VOB_PATH"; // read by the decoder thread, pointed at the fixture
+static const char VSYNC_ENV[] = "AIRBUD_VSYNC";       // the dummy renderer has no vblanks to wait on
+
+static const char *const STATE_NAMES[STATE_COUNT] = { "MAIN_MENU_1", "MAIN_MENU_2", "MAIN_MENU_3", "TUTORIAL" };
+
+/**
+ * @struct bench_step
+ * @brief a state to go to and how long to stay there, the first step is the state the game starts in
+ */
+struct bench_step {
+    STATE_ID state;                    /**< state to play */
+    Uint32 hold_ms;                    /**< time to stay before moving on, cut short when the section ends */
+};
+
+// follows the menus the way a player would, including the predicted and the unpredicted changes
+static const struct bench_step SCRIPT[] = {
+    { MAIN_MENU_1, 4000 },
+    { MAIN_MENU_2, 3000 },
+    { MAIN_MENU_3, 3000 },
+    { MAIN_MENU_1, 3000 },
+    { TUTORIAL, 6000 },
+    { MAIN_MENU_2, 2000 },
+    { MAIN_MENU_1, 3000 },
+};
+#define SCRIPT_STEPS ((int)(sizeof(SCRIPT) / sizeof(SCRIPT[0])))
+
+/**
+ * @struct step_result
+ * @brief what one step of the script measured
+ */
+struct step_result {
+    bool ended;                        /**< the decoder finished the section before the hold time was up */
+    bool prefetched;                   /**< the section started from the predicted state's pre-decoded buffers */
+    double section_ms;                 /**< from the state change to the decoder starting the section, negative if it never did */
+    double first_output_ms;            /**< from the state change to the first frame presented or audio queued, negative if none */
+    int presented;                     /**< frames presented during the step */
+    int dropped;                       /**< frames the renderer threw away during the step */
+    int decoded;                       /**< video frames decoded during the step, including prefetching the next state */
+    double decode_ms;                  /**< time the video decoder spent on them */
+};
+
+/**
+ * @brief plays one step of the script, pumping events and watching for the first output of the new state
+ *
+ * @param appstate app state the threads were started with
+ * @param step step to play
+ * @param first whether this is the state the game started in, which isn't changed into
+ * @param result filled with what was measured
+ * @return false if the pipeline failed or the app was asked to quit, true otherwise
+ */
+static bool run_step(app_state *appstate, const struct bench_step *step, const bool first, struct step_result *result) {
+    pipeline_stats *stats = &appstate->stats;
+    if (!first) {
+        change_game_state(appstate, step->state);
+    }
+    const uint32_t epoch = SDL_GetAtomicU32(&appstate->segment_epoch);
+    const uint32_t change_us = SDL_GetAtomicU32(&stats->change_us);
+
+    const int presented = SDL_GetAtomicInt(&stats->presented_frames);
+    const int dropped = SDL_GetAtomicInt(&stats->dropped_frames);
+    const int decoded = SDL_GetAtomicInt(&stats->decoded_frames);
+    const int decode_us = SDL_GetAtomicInt(&stats->decode_us);
+
+    *result = (struct step_result){ .section_ms = -1.0, .first_output_ms = -1.0 };
+    const bool audio_only = GAME_STATES[step->state].audio_only;
+    const Uint64 start_ms = SDL_GetTicks();
+    bool ok = true;
+
+    while (ok && !result->ended && SDL_GetTicks() - start_ms < step->hold_ms) {
+        SDL_Event event;
+        while (SDL_PollEvent(&event)) {
+            if (event.type == SDL_EVENT_QUIT) {
+                ok = false;
+            } else if (event.type == appstate->decoding_ended_event && (uint32_t)event.user.code == epoch) {
+                result->ended = true;
+            }
+        }
+        if (SDL_GetAtomicInt(&appstate->stop_decoder_thread) != 0 || SDL_GetAtomicInt(&appstate->stop_render_thread) != 0) {
+            fprintf(stderr, "pipeline stopped during %s\n", STATE_NAMES[step->state]);
+            ok = false;
+        }
+
+        // audio only states have no frame to present, their first output is the first audio queued
+        if (audio_only && result->first_output_ms < 0.0 && SDL_GetAtomicU32(&appstate->total_audio_samples) > 0) {
+            result->first_output_ms = (double)(stats_clock_us() - change_us) / 1000.0;
+        }
+        SDL_Delay(POLL_MS);
+    }
+
+    if (SDL_GetAtomicU32(&stats->section_epoch) == epoch) {
+        result->section_ms = (double)SDL_GetAtomicU32(&stats->section_latency_us) / 1000.0;
+    }
+    result->prefetched = SDL_GetAtomicU32(&stats->prefetch_epoch) == epoch;
+    const int prefetched_frames = result->prefetched ? SDL_GetAtomicInt(&stats->prefetch_frames) : 0;
+    if (!audio_only && SDL_GetAtomicU32(&stats->present_epoch) == epoch) {
+        result->first_output_ms = (double)SDL_GetAtomicU32(&stats->present_latency_us) / 1000.0;
+    }
+    result->presented = SDL_GetAtomicInt(&stats->presented_frames) - presented;
+    result->dropped = SDL_GetAtomicInt(&stats->dropped_frames) - dropped;
+    result->decoded = SDL_GetAtomicInt(&stats->decoded_frames) - decoded;
+    result->decode_ms = (double)(SDL_GetAtomicInt(&stats->decode_us) - decode_us) / 1000.0;
+
+    // a committed prefetch hands the renderer the start of the section, the decoder has to carry on after it
+    if (ok && result->prefetched && !audio_only && result->presented <= prefetched_frames) {
+        fprintf(stderr, "video of %s stopped after the %d prefetched frames\n", STATE_NAMES[step->state],
+            prefetched_frames);
+        ok = false;
+    }
+    return ok;
+}
+
+/**
+ * @brief peak resident memory of the process
+ *
+ * @return bytes, 0 if it couldn't be read
+ */
+static uint64_t peak_rss_bytes(void) {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return (uint64_t)usage.ru_maxrss;
+#else
+    return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+/**
+ * @brief prints the measurements of every step, then the latencies per state and the totals
+ *
+ * @param appstate app state the threads ran with, stopped
+ * @param results results of the steps that ran
+ * @param steps amount of them
+ * @param wall_ms how long the script took
+ */
+static void print_report(app_state *appstate, const struct step_result *results, const int steps, const double wall_ms) {
+    printf("\n%-4s %-*s %-6s %-8s %10s %12s %9s %7s %7s %10s\n", "step", STATE_NAME_WIDTH, "state", "end", "start",
+        "start ms", "first out ms", "presented", "dropped", "decoded", "decode fps");
+
+    int presented = 0;
+    int dropped = 0;
+    int decoded = 0;
+    double decode_ms = 0.0;
+    double transition_sum_ms = 0.0;
+    double transition_max_ms = 0.0;
+    int transitions = 0;
+    for (int i = 0; i < steps; i++) {
+        const struct step_result *result = &results[i];
+        printf("%-4d %-*s %-6s %-8s %10.2f %12.2f %9d %7d %7d %10.1f\n", i, STATE_NAME_WIDTH,
+            STATE_NAMES[SCRIPT[i].state], result->ended ? "ended" : "held", result->prefetched ? "prefetch" : "cold",
+            result->section_ms, result->first_output_ms, result->presented,
+            result->dropped, result->decoded, result->decode_ms > 0.0 ? result->decoded * 1000.0 / result->decode_ms : 0.0);
+
+        presented += result->presented;
+        dropped += result->dropped;
+        decoded += result->decoded;
+        decode_ms += result->decode_ms;
+
+        // the first step is the cold start, every later one is a transition
+        if (i > 0 && result->first_output_ms >= 0.0) {
+            transition_sum_ms += result->first_output_ms;
+            transition_max_ms = SDL_max(transition_max_ms, result->first_output_ms);
+            transitions++;
+        }
+    }
+
+    printf("\nfirst output latency per state\n");
+    for (int state = 0; state < STATE_COUNT; state++) {
+        double sum_ms = 0.0;
+        double max_ms = 0.0;
+        int count = 0;
+        for (int i = 0; i < steps; i++) {
+            if (SCRIPT[i].state == state && results[i].first_output_ms >= 0.0) {
+                sum_ms += results[i].first_output_ms;
+                max_ms = SDL_max(max_ms, results[i].first_output_ms);
+                count++;
+            }
+        }
+        if (count) {
+            printf("  %-*s %s %8.2f ms avg %8.2f ms max over %d\n", STATE_NAME_WIDTH, STATE_NAMES[state],
+                GAME_STATES[state].audio_only ? "audio" : "video", sum_ms / count, max_ms, count);
+        }
+    }
+
+    printf("\ntransition latency  %8.2f ms avg %8.2f ms max over %d transitions\n",
+        transitions ? transition_sum_ms / transitions : 0.0, transition_max_ms, transitions);
+    printf("decode              %8.1f fps over %d frames, %.2f ms per frame\n",
+        decode_ms > 0.0 ? decoded * 1000.0 / decode_ms : 0.0, decoded, decoded ? decode_ms / decoded : 0.0);
+    printf("presented           %8d frames, %d dropped by the renderer, %" PRIu32 " skipped late by the decoder\n",
+        presented, dropped, appstate->render_queue->late_frames);
+    printf("peak rss            %8.1f MiB\n", (double)peak_rss_bytes() / (1024.0 * 1024.0));
+    printf("wall time           %8.1f s\n", wall_ms / 1000.0);
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = argc > 1 ? argv[1] : DEFAULT_FIXTURE;
+    if (SCRIPT[0].state != MAIN_MENU_1) {
+        fprintf(stderr, "the script has to start where the game does\n");
+        return 1;
+    }
+
+    if (!prepare_game_fixture(path)) {
+        fprintf(stderr, "couldn't prepare fixture %s\n", path);
+        return 1;
+    }
+
+    // headless, the dummy audio driver still consumes audio in real time so the clock runs as usual
+    SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "dummy");
+    SDL_SetHint(SDL_HINT_AUDIO_DRIVER, "dummy");
+    SDL_Environment *env = SDL_GetEnvironment();
+    if (!env || !SDL_SetEnvironmentVariable(env, VOB_PATH_ENV, path, true) ||
+        !SDL_SetEnvironmentVariable(env, VSYNC_ENV, "0", false))
+    {
+        fprintf(stderr, "couldn't set up the environment %s\n", SDL_GetError());
+        return 1;
+    }
+
+    app_state *appstate = initialize();
+    if (!appstate || !start_threads(appstate)) {
+        fprintf(stderr, "couldn't start the pipeline\n");
+        return 1;
+    }
+
+    struct step_result results[SCRIPT_STEPS];
+    const Uint64 start_ms = SDL_GetTicks();
+    int steps = 0;
+    bool ok = true;
+    for (; steps < SCRIPT_STEPS && ok; steps++) {
+        ok = run_step(appstate, &SCRIPT[steps], steps == 0, &results[steps]);
+    }
+    const double wall_ms = (double)(SDL_GetTicks() - start_ms);
+
+    stop_threads(appstate);
+    print_report(appstate, results, steps, wall_ms);
+
+    // the whole script in one trace and one lock profile, in builds with AIRBUD_TRACE or AIRBUD_LOCK_PROFILE on
+    TRACE_EXPORT();
+    DUMP_LOCK_PROFILE();
+
+    destroy_frameQueue(appstate->render_queue);
+    destroy_frame_pool(appstate->frame_pool);
+    SDL_Quit();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,200 @@
+/**
+ * @file deinterlace_bench.c
+ *
+ * Measures what deinterlacing costs per frame with every kernel the cpu supports, on one core.
+ * Frames are synthetic 720x480 interlaced pictures with a bar moving between the fields, so both the
+ * still and the moving paths of the filter are exercised. Checks every kernel's output against the
+ * scalar one and prints the cost against the 33 ms a frame has at 30 fps.
+ * The time per frame includes taking the output picture from the pool, and the kernels only vectorize as
+ * intended with optimization on, so only figures from a release build against the real SDL and FFmpeg
+ * count, together with the cpu they were taken on
+ *
+ * usage: deinterlace_bench [frames]
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <libavutil/frame.h>
+
+#include <deinterlace.h>
+#include <frame_pool.h>
+
+#define DEFAULT_FRAMES 2000
+#define FRAME_WIDTH 720
+#define FRAME_HEIGHT 480
+#define SOURCE_FRAMES 8        // distinct pictures cycled through, the bar moves across them
+#define BAR_WIDTH 48
+#define BAR_STEP 24            // pixels the bar moves per field
+#define FRAME_BUDGET_MS (1000.0 / 30.0)
+
+/**
+ * @brief draws a still gradient background with a bar that is at a different place in each field
+ *
+ * @param frame frame with a 4:2:0 picture to draw into
+ * @param index which picture in the sequence it is
+ */
+static void draw_source(AVFrame *frame, const int index) {
+    for (int y = 0; y < frame->height; y++) {
+        // the bottom field is shot half a frame later than the top one
+        const int bar_x = (index * 2 + (y & 1)) * BAR_STEP % (frame->width - BAR_WIDTH);
+        uint8_t *row = frame->data[0] + (size_t)y * frame->linesize[0];
+        for (int x = 0; x < frame->width; x++) {
+            row[x] = x >= bar_x && x < bar_x + BAR_WIDTH ? 235 : (uint8_t)(16 + (x + y) % 200);
+        }
+    }
+    for (int plane = 1; plane < 3; plane++) {
+        for (int y = 0; y < (frame->height + 1) / 2; y++) {
+            const int bar_x = (index * 2 + (y & 1)) * BAR_STEP % (frame->width - BAR_WIDTH) / 2;
+            uint8_t *row = frame->data[plane] + (size_t)y * frame->linesize[plane];
+            for (int x = 0; x < (frame->width + 1) / 2; x++) {
+                row[x] = x >= bar_x && x < bar_x + BAR_WIDTH / 2 ? (uint8_t)(plane * 80) : 128;
+            }
+        }
+    }
+    frame->flags |= AV_FRAME_FLAG_INTERLACED | AV_FRAME_FLAG_TOP_FIELD_FIRST;
+}
+
+/**
+ * @brief FNV-1a over the visible part of a picture, so kernels can be compared without keeping their output
+ */
+static uint64_t hash_picture(const AVFrame *frame, uint64_t hash) {
+    for (int plane = 0; plane < 3; plane++) {
+        const int width = plane ? (frame->width + 1) / 2 : frame->width;
+        const int height = plane ? (frame->height + 1) / 2 : frame->height;
+        for (int y = 0; y < height; y++) {
+            const uint8_t *row = frame->data[plane] + (size_t)y * frame->linesize[plane];
+            for (int x = 0; x < width; x++) {
+                hash = (hash ^ row[x]) * 1099511628211ULL;
+            }
+        }
+    }
+    return hash;
+}
+
+/**
+ * @brief deinterlaces the source pictures over and over with one kernel and prints the cost per frame
+ *
+ * @param kernel kernel to measure
+ * @param pool pool the output pictures come from
+ * @param sources source pictures, referenced rather than copied for every frame
+ * @param frames frames to deinterlace
+ * @param hash set to the hash of one pass over the sources, for comparing kernels
+ * @return true on success, false otherwise
+ */
+static bool run_bench(const enum deinterlace_kernel kernel, frame_pool *pool, AVFrame *const *sources, const int frames,
+                      uint64_t *hash)
+{
+    deinterlacer *deint = create_deinterlacer(pool, NULL);
+    AVFrame *frame = av_frame_alloc();
+    if (!deint || !frame || !set_deinterlace_kernel(deint, kernel)) {
+        fprintf(stderr, "couldn't set up the %s deinterlacer\n", deinterlace_kernel_name(kernel));
+        destroy_deinterlacer(deint);
+        av_frame_free(&frame);
+        return false;
+    }
+
+    *hash = 14695981039346656037ULL;
+    Uint64 total_ns = 0;
+    Uint64 worst_ns = 0;
+    for (int i = 0; i < frames; i++) {
+        if (av_frame_ref(frame, sources[i % SOURCE_FRAMES]) < 0) {
+            fprintf(stderr, "couldn't reference source frame\n");
+            break;
+        }
+
+        const Uint64 start_ns = SDL_GetTicksNS();
+        const bool filtered = deinterlace_frame(deint, frame);
+        const Uint64 elapsed_ns = SDL_GetTicksNS() - start_ns;
+        if (!filtered) {
+            fprintf(stderr, "couldn't deinterlace frame\n");
+            av_frame_unref(frame);
+            break;
+        }
+
+        total_ns += elapsed_ns;
+        if (elapsed_ns > worst_ns) {
+            worst_ns = elapsed_ns;
+        }
+
+        // the first pass has no previous frame for its first picture, the second one is fully in steady state
+        if (i >= SOURCE_FRAMES && i < 2 * SOURCE_FRAMES) {
+            *hash = hash_picture(frame, *hash);
+        }
+        av_frame_unref(frame);
+    }
+
+    const double average_ms = (double)total_ns / frames / SDL_NS_PER_MS;
+    printf("%-8s %8d frames %8.3f ms/frame avg %8.3f ms worst %6.2f%% of the %.1f ms frame budget\n",
+        deinterlace_kernel_name(kernel), frames, average_ms, (double)worst_ns / SDL_NS_PER_MS,
+        100.0 * average_ms / FRAME_BUDGET_MS, FRAME_BUDGET_MS);
+
+    destroy_deinterlacer(deint);
+    av_frame_free(&frame);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    const int frames = argc > 1 ? atoi(argv[1]) : DEFAULT_FRAMES;
+    if (frames < 2 * SOURCE_FRAMES) {
+        fprintf(stderr, "usage: %s [frames], at least %d\n", argv[0], 2 * SOURCE_FRAMES);
+        return 1;
+    }
+
+    frame_pool *pool = create_frame_pool(SOURCE_FRAMES);
+    if (!pool) {
+        fprintf(stderr, "couldn't create frame pool\n");
+        return 1;
+    }
+
+    AVFrame *sources[SOURCE_FRAMES] = {0};
+    bool ok = true;
+    for (int i = 0; i < SOURCE_FRAMES && ok; i++) {
+        sources[i] = av_frame_alloc();
+        if (!sources[i]) {
+            ok = false;
+            break;
+        }
+        sources[i]->format = AV_PIX_FMT_YUV420P;
+        sources[i]->width = FRAME_WIDTH;
+        sources[i]->height = FRAME_HEIGHT;
+        ok = acquire_picture(pool, sources[i]);
+        if (ok) {
+            draw_source(sources[i], i);
+        }
+    }
+    if (!ok) {
+        fprintf(stderr, "couldn't create source frames\n");
+    }
+
+    // every kernel has to match the scalar one bit for bit
+    uint64_t scalar_hash = 0;
+    ok = ok && run_bench(DEINTERLACE_SCALAR, pool, sources, frames, &scalar_hash);
+    const enum deinterlace_kernel simd_kernels[] = { DEINTERLACE_SSE2, DEINTERLACE_AVX2, DEINTERLACE_NEON };
+    for (int i = 0; i < (int)(sizeof(simd_kernels) / sizeof(simd_kernels[0])) && ok; i++) {
+        if (!deinterlace_kernel_supported(simd_kernels[i])) {
+            printf("%-8s not supported on this cpu\n", deinterlace_kernel_name(simd_kernels[i]));
+            continue;
+        }
+
+        uint64_t hash = 0;
+        ok = run_bench(simd_kernels[i], pool, sources, frames, &hash);
+        if (ok && hash != scalar_hash) {
+            fprintf(stderr, "%s output differs from scalar\n", deinterlace_kernel_name(simd_kernels[i]));
+            ok = false;
+        }
+    }
+
+    for (int i = 0; i < SOURCE_FRAMES; i++) {
+        av_frame_free(&sources[i]);
+    }
+    destroy_frame_pool(pool);
+    SDL_Quit();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,224 @@
+/**
+ * @file frame_queue_bench.c
+ *
+ * Compares the lock free frame_queue against the mutex and condition queue it replaced.
+ * Both queues hand the same pooled frames between a producer and a consumer thread, so only
+ * the synchronization differs. Measures throughput with the queue free running, and handoff
+ * latency with a single frame in flight.
+ * Both are dominated by SDL's mutexes, conditions and atomics, so only figures from a build against the
+ * real SDL the app ships with mean anything, not from a stand in for it
+ *
+ * usage: frame_queue_bench [frames]
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <libavutil/frame.h>
+
+#include <frame_queue.h>
+#include <frame_pool.h>
+
+#define DEFAULT_FRAMES 1000000
+#define LATENCY_FRAMES 20000 // frames sent one at a time for the latency run
+#define WAIT_MS 50
+
+/**
+ * @struct mutex_queue
+ * @brief the frame_queue as it was before the lock free ring, every access takes the mutex
+ */
+struct mutex_queue {
+    AVFrame **frames;
+    int capacity;
+    int size;
+    int front;
+    int rear;
+
+    SDL_Mutex *mutex;
+    SDL_Condition *not_empty;
+    SDL_Condition *not_full;
+};
+
+static struct mutex_queue *create_mutex_queue(void) {
+    struct mutex_queue *queue = calloc(1, sizeof(struct mutex_queue));
+    if (!queue) return NULL;
+
+    queue->capacity = VIDEO_BUFFER_CAP;
+    queue->frames = calloc(queue->capacity, sizeof(AVFrame *));
+    queue->mutex = SDL_CreateMutex();
+    queue->not_empty = SDL_CreateCondition();
+    queue->not_full = SDL_CreateCondition();
+    if (!queue->frames || !queue->mutex || !queue->not_empty || !queue->not_full) {
+        return NULL;
+    }
+    return queue;
+}
+
+static void destroy_mutex_queue(struct mutex_queue *queue) {
+    SDL_DestroyMutex(queue->mutex);
+    SDL_DestroyCondition(queue->not_empty);
+    SDL_DestroyCondition(queue->not_full);
+    free(queue->frames);
+    free(queue);
+}
+
+/**
+ * @struct bench_run
+ * @brief shared state of a single producer / consumer run
+ */
+struct bench_run {
+    bool lock_free;              /**< which queue is being measured */
+    frame_queue *ring;           /**< lock free queue */
+    struct mutex_queue *locked;  /**< mutex queue */
+    frame_pool *pool;            /**< pool both queues take frames from */
+
+    int frames;                  /**< frames to send */
+    bool one_in_flight;          /**< producer waits for each frame to be consumed before sending the next */
+    SDL_AtomicInt consumed;      /**< frames consumed so far */
+
+    Uint64 latency_ns;           /**< summed enqueue to dequeue time */
+    Uint64 max_latency_ns;       /**< worst enqueue to dequeue time */
+};
+
+/**
+ * @brief sends a frame stamped with the time it was sent
+ */
+static void produce(struct bench_run *run, AVFrame *frame) {
+    frame->pts = (int64_t)SDL_GetTicksNS();
+
+    if (run->lock_free) {
+        while (!wait_for_space(run->ring, WAIT_MS)) {}
+        enqueue_frame(run->ring, frame, 0, NULL);
+        return;
+    }
+
+    struct mutex_queue *queue = run->locked;
+    SDL_LockMutex(queue->mutex);
+    while (queue->size == queue->capacity) {
+        SDL_WaitConditionTimeout(queue->not_full, queue->mutex, WAIT_MS);
+    }
+    AVFrame *queued_frame = acquire_frame(run->pool);
+    av_frame_move_ref(queued_frame, frame);
+    queue->frames[queue->rear] = queued_frame;
+    queue->rear = (queue->rear + 1) % queue->capacity;
+    queue->size++;
+    SDL_SignalCondition(queue->not_empty);
+    SDL_UnlockMutex(queue->mutex);
+}
+
+/**
+ * @brief takes the next frame, waiting for one if needed
+ */
+static AVFrame *consume(struct bench_run *run) {
+    if (run->lock_free) {
+        while (!wait_for_frame(run->ring, WAIT_MS)) {}
+        return dequeue_frame(run->ring, NULL, NULL);
+    }
+
+    struct mutex_queue *queue = run->locked;
+    SDL_LockMutex(queue->mutex);
+    while (queue->size == 0) {
+        SDL_WaitConditionTimeout(queue->not_empty, queue->mutex, WAIT_MS);
+    }
+    AVFrame *frame = queue->frames[queue->front];
+    queue->front = (queue->front + 1) % queue->capacity;
+    queue->size--;
+    SDL_SignalCondition(queue->not_full);
+    SDL_UnlockMutex(queue->mutex);
+    return frame;
+}
+
+static int consumer_thread(void *data) {
+    struct bench_run *run = data;
+
+    for (int i = 0; i < run->frames; i++) {
+        AVFrame *frame = consume(run);
+
+        const Uint64 latency_ns = SDL_GetTicksNS() - (Uint64)frame->pts;
+        run->latency_ns += latency_ns;
+        if (latency_ns > run->max_latency_ns) {
+            run->max_latency_ns = latency_ns;
+        }
+
+        release_frame(run->pool, &frame);
+        SDL_SetAtomicInt(&run->consumed, i + 1);
+    }
+    return 0;
+}
+
+/**
+ * @brief runs a producer on the calling thread against a consumer thread and prints the results
+ */
+static bool run_bench(const char *name, frame_pool *pool, const bool lock_free, const int frames, const bool one_in_flight) {
+    struct bench_run run = {
+        .lock_free = lock_free,
+        .pool = pool,
+        .frames = frames,
+        .one_in_flight = one_in_flight,
+    };
+    SDL_SetAtomicInt(&run.consumed, 0);
+    run.ring = lock_free ? create_frame_queue(pool, DEFAULT_VIDEO_QUEUE_BYTES) : NULL;
+    run.locked = lock_free ? NULL : create_mutex_queue();
+    if (!run.ring && !run.locked) {
+        fprintf(stderr, "couldn't create queue\n");
+        return false;
+    }
+
+    AVFrame *frame = av_frame_alloc();
+    SDL_Thread *consumer = SDL_CreateThread(consumer_thread, "consumer", &run);
+    if (!frame || !consumer) {
+        fprintf(stderr, "couldn't start consumer\n");
+        return false;
+    }
+
+    const Uint64 start_ns = SDL_GetTicksNS();
+    for (int i = 0; i < frames; i++) {
+        produce(&run, frame);
+        if (one_in_flight) {
+            while (SDL_GetAtomicInt(&run.consumed) <= i) {}
+        }
+    }
+    SDL_WaitThread(consumer, NULL);
+    const Uint64 elapsed_ns = SDL_GetTicksNS() - start_ns;
+
+    printf("%-10s %-10s %10d frames %10.1f ns/frame %12.0f frames/s  latency avg %8.0f ns  max %10.0f ns\n",
+        name, one_in_flight ? "handoff" : "throughput", frames,
+        (double)elapsed_ns / frames, (double)frames * SDL_NS_PER_SECOND / (double)elapsed_ns,
+        (double)run.latency_ns / frames, (double)run.max_latency_ns);
+
+    av_frame_free(&frame);
+    if (run.ring) destroy_frameQueue(run.ring);
+    if (run.locked) destroy_mutex_queue(run.locked);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    const int frames = argc > 1 ? atoi(argv[1]) : DEFAULT_FRAMES;
+    if (frames <= 0) {
+        fprintf(stderr, "usage: %s [frames]\n", argv[0]);
+        return 1;
+    }
+
+    frame_pool *pool = create_frame_pool(2 * VIDEO_BUFFER_CAP);
+    if (!pool) {
+        fprintf(stderr, "couldn't create frame pool\n");
+        return 1;
+    }
+
+    const int latency_frames = frames < LATENCY_FRAMES ? frames : LATENCY_FRAMES;
+    const bool ok =
+        run_bench("mutex", pool, false, frames, false) &&
+        run_bench("lock free", pool, true, frames, false) &&
+        run_bench("mutex", pool, false, latency_frames, true) &&
+        run_bench("lock free", pool, true, latency_frames, true);
+
+    destroy_frame_pool(pool);
+    SDL_Quit();
+    return ok ? 0 : 1;
+}
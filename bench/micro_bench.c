@@ -0,0 +1,758 @@
+/**
+ * @file micro_bench.c
+ *
+ * Microbenchmarks of the hot paths on their own, so every queue, pool or resampler change can be measured
+ * against a baseline instead of argued about. Covers the frame_queue handing frames from a producer to a
+ * consumer thread, decode_video and decode_audio on packets demuxed from the fixture up front, and uploading
+ * a decoded frame with SDL_UpdateYUVTexture, and the frame pacer's scheduling arithmetic. Each benchmark runs in batches until it has run for the minimum
+ * time, then the results are written as JSON with ns, allocations and allocated bytes per op.
+ * Allocations are counted by interposing malloc, which only works against glibc, elsewhere they come out null
+ *
+ * usage: micro_bench [--fixture path] [--min-time seconds] [--filter name] [--out results.json]
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#include <SDL3/SDL.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/mem.h>
+#include <libswresample/swresample.h>
+
+#include <decode.h>
+#include <frame_queue.h>
+#include <frame_pool.h>
+#include <frame_pacer.h>
+#include <vob_fixture.h>
+
+#define DEFAULT_FIXTURE "airbud_bench.vob"
+#define DEFAULT_MIN_TIME_S 1.0
+#define VIDEO_PACKETS 300              // about ten seconds of video demuxed up front
+#define AUDIO_PACKETS 512              // room for the audio demuxed alongside it
+#define QUEUE_BATCH_FRAMES 20000       // frames handed over per producer / consumer run
+#define UPLOAD_BATCH 100               // uploads per batch, the renderer is flushed once after them
+#define TEXTURE_COUNT 3                // uploads cycle through a ring like the renderer's
+#define WAIT_MS 50
+#define PACER_BATCH 10000              // frames scheduled per batch
+#define PACER_HZ 60
+#define SAMPLE_RATE 48000
+
+/* ---- allocation counting ---- */
+
+#if defined(__GLIBC__)
+#define COUNTS_ALLOCATIONS 1
+
+// glibc's own allocator, the definitions below replace malloc and friends for the whole process, ffmpeg and SDL included
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *ptr);
+
+static uint64_t allocation_count;      // every allocation on any thread, reallocations included
+static uint64_t allocation_bytes;      // bytes asked for by them
+
+static void count_allocation(const size_t size) {
+    __atomic_fetch_add(&allocation_count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&allocation_bytes, size, __ATOMIC_RELAXED);
+}
+
+void *malloc(const size_t size) {
+    count_allocation(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(const size_t count, const size_t size) {
+    count_allocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, const size_t size) {
+    count_allocation(size);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+    __libc_free(ptr);
+}
+
+void *memalign(const size_t alignment, const size_t size) {
+    count_allocation(size);
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(const size_t alignment, const size_t size) {
+    count_allocation(size);
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, const size_t alignment, const size_t size) {
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    count_allocation(size);
+    void *memory = __libc_memalign(alignment, size);
+    if (!memory && size) {
+        return ENOMEM;
+    }
+    *ptr = memory;
+    return 0;
+}
+
+static void read_allocations(uint64_t *count, uint64_t *bytes) {
+    *count = __atomic_load_n(&allocation_count, __ATOMIC_RELAXED);
+    *bytes = __atomic_load_n(&allocation_bytes, __ATOMIC_RELAXED);
+}
+
+#else
+#define COUNTS_ALLOCATIONS 0
+
+static void read_allocations(uint64_t *count, uint64_t *bytes) {
+    *count = 0;
+    *bytes = 0;
+}
+
+#endif
+
+/* ---- shared state ---- */
+
+/**
+ * @struct bench_media
+ * @brief packets, decoders and outputs set up once and shared by every benchmark
+ */
+struct bench_media {
+    AVFormatContext *format_context;         /**< opened fixture */
+    AVPacket *video_packets[VIDEO_PACKETS];  /**< video packets from the start of the fixture */
+    int video_count;                         /**< amount of them */
+    AVPacket *audio_packets[AUDIO_PACKETS];  /**< audio packets demuxed alongside them */
+    int audio_count;                         /**< amount of them */
+
+    AVCodecContext *video_ctx;               /**< single threaded video decoder, decodes into the pool */
+    AVCodecContext *audio_ctx;               /**< audio decoder */
+    SwrContext *resampler;                   /**< converts to the S16 stereo the app plays */
+    AVFrame *frame;                          /**< reused frame the decoders receive into */
+    AVFrame *picture;                        /**< one decoded picture, handed through the queue and uploaded */
+
+    frame_pool *pool;                        /**< pool shared by the decoder and the queue, like the app's */
+    frame_queue *queue;                      /**< queue the benchmarks produce into and consume from */
+    struct video_filters filters;            /**< the app's filter chain, for the filtered decode */
+
+    SDL_AudioStream *audio_stream;           /**< stream the audio decoder pushes into, cleared after every batch */
+    SDL_AtomicU32 audio_samples;             /**< samples pushed to it */
+    struct pcm_scratch scratch;              /**< resampler output, reused like on the audio decoder thread */
+
+    SDL_Window *window;                      /**< hidden window the renderer belongs to */
+    SDL_Renderer *renderer;                  /**< renderer the textures are uploaded with, NULL skips the upload benchmark */
+    SDL_Texture *textures[TEXTURE_COUNT];    /**< ring of streaming textures */
+    int next_texture;                        /**< texture the next upload goes to */
+};
+
+/**
+ * @struct micro_bench
+ * @brief a benchmark, run in batches that each report how many ops they did
+ */
+struct micro_bench {
+    const char *name;                                          /**< name in the results */
+    bool (*run)(struct bench_media *media, int64_t *ops);      /**< runs one batch, false on failure */
+};
+
+/**
+ * @struct bench_result
+ * @brief totals over every measured batch of a benchmark
+ */
+struct bench_result {
+    const char *name;                        /**< benchmark name */
+    int batches;                             /**< measured batches, the warm up batch isn't counted */
+    int64_t ops;                             /**< ops over them */
+    Uint64 elapsed_ns;                       /**< time they took */
+    uint64_t allocations;                    /**< allocations during them */
+    uint64_t allocated_bytes;                /**< bytes asked for by those */
+};
+
+// frames never go stale
+static const struct segment_tag TAG = { .epoch = 0, .live_epoch = NULL };
+
+/**
+ * @brief gives every queued frame back to the pool
+ *
+ * @param media media holding the queue
+ * @return amount of frames there were
+ */
+static int64_t drain_queue(struct bench_media *media) {
+    int64_t frames = 0;
+    AVFrame *frame;
+    while ((frame = dequeue_frame(media->queue, NULL, NULL))) {
+        release_frame(media->pool, &frame);
+        frames++;
+    }
+    return frames;
+}
+
+/* ---- benchmarks ---- */
+
+/**
+ * @struct queue_run
+ * @brief shared state of one producer / consumer run
+ */
+struct queue_run {
+    struct bench_media *media;               /**< media holding the queue and pool */
+    int frames;                              /**< frames to hand over */
+};
+
+static int queue_consumer(void *data) {
+    const struct queue_run *run = data;
+
+    for (int i = 0; i < run->frames; i++) {
+        while (!wait_for_frame(run->media->queue, WAIT_MS)) {}
+        AVFrame *frame = dequeue_frame(run->media->queue, NULL, NULL);
+        release_frame(run->media->pool, &frame);
+    }
+    return 0;
+}
+
+/**
+ * @brief hands references to a decoded picture from this thread to a consumer thread as fast as both can go
+ * one op is one frame enqueued, dequeued and released, the consumer thread is started per batch
+ */
+static bool run_queue_contended(struct bench_media *media, int64_t *ops) {
+    struct queue_run run = { .media = media, .frames = QUEUE_BATCH_FRAMES };
+    AVFrame *frame = av_frame_alloc();
+    SDL_Thread *consumer = frame ? SDL_CreateThread(queue_consumer, "consumer", &run) : NULL;
+    if (!consumer) {
+        fprintf(stderr, "couldn't start consumer\n");
+        av_frame_free(&frame);
+        return false;
+    }
+
+    bool ok = true;
+    for (int i = 0; i < run.frames; i++) {
+        if (av_frame_ref(frame, media->picture) < 0) {
+            ok = false;
+        }
+        while (!wait_for_space(media->queue, WAIT_MS)) {}
+        // a failed reference is still sent blank, so the consumer never waits on a frame that isn't coming
+        enqueue_frame(media->queue, frame, 0, NULL);
+    }
+
+    SDL_WaitThread(consumer, NULL);
+    av_frame_free(&frame);
+    *ops = run.frames;
+    return ok;
+}
+
+/**
+ * @brief decodes the demuxed video packets from the start, draining the queue after every packet
+ * one op is one frame queued
+ *
+ * @param media media holding the packets and decoder
+ * @param filters stages the frames go through
+ * @param ops set to the frames queued
+ * @return true on success, false otherwise
+ */
+static bool decode_video_packets(struct bench_media *media, const struct video_filters *filters, int64_t *ops) {
+    avcodec_flush_buffers(media->video_ctx);
+
+    int64_t frames = 0;
+    for (int i = 0; i < media->video_count; i++) {
+        if (!decode_video(media->video_ctx, media->video_packets[i], media->frame, media->queue, AV_NOPTS_VALUE,
+            &TAG, filters))
+        {
+            return false;
+        }
+        frames += drain_queue(media);
+    }
+
+    // the frames still held back for reordering
+    if (!decode_video(media->video_ctx, NULL, media->frame, media->queue, AV_NOPTS_VALUE, &TAG, filters)) {
+        return false;
+    }
+    frames += drain_queue(media);
+
+    *ops = frames;
+    return frames > 0;
+}
+
+static bool run_decode_video(struct bench_media *media, int64_t *ops) {
+    static const struct video_filters no_filters = {0};
+    return decode_video_packets(media, &no_filters, ops);
+}
+
+static bool run_decode_video_filtered(struct bench_media *media, int64_t *ops) {
+    if (!media->filters.ivtc || !media->filters.deint || !media->filters.tracker) {
+        fprintf(stderr, "couldn't create the video filters\n");
+        return false;
+    }
+    reset_telecine_filter(media->filters.ivtc);
+    reset_deinterlacer(media->filters.deint);
+    reset_damage_tracker(media->filters.tracker);
+    return decode_video_packets(media, &media->filters, ops);
+}
+
+/**
+ * @brief decodes and resamples the demuxed audio packets into an audio stream, one op is one packet
+ */
+static bool run_decode_audio(struct bench_media *media, int64_t *ops) {
+    avcodec_flush_buffers(media->audio_ctx);
+
+    for (int i = 0; i < media->audio_count; i++) {
+        if (!decode_audio(media->audio_ctx, media->audio_packets[i], media->frame, media->resampler, &media->scratch,
+            media->audio_stream, &media->audio_samples, NULL, &TAG))
+        {
+            return false;
+        }
+    }
+
+    SDL_ClearAudioStream(media->audio_stream);
+    SDL_SetAtomicU32(&media->audio_samples, 0);
+    *ops = media->audio_count;
+    return true;
+}
+
+/**
+ * @brief uploads the decoded picture into the texture ring, one op is one whole frame
+ */
+static bool run_upload(struct bench_media *media, int64_t *ops) {
+    const AVFrame *picture = media->picture;
+
+    for (int i = 0; i < UPLOAD_BATCH; i++) {
+        SDL_Texture *texture = media->textures[media->next_texture];
+        media->next_texture = (media->next_texture + 1) % TEXTURE_COUNT;
+
+        if (!SDL_UpdateYUVTexture(texture, NULL, picture->data[0], picture->linesize[0], picture->data[1],
+            picture->linesize[1], picture->data[2], picture->linesize[2]))
+        {
+            fprintf(stderr, "couldn't upload frame %s\n", SDL_GetError());
+            return false;
+        }
+    }
+
+    // renderers that batch work only really do it here
+    SDL_FlushRenderer(media->renderer);
+    *ops = UPLOAD_BATCH;
+    return true;
+}
+
+/**
+ * @brief schedules and presents frames that are due now on a vsync pacer whose vblank estimate has run ahead of
+ * the clock, as easing towards an early present can leave it. one op is one frame. a frame dropped or counted late,
+ * or an estimate still ahead of the clock after the present fails the batch, the grid arithmetic used to wrap on it
+ */
+static bool run_pacer_future_vblank(struct bench_media *media, int64_t *ops) {
+    frame_pacer pacer = { .period_ns = SDL_NS_PER_SECOND / PACER_HZ, .vsync = true, .shown_ms = -1.0 };
+    const double frame_ms = 1000.0 / PACER_HZ;
+
+    for (int i = 0; i < PACER_BATCH; i++) {
+        pacer.vblank_ns = SDL_GetTicksNS() + pacer.period_ns / 8;
+
+        if (schedule_frame(&pacer, 0.0, i * frame_ms, frame_ms) != PACE_PRESENT || pacer.late > 0) {
+            fprintf(stderr, "frame due now shown late with the vblank estimate ahead of the clock\n");
+            return false;
+        }
+        frame_presented(&pacer);
+        if (pacer.vblank_ns > SDL_GetTicksNS()) {
+            fprintf(stderr, "vblank estimate left ahead of the clock after a present\n");
+            return false;
+        }
+    }
+    *ops = PACER_BATCH;
+    return true;
+}
+
+static const struct micro_bench BENCHES[] = {
+    { "frame_queue/contended", run_queue_contended },
+    { "decode_video", run_decode_video },
+    { "decode_video/filtered", run_decode_video_filtered },
+    { "decode_audio", run_decode_audio },
+    { "upload/update_yuv_texture", run_upload },
+    { "frame_pacer/future_vblank", run_pacer_future_vblank },
+};
+#define BENCH_COUNT ((int)(sizeof(BENCHES) / sizeof(BENCHES[0])))
+
+/* ---- setup ---- */
+
+/**
+ * @brief opens a single threaded decoder for a stream, so the benchmarks measure one core
+ *
+ * @param format_context opened file
+ * @param stream_index stream to decode
+ * @param pool pool to decode pictures into, NULL for audio
+ * @return opened decoder, or NULL on failure
+ */
+static AVCodecContext *open_decoder(const AVFormatContext *format_context, const int stream_index, frame_pool *pool) {
+    const AVStream *stream = format_context->streams[stream_index];
+    const AVCodec *codec = avcodec_find_decoder(stream->codecpar->codec_id);
+    AVCodecContext *ctx = codec ? avcodec_alloc_context3(codec) : NULL;
+    if (!ctx || avcodec_parameters_to_context(ctx, stream->codecpar) < 0) {
+        avcodec_free_context(&ctx);
+        return NULL;
+    }
+
+    ctx->thread_count = 1;
+    ctx->pkt_timebase = stream->time_base;
+    if (pool) {
+        use_frame_pool(ctx, pool);
+    }
+    if (avcodec_open2(ctx, codec, NULL) < 0) {
+        avcodec_free_context(&ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+/**
+ * @brief demuxes the start of the fixture into memory
+ *
+ * @param media media to fill the packet arrays of, the file is opened
+ * @param video_stream index of the video stream
+ * @param audio_stream index of the audio stream
+ * @return true on success, false otherwise
+ */
+static bool demux_packets(struct bench_media *media, const int video_stream, const int audio_stream) {
+    AVPacket *packet = av_packet_alloc();
+    if (!packet) {
+        return false;
+    }
+
+    while (media->video_count < VIDEO_PACKETS && av_read_frame(media->format_context, packet) >= 0) {
+        AVPacket **slot = NULL;
+        if (packet->stream_index == video_stream) {
+            slot = &media->video_packets[media->video_count++];
+        } else if (packet->stream_index == audio_stream && media->audio_count < AUDIO_PACKETS) {
+            slot = &media->audio_packets[media->audio_count++];
+        }
+
+        if (slot) {
+            *slot = av_packet_alloc();
+            if (!*slot) {
+                av_packet_free(&packet);
+                return false;
+            }
+            av_packet_move_ref(*slot, packet);
+        }
+        av_packet_unref(packet);
+    }
+
+    av_packet_free(&packet);
+    return media->video_count > 0 && media->audio_count > 0;
+}
+
+/**
+ * @brief decodes the first picture of the demuxed video, for the queue and upload benchmarks
+ *
+ * @param media media with the packets and video decoder, picture is set
+ * @return true on success, false otherwise
+ */
+static bool decode_first_picture(struct bench_media *media) {
+    media->picture = av_frame_alloc();
+    if (!media->picture) {
+        return false;
+    }
+
+    for (int i = 0; i < media->video_count; i++) {
+        if (avcodec_send_packet(media->video_ctx, media->video_packets[i]) < 0) {
+            break;
+        }
+        if (avcodec_receive_frame(media->video_ctx, media->picture) == 0) {
+            avcodec_flush_buffers(media->video_ctx);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief creates a hidden window and the texture ring, on the dummy driver if there is no display
+ *
+ * @param media media to set the renderer and textures of
+ * @return true if there is a renderer to upload with, false otherwise
+ */
+static bool open_renderer(struct bench_media *media) {
+    if (!SDL_InitSubSystem(SDL_INIT_VIDEO)) {
+        SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "dummy");
+        if (!SDL_InitSubSystem(SDL_INIT_VIDEO)) {
+            return false;
+        }
+    }
+
+    if (!SDL_CreateWindowAndRenderer("micro_bench", media->picture->width, media->picture->height, SDL_WINDOW_HIDDEN,
+        &media->window, &media->renderer))
+    {
+        media->renderer = NULL;
+        return false;
+    }
+
+    for (int i = 0; i < TEXTURE_COUNT; i++) {
+        media->textures[i] = SDL_CreateTexture(media->renderer, SDL_PIXELFORMAT_IYUV, SDL_TEXTUREACCESS_STREAMING,
+            media->picture->width, media->picture->height);
+        if (!media->textures[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief opens the fixture, demuxes the packets and sets up everything the benchmarks share
+ *
+ * @param media zeroed media to set up
+ * @param path fixture to read
+ * @return true on success, false otherwise, close_media cleans up either way
+ */
+static bool open_media(struct bench_media *media, const char *path) {
+    if (avformat_open_input(&media->format_context, path, NULL, NULL) < 0 ||
+        avformat_find_stream_info(media->format_context, NULL) < 0)
+    {
+        fprintf(stderr, "couldn't open %s\n", path);
+        return false;
+    }
+    const int video_stream = av_find_best_stream(media->format_context, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    const int audio_stream = av_find_best_stream(media->format_context, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+    if (video_stream < 0 || audio_stream < 0 || !demux_packets(media, video_stream, audio_stream)) {
+        fprintf(stderr, "couldn't demux video and audio from %s\n", path);
+        return false;
+    }
+
+    media->pool = create_frame_pool(2 * VIDEO_BUFFER_CAP);
+    media->queue = media->pool ? create_frame_queue(media->pool, DEFAULT_VIDEO_QUEUE_BYTES) : NULL;
+    media->frame = av_frame_alloc();
+    if (!media->queue || !media->frame) {
+        fprintf(stderr, "couldn't create the frame pool and queue\n");
+        return false;
+    }
+
+    media->video_ctx = open_decoder(media->format_context, video_stream, media->pool);
+    media->audio_ctx = open_decoder(media->format_context, audio_stream, NULL);
+    if (!media->video_ctx || !media->audio_ctx) {
+        fprintf(stderr, "couldn't open decoders\n");
+        return false;
+    }
+
+    // the same conversion the audio decoder thread does
+    if (swr_alloc_set_opts2(&media->resampler, &(AVChannelLayout)AV_CHANNEL_LAYOUT_STEREO, AV_SAMPLE_FMT_S16, SAMPLE_RATE,
+        &media->audio_ctx->ch_layout, media->audio_ctx->sample_fmt, media->audio_ctx->sample_rate, 0, NULL) < 0 ||
+        swr_init(media->resampler) < 0)
+    {
+        fprintf(stderr, "couldn't create resampler\n");
+        return false;
+    }
+
+    const SDL_AudioSpec spec = { .freq = SAMPLE_RATE, .format = SDL_AUDIO_S16LE, .channels = 2 };
+    media->audio_stream = SDL_CreateAudioStream(&spec, &spec);
+    if (!media->audio_stream) {
+        fprintf(stderr, "couldn't create audio stream %s\n", SDL_GetError());
+        return false;
+    }
+    SDL_SetAtomicU32(&media->audio_samples, 0);
+
+    media->filters = (struct video_filters){
+        .ivtc = create_telecine_filter(media->pool),
+        .deint = create_deinterlacer(media->pool, NULL),
+        .tracker = create_damage_tracker(),
+    };
+
+    if (!decode_first_picture(media)) {
+        fprintf(stderr, "couldn't decode a picture\n");
+        return false;
+    }
+    if (!open_renderer(media)) {
+        fprintf(stderr, "no renderer, skipping uploads %s\n", SDL_GetError());
+    }
+    return true;
+}
+
+static void close_media(struct bench_media *media) {
+    for (int i = 0; i < TEXTURE_COUNT; i++) {
+        if (media->textures[i]) {
+            SDL_DestroyTexture(media->textures[i]);
+        }
+    }
+    if (media->renderer) {
+        SDL_DestroyRenderer(media->renderer);
+    }
+    if (media->window) {
+        SDL_DestroyWindow(media->window);
+    }
+
+    destroy_telecine_filter(media->filters.ivtc);
+    destroy_deinterlacer(media->filters.deint);
+    destroy_damage_tracker(media->filters.tracker);
+    if (media->audio_stream) {
+        SDL_DestroyAudioStream(media->audio_stream);
+    }
+    av_freep(&media->scratch.data);
+    swr_free(&media->resampler);
+
+    avcodec_free_context(&media->video_ctx);
+    avcodec_free_context(&media->audio_ctx);
+    av_frame_free(&media->frame);
+    av_frame_free(&media->picture);
+    if (media->queue) {
+        destroy_frameQueue(media->queue);
+    }
+    if (media->pool) {
+        destroy_frame_pool(media->pool);
+    }
+
+    for (int i = 0; i < media->video_count; i++) {
+        av_packet_free(&media->video_packets[i]);
+    }
+    for (int i = 0; i < media->audio_count; i++) {
+        av_packet_free(&media->audio_packets[i]);
+    }
+    avformat_close_input(&media->format_context);
+}
+
+/* ---- harness ---- */
+
+/**
+ * @brief runs a warm up batch, then measured batches until the minimum time is up
+ *
+ * @param bench benchmark to run
+ * @param media shared media
+ * @param min_ns least time to spend in measured batches
+ * @param result filled with the totals
+ * @return true on success, false if a batch failed
+ */
+static bool run_micro_bench(const struct micro_bench *bench, struct bench_media *media, const Uint64 min_ns,
+                            struct bench_result *result)
+{
+    *result = (struct bench_result){ .name = bench->name };
+
+    // fills the pools and caches, nothing after it should have to allocate them again
+    int64_t ops = 0;
+    if (!bench->run(media, &ops)) {
+        return false;
+    }
+
+    while (result->elapsed_ns < min_ns) {
+        uint64_t start_allocations, start_bytes;
+        read_allocations(&start_allocations, &start_bytes);
+        const Uint64 start_ns = SDL_GetTicksNS();
+
+        if (!bench->run(media, &ops)) {
+            return false;
+        }
+
+        const Uint64 elapsed_ns = SDL_GetTicksNS() - start_ns;
+        uint64_t allocations, bytes;
+        read_allocations(&allocations, &bytes);
+
+        result->batches++;
+        result->ops += ops;
+        result->elapsed_ns += elapsed_ns;
+        result->allocations += allocations - start_allocations;
+        result->allocated_bytes += bytes - start_bytes;
+    }
+    return result->ops > 0;
+}
+
+/**
+ * @brief writes the results as a JSON document
+ *
+ * @param file file to write to
+ * @param media shared media, described in the context
+ * @param results results to write
+ * @param count amount of them
+ */
+static void write_json(FILE *file, const struct bench_media *media, const struct bench_result *results, const int count) {
+    fprintf(file, "{\n  \"context\": {\n");
+    fprintf(file, "    \"renderer\": \"%s\",\n", media->renderer ? SDL_GetRendererName(media->renderer) : "none");
+    fprintf(file, "    \"video_packets\": %d,\n    \"audio_packets\": %d,\n", media->video_count, media->audio_count);
+    fprintf(file, "    \"counts_allocations\": %s\n  },\n", COUNTS_ALLOCATIONS ? "true" : "false");
+    fprintf(file, "  \"benchmarks\": [\n");
+
+    for (int i = 0; i < count; i++) {
+        const struct bench_result *result = &results[i];
+        const double ops = (double)result->ops;
+        fprintf(file, "    {\"name\": \"%s\", \"batches\": %d, \"ops\": %" PRId64 ", \"ns_per_op\": %.1f, ",
+            result->name, result->batches, result->ops, (double)result->elapsed_ns / ops);
+        if (COUNTS_ALLOCATIONS) {
+            fprintf(file, "\"allocs_per_op\": %.3f, \"bytes_per_op\": %.1f}",
+                (double)result->allocations / ops, (double)result->allocated_bytes / ops);
+        } else {
+            fprintf(file, "\"allocs_per_op\": null, \"bytes_per_op\": null}");
+        }
+        fprintf(file, "%s\n", i + 1 < count ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = DEFAULT_FIXTURE;
+    const char *filter = NULL;
+    const char *out_path = NULL;
+    double min_time_s = DEFAULT_MIN_TIME_S;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--fixture") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        } else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+            min_time_s = strtod(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--fixture path] [--min-time seconds] [--filter name] [--out results.json]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // the audio stream is never bound to a device
+    SDL_SetHint(SDL_HINT_AUDIO_DRIVER, "dummy");
+    if (!SDL_Init(SDL_INIT_AUDIO)) {
+        fprintf(stderr, "couldn't initialize SDL %s\n", SDL_GetError());
+        return 1;
+    }
+    if (!prepare_game_fixture(path)) {
+        fprintf(stderr, "couldn't prepare fixture %s\n", path);
+        return 1;
+    }
+
+    struct bench_media media = {0};
+    bool ok = open_media(&media, path);
+
+    struct bench_result results[BENCH_COUNT];
+    int count = 0;
+    for (int i = 0; i < BENCH_COUNT && ok; i++) {
+        const struct micro_bench *bench = &BENCHES[i];
+        if ((filter && !strstr(bench->name, filter)) || (bench->run == run_upload && !media.renderer)) {
+            continue;
+        }
+
+        ok = run_micro_bench(bench, &media, (Uint64)(min_time_s * SDL_NS_PER_SECOND), &results[count]);
+        if (!ok) {
+            fprintf(stderr, "%s failed\n", bench->name);
+            break;
+        }
+        const struct bench_result *result = &results[count++];
+        fprintf(stderr, "%-28s %12.1f ns/op %10.3f allocs/op %12.1f bytes/op over %" PRId64 " ops\n", result->name,
+            (double)result->elapsed_ns / (double)result->ops, (double)result->allocations / (double)result->ops,
+            (double)result->allocated_bytes / (double)result->ops, result->ops);
+    }
+
+    if (ok) {
+        FILE *file = out_path ? fopen(out_path, "w") : stdout;
+        if (file) {
+            write_json(file, &media, results, count);
+            if (out_path) {
+                fclose(file);
+            }
+        } else {
+            fprintf(stderr, "couldn't write %s\n", out_path);
+            ok = false;
+        }
+    }
+
+    close_media(&media);
+    SDL_Quit();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,300 @@
+/**
+ * @file telecine_bench.c
+ *
+ * Checks the inverse telecine against a synthetic hard telecined sequence and measures what it costs per frame.
+ * Eight 720x480 film frames with a bar moving across them are pulled down 3:2 top field first into
+ * AtAb BtBb BtCb CtDb DtDb cycles, timestamped 3003 ticks apart like 29.97 fps in a 90 kHz time base.
+ * The filter has to lock onto the cadence within three cycles and from then on drop the third frame of
+ * every cycle, give back every film frame exactly, so no combing is left, and space them 3753 or 3754
+ * ticks apart on the 23.976 fps timeline
+ *
+ * usage: telecine_bench [frames]
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavutil/frame.h>
+
+#include <frame_pool.h>
+#include <telecine.h>
+
+#define DEFAULT_FRAMES 2000
+#define FRAME_WIDTH 720
+#define FRAME_HEIGHT 480
+#define CYCLE_FRAMES 5             // decoded frames per 3:2 cycle
+#define CYCLE_FILM_FRAMES 4        // film frames they hold
+#define FILM_FRAMES 8              // distinct film frames cycled through, two cadence cycles
+#define TELECINED_FRAMES (FILM_FRAMES / CYCLE_FILM_FRAMES * CYCLE_FRAMES)
+#define REPEAT_PHASE 2             // BtCb, its top field repeats the frame before it
+#define LOCK_DEADLINE (3 * CYCLE_FRAMES)
+#define FRAME_DURATION 3003
+#define BAR_WIDTH 48
+#define BAR_STEP 24                // pixels the bar moves per film frame
+#define FRAME_BUDGET_MS (1000.0 / 30.0)
+
+// which film frame gives the top and the bottom field of each frame in a cycle
+static const int top_fields[CYCLE_FRAMES] = { 0, 1, 1, 2, 3 };
+static const int bottom_fields[CYCLE_FRAMES] = { 0, 1, 2, 3, 3 };
+// which film frame each kept frame of a locked cycle has to be, -1 for the dropped one
+static const int kept_film[CYCLE_FRAMES] = { 0, 1, -1, 2, 3 };
+
+/**
+ * @brief draws a progressive film frame, a still gradient background with a bar that moves from frame to frame
+ *
+ * @param frame frame with a 4:2:0 picture to draw into
+ * @param index which film frame in the sequence it is
+ */
+static void draw_film(AVFrame *frame, const int index) {
+    const int bar_x = index * BAR_STEP % (frame->width - BAR_WIDTH);
+    for (int y = 0; y < frame->height; y++) {
+        uint8_t *row = frame->data[0] + (size_t)y * frame->linesize[0];
+        for (int x = 0; x < frame->width; x++) {
+            row[x] = x >= bar_x && x < bar_x + BAR_WIDTH ? 235 : (uint8_t)(16 + (x + y) % 200);
+        }
+    }
+    for (int plane = 1; plane < 3; plane++) {
+        for (int y = 0; y < (frame->height + 1) / 2; y++) {
+            uint8_t *row = frame->data[plane] + (size_t)y * frame->linesize[plane];
+            for (int x = 0; x < (frame->width + 1) / 2; x++) {
+                row[x] = x >= bar_x / 2 && x < (bar_x + BAR_WIDTH) / 2 ? (uint8_t)(plane * 80) : 128;
+            }
+        }
+    }
+}
+
+/**
+ * @brief builds a telecined frame from the top field of one film frame and the bottom field of another
+ * chroma rows alternate between the fields the same way the filter weaves them
+ *
+ * @param frame frame with a 4:2:0 picture to build in
+ * @param top film frame giving the even rows
+ * @param bottom film frame giving the odd rows
+ */
+static void weave_fields(AVFrame *frame, const AVFrame *top, const AVFrame *bottom) {
+    for (int plane = 0; plane < 3; plane++) {
+        const int width = plane ? (frame->width + 1) / 2 : frame->width;
+        const int height = plane ? (frame->height + 1) / 2 : frame->height;
+        for (int y = 0; y < height; y++) {
+            const AVFrame *source = y & 1 ? bottom : top;
+            memcpy(frame->data[plane] + (size_t)y * frame->linesize[plane],
+                source->data[plane] + (size_t)y * source->linesize[plane], width);
+        }
+    }
+    frame->flags |= AV_FRAME_FLAG_INTERLACED | AV_FRAME_FLAG_TOP_FIELD_FIRST;
+}
+
+/**
+ * @brief compares the visible part of two pictures
+ *
+ * @return true if every pixel matches
+ */
+static bool same_picture(const AVFrame *a, const AVFrame *b) {
+    for (int plane = 0; plane < 3; plane++) {
+        const int width = plane ? (a->width + 1) / 2 : a->width;
+        const int height = plane ? (a->height + 1) / 2 : a->height;
+        for (int y = 0; y < height; y++) {
+            if (memcmp(a->data[plane] + (size_t)y * a->linesize[plane],
+                       b->data[plane] + (size_t)y * b->linesize[plane], width) != 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief allocates a blank 720x480 4:2:0 frame with a pooled picture
+ *
+ * @param pool pool the picture comes from
+ * @return frame, or NULL on failure
+ */
+static AVFrame *create_picture(frame_pool *pool) {
+    AVFrame *frame = av_frame_alloc();
+    if (!frame) return NULL;
+
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = FRAME_WIDTH;
+    frame->height = FRAME_HEIGHT;
+    if (!acquire_picture(pool, frame)) {
+        av_frame_free(&frame);
+    }
+    return frame;
+}
+
+/**
+ * @brief runs the telecined frames through the filter, checking its decisions and output once it has locked
+ *
+ * @param pool pool the matched pictures come from
+ * @param film film frames the output is checked against
+ * @param telecined telecined frames, referenced rather than copied for every frame
+ * @param frames frames to filter
+ * @return true if the filter did everything it should, false otherwise
+ */
+static bool run_bench(frame_pool *pool, AVFrame *const *film, AVFrame *const *telecined, const int frames) {
+    telecine_filter *ivtc = create_telecine_filter(pool);
+    AVFrame *frame = av_frame_alloc();
+    if (!ivtc || !frame) {
+        fprintf(stderr, "couldn't set up the inverse telecine\n");
+        destroy_telecine_filter(ivtc);
+        av_frame_free(&frame);
+        return false;
+    }
+
+    bool ok = true;
+    int lock_frame = -1;
+    int dropped = 0;
+    int kept = 0;
+    int64_t first_kept_pts = AV_NOPTS_VALUE;
+    int64_t last_kept_pts = AV_NOPTS_VALUE;
+    Uint64 total_ns = 0;
+    Uint64 worst_ns = 0;
+    for (int i = 0; i < frames && ok; i++) {
+        const int cycle = i / CYCLE_FRAMES;
+        const int phase = i % CYCLE_FRAMES;
+        if (av_frame_ref(frame, telecined[cycle % 2 * CYCLE_FRAMES + phase]) < 0) {
+            fprintf(stderr, "couldn't reference telecined frame\n");
+            ok = false;
+            break;
+        }
+        frame->pts = (int64_t)i * FRAME_DURATION;
+        frame->best_effort_timestamp = frame->pts;
+
+        const bool locked = lock_frame >= 0;
+        const Uint64 start_ns = SDL_GetTicksNS();
+        const enum telecine_decision decision = inverse_telecine(ivtc, frame);
+        const Uint64 elapsed_ns = SDL_GetTicksNS() - start_ns;
+        total_ns += elapsed_ns;
+        if (elapsed_ns > worst_ns) {
+            worst_ns = elapsed_ns;
+        }
+
+        if (!locked) {
+            if (ivtc->film) {
+                // it locks on a repeat, which is the first frame it drops
+                lock_frame = i;
+                dropped += decision == TELECINE_DROP;
+                if (phase != REPEAT_PHASE || decision != TELECINE_DROP) {
+                    fprintf(stderr, "locked on frame %d, phase %d, without dropping it\n", i, phase);
+                    ok = false;
+                }
+            } else if (i >= LOCK_DEADLINE) {
+                fprintf(stderr, "no cadence lock after %d frames\n", LOCK_DEADLINE);
+                ok = false;
+            }
+            av_frame_unref(frame);
+            continue;
+        }
+
+        if (!ivtc->film) {
+            fprintf(stderr, "lost the cadence on frame %d\n", i);
+            ok = false;
+        } else if ((decision == TELECINE_DROP) != (phase == REPEAT_PHASE)) {
+            fprintf(stderr, "frame %d, phase %d, was %s\n", i, phase, decision == TELECINE_DROP ? "dropped" : "kept");
+            ok = false;
+        } else if (decision == TELECINE_DROP) {
+            dropped++;
+        } else {
+            const AVFrame *expected = film[cycle % 2 * CYCLE_FILM_FRAMES + kept_film[phase]];
+            if (!same_picture(frame, expected) || (frame->flags & AV_FRAME_FLAG_INTERLACED)) {
+                fprintf(stderr, "frame %d, phase %d, isn't the film frame it holds\n", i, phase);
+                ok = false;
+            }
+
+            // 5 decoded frames in the time of 4 film frames, the remainder spread so it never drifts
+            const int64_t spacing = last_kept_pts == AV_NOPTS_VALUE ? 0 : frame->pts - last_kept_pts;
+            if (last_kept_pts != AV_NOPTS_VALUE && spacing != FRAME_DURATION * CYCLE_FRAMES / CYCLE_FILM_FRAMES &&
+                spacing != FRAME_DURATION * CYCLE_FRAMES / CYCLE_FILM_FRAMES + 1) {
+                fprintf(stderr, "frame %d is %" PRId64 " ticks after the last one kept\n", i, spacing);
+                ok = false;
+            }
+            if (first_kept_pts == AV_NOPTS_VALUE) {
+                first_kept_pts = frame->pts;
+            }
+            last_kept_pts = frame->pts;
+            kept++;
+        }
+        av_frame_unref(frame);
+    }
+
+    if (ok && lock_frame < 0) {
+        fprintf(stderr, "no cadence lock after %d frames\n", frames);
+        ok = false;
+    }
+    if (ok && kept > 1) {
+        // the small steps have to add up to exactly 4 film frames per cycle
+        const int64_t span = last_kept_pts - first_kept_pts;
+        const int64_t expected_span = (int64_t)(kept - 1) * FRAME_DURATION * CYCLE_FRAMES / CYCLE_FILM_FRAMES;
+        if (span != expected_span) {
+            fprintf(stderr, "film frames drifted, %" PRId64 " ticks instead of %" PRId64 "\n", span, expected_span);
+            ok = false;
+        }
+    }
+    if (ok) {
+        const double average_ms = (double)total_ns / frames / SDL_NS_PER_MS;
+        printf("locked on frame %d, %d repeats dropped, %d film frames kept and respaced\n", lock_frame, dropped, kept);
+        printf("%8d frames %8.3f ms/frame avg %8.3f ms worst %6.2f%% of the %.1f ms frame budget\n",
+            frames, average_ms, (double)worst_ns / SDL_NS_PER_MS, 100.0 * average_ms / FRAME_BUDGET_MS,
+            FRAME_BUDGET_MS);
+    }
+
+    destroy_telecine_filter(ivtc);
+    av_frame_free(&frame);
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    const int frames = argc > 1 ? atoi(argv[1]) : DEFAULT_FRAMES;
+    if (frames < LOCK_DEADLINE + 2 * CYCLE_FRAMES) {
+        fprintf(stderr, "usage: %s [frames], at least %d\n", argv[0], LOCK_DEADLINE + 2 * CYCLE_FRAMES);
+        return 1;
+    }
+
+    frame_pool *pool = create_frame_pool(FILM_FRAMES + TELECINED_FRAMES);
+    if (!pool) {
+        fprintf(stderr, "couldn't create frame pool\n");
+        return 1;
+    }
+
+    AVFrame *film[FILM_FRAMES] = {0};
+    AVFrame *telecined[TELECINED_FRAMES] = {0};
+    bool ok = true;
+    for (int i = 0; i < FILM_FRAMES && ok; i++) {
+        film[i] = create_picture(pool);
+        ok = film[i] != NULL;
+        if (ok) {
+            draw_film(film[i], i);
+        }
+    }
+    for (int i = 0; i < TELECINED_FRAMES && ok; i++) {
+        const int first_film = i / CYCLE_FRAMES * CYCLE_FILM_FRAMES;
+        telecined[i] = create_picture(pool);
+        ok = telecined[i] != NULL;
+        if (ok) {
+            weave_fields(telecined[i], film[first_film + top_fields[i % CYCLE_FRAMES]],
+                film[first_film + bottom_fields[i % CYCLE_FRAMES]]);
+        }
+    }
+    if (!ok) {
+        fprintf(stderr, "couldn't create source frames\n");
+    }
+
+    ok = ok && run_bench(pool, film, telecined, frames);
+
+    for (int i = 0; i < FILM_FRAMES; i++) {
+        av_frame_free(&film[i]);
+    }
+    for (int i = 0; i < TELECINED_FRAMES; i++) {
+        av_frame_free(&telecined[i]);
+    }
+    destroy_frame_pool(pool);
+    SDL_Quit();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,411 @@
+/**
+ * @file vob_fixture.c
+ *
+ * encodes the synthetic vob used by the benchmarks
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/mem.h>
+
+#include <vob_fixture.h>
+#include <vob_index.h>
+#include <game_states.h>
+
+#define FIXTURE_WIDTH 720
+#define FIXTURE_HEIGHT 480
+#define VIDEO_BIT_RATE 6000000                 // average rate, in the range the disc's menus use
+#define VIDEO_MAX_RATE 9000000                 // under the 9.8 Mbps dvd ceiling
+#define VIDEO_BUFFER_BITS (224 * 1024 * 8)     // dvd vbv buffer
+#define GOP_FRAMES 15                          // closed gops, so every segment and every gop decodes on its own
+#define B_FRAMES 2
+#define AUDIO_SAMPLE_RATE 48000
+#define AUDIO_BIT_RATE 192000
+
+#define FILL_TARGET 0.9                        // share of a segment the first encode aims for
+#define REFILL_TARGET 0.95                     // share aimed for when an encode came out too big and is redone shorter
+#define MAX_ATTEMPTS 4
+
+#define BAR_WIDTH 48
+#define BAR_STEP 12                            // pixels the bar moves per field
+#define SCROLL_STEP 2                          // pixels the background moves per field
+
+#define PACK_HEADER_BYTES 14
+#define PES_HEADER_BYTES 6
+
+/**
+ * @struct segment_encoder
+ * @brief encoders and muxer for one segment, the muxer writes into a memory buffer so the size can be checked first
+ */
+struct segment_encoder {
+    AVFormatContext *mux;                      /**< dvd muxer writing into a dynamic buffer */
+    AVCodecContext *video;                     /**< mpeg-2 video encoder */
+    AVCodecContext *audio;                     /**< ac-3 audio encoder */
+    AVStream *video_stream;                    /**< muxed video stream */
+    AVStream *audio_stream;                    /**< muxed audio stream */
+    AVFrame *picture;                          /**< reused picture drawn into for every frame */
+    AVFrame *samples;                          /**< reused audio frame filled for every encoder frame */
+    AVPacket *packet;                          /**< reused encoded packet */
+};
+
+/**
+ * @brief frees everything an encoder holds, including any output it hasn't handed over
+ *
+ * @param enc encoder to free, can be partially opened
+ */
+static void free_segment_encoder(struct segment_encoder *enc) {
+    if (enc->mux && enc->mux->pb) {
+        uint8_t *buffer = NULL;
+        avio_close_dyn_buf(enc->mux->pb, &buffer);
+        av_free(buffer);
+        enc->mux->pb = NULL;
+    }
+    avformat_free_context(enc->mux);
+    avcodec_free_context(&enc->video);
+    avcodec_free_context(&enc->audio);
+    av_frame_free(&enc->picture);
+    av_frame_free(&enc->samples);
+    av_packet_free(&enc->packet);
+    memset(enc, 0, sizeof(*enc));
+}
+
+/**
+ * @brief opens the encoders and starts the muxer
+ *
+ * @param enc zeroed encoder to open
+ * @return true on success, false otherwise, free_segment_encoder cleans up either way
+ */
+static bool open_segment_encoder(struct segment_encoder *enc) {
+    if (avformat_alloc_output_context2(&enc->mux, NULL, "dvd", NULL) < 0 || avio_open_dyn_buf(&enc->mux->pb) < 0) {
+        fprintf(stderr, "couldn't create dvd muxer\n");
+        return false;
+    }
+
+    const AVCodec *video_codec = avcodec_find_encoder(AV_CODEC_ID_MPEG2VIDEO);
+    const AVCodec *audio_codec = avcodec_find_encoder(AV_CODEC_ID_AC3);
+    if (!video_codec || !audio_codec) {
+        fprintf(stderr, "couldn't find mpeg-2 and ac-3 encoders\n");
+        return false;
+    }
+    enc->video = avcodec_alloc_context3(video_codec);
+    enc->audio = avcodec_alloc_context3(audio_codec);
+    if (!enc->video || !enc->audio) {
+        fprintf(stderr, "couldn't allocate encoders\n");
+        return false;
+    }
+
+    // interlaced ntsc dvd video, top field first like the disc
+    enc->video->width = FIXTURE_WIDTH;
+    enc->video->height = FIXTURE_HEIGHT;
+    enc->video->pix_fmt = AV_PIX_FMT_YUV420P;
+    enc->video->time_base = (AVRational){ 1001, 30000 };
+    enc->video->framerate = (AVRational){ 30000, 1001 };
+    enc->video->sample_aspect_ratio = (AVRational){ 8, 9 };
+    enc->video->field_order = AV_FIELD_TT;
+    enc->video->bit_rate = VIDEO_BIT_RATE;
+    enc->video->rc_max_rate = VIDEO_MAX_RATE;
+    enc->video->rc_buffer_size = VIDEO_BUFFER_BITS;
+    enc->video->gop_size = GOP_FRAMES;
+    enc->video->max_b_frames = B_FRAMES;
+    enc->video->flags |= AV_CODEC_FLAG_CLOSED_GOP | AV_CODEC_FLAG_INTERLACED_DCT | AV_CODEC_FLAG_INTERLACED_ME;
+
+    enc->audio->sample_fmt = AV_SAMPLE_FMT_FLTP;
+    enc->audio->sample_rate = AUDIO_SAMPLE_RATE;
+    enc->audio->time_base = (AVRational){ 1, AUDIO_SAMPLE_RATE };
+    enc->audio->bit_rate = AUDIO_BIT_RATE;
+    av_channel_layout_default(&enc->audio->ch_layout, 2);
+
+    if (avcodec_open2(enc->video, video_codec, NULL) < 0 || avcodec_open2(enc->audio, audio_codec, NULL) < 0) {
+        fprintf(stderr, "couldn't open encoders\n");
+        return false;
+    }
+
+    enc->video_stream = avformat_new_stream(enc->mux, NULL);
+    enc->audio_stream = avformat_new_stream(enc->mux, NULL);
+    if (!enc->video_stream || !enc->audio_stream ||
+        avcodec_parameters_from_context(enc->video_stream->codecpar, enc->video) < 0 ||
+        avcodec_parameters_from_context(enc->audio_stream->codecpar, enc->audio) < 0)
+    {
+        fprintf(stderr, "couldn't add streams to the muxer\n");
+        return false;
+    }
+    enc->video_stream->time_base = enc->video->time_base;
+    enc->audio_stream->time_base = enc->audio->time_base;
+
+    enc->picture = av_frame_alloc();
+    enc->samples = av_frame_alloc();
+    enc->packet = av_packet_alloc();
+    if (!enc->picture || !enc->samples || !enc->packet) {
+        fprintf(stderr, "couldn't allocate encoder frames\n");
+        return false;
+    }
+    enc->picture->format = enc->video->pix_fmt;
+    enc->picture->width = enc->video->width;
+    enc->picture->height = enc->video->height;
+    enc->samples->format = enc->audio->sample_fmt;
+    enc->samples->sample_rate = enc->audio->sample_rate;
+    enc->samples->nb_samples = enc->audio->frame_size;
+    if (av_frame_get_buffer(enc->picture, 0) < 0 ||
+        av_channel_layout_copy(&enc->samples->ch_layout, &enc->audio->ch_layout) < 0 ||
+        av_frame_get_buffer(enc->samples, 0) < 0)
+    {
+        fprintf(stderr, "couldn't allocate encoder buffers\n");
+        return false;
+    }
+
+    if (avformat_write_header(enc->mux, NULL) < 0) {
+        fprintf(stderr, "couldn't write program stream header\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief muxes every packet an encoder has ready
+ *
+ * @param enc encoder holding the muxer
+ * @param codec encoder to drain
+ * @param stream stream its packets belong to
+ * @return true on success, false otherwise
+ */
+static bool mux_packets(struct segment_encoder *enc, AVCodecContext *codec, const AVStream *stream) {
+    int ret;
+    while ((ret = avcodec_receive_packet(codec, enc->packet)) >= 0) {
+        av_packet_rescale_ts(enc->packet, codec->time_base, stream->time_base);
+        enc->packet->stream_index = stream->index;
+        if (av_interleaved_write_frame(enc->mux, enc->packet) < 0) {
+            fprintf(stderr, "couldn't mux packet\n");
+            return false;
+        }
+    }
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF;
+}
+
+/**
+ * @brief draws a scrolling textured background with a bar crossing it, the bottom field half a frame after the top.
+ * every segment is tinted differently so they can be told apart
+ *
+ * @param picture writable picture to draw into
+ * @param segment segment the frame belongs to
+ * @param index frame number in the segment
+ */
+static void draw_picture(AVFrame *picture, const int segment, const int64_t index) {
+    for (int y = 0; y < picture->height; y++) {
+        const int field_time = (int)(index * 2 + (y & 1));
+        const int bar_x = field_time * BAR_STEP % (picture->width - BAR_WIDTH);
+        const int scroll = field_time * SCROLL_STEP;
+        uint8_t *row = picture->data[0] + (size_t)y * picture->linesize[0];
+        for (int x = 0; x < picture->width; x++) {
+            const int texture = ((x + scroll) ^ (y * 3)) * 7 % 160;
+            row[x] = x >= bar_x && x < bar_x + BAR_WIDTH ? 235 : (uint8_t)(32 + texture);
+        }
+    }
+    for (int plane = 1; plane < 3; plane++) {
+        const int tint = 128 + ((segment + plane) % 3 - 1) * 40;
+        for (int y = 0; y < picture->height / 2; y++) {
+            uint8_t *row = picture->data[plane] + (size_t)y * picture->linesize[plane];
+            for (int x = 0; x < picture->width / 2; x++) {
+                row[x] = (uint8_t)(tint + (x / 8 + y / 8) % 16 - 8);
+            }
+        }
+    }
+}
+
+/**
+ * @brief fills a frame of stereo audio with a tone whose pitch depends on the segment
+ *
+ * @param samples writable planar float frame to fill
+ * @param segment segment the audio belongs to
+ * @param first_sample sample number of the frame's first sample in the segment
+ */
+static void fill_tone(AVFrame *samples, const int segment, const int64_t first_sample) {
+    const int frequency = 220 * (segment + 1);
+    for (int i = 0; i < samples->nb_samples; i++) {
+        // whole hertz tones repeat every second, keeps the phase exact however far into the segment
+        const int64_t phase = (first_sample + i) * frequency % AUDIO_SAMPLE_RATE;
+        const float value = 0.2f * SDL_sinf((float)(2.0 * SDL_PI_D * (double)phase / AUDIO_SAMPLE_RATE));
+        for (int channel = 0; channel < samples->ch_layout.nb_channels; channel++) {
+            ((float *)samples->data[channel])[i] = value;
+        }
+    }
+}
+
+/**
+ * @brief encodes one segment into memory
+ *
+ * @param segment index of the segment, picks its tint and tone
+ * @param frames video frames to encode, audio covers the same time
+ * @param output set to the muxed segment, free with av_free
+ * @return size of the output in bytes, negative on failure
+ */
+static int64_t encode_segment(const int segment, const int64_t frames, uint8_t **output) {
+    struct segment_encoder enc = {0};
+    if (!open_segment_encoder(&enc)) {
+        free_segment_encoder(&enc);
+        return -1;
+    }
+
+    int64_t video_frame = 0;
+    int64_t audio_sample = 0;
+    bool ok = true;
+    while (ok && video_frame < frames) {
+        // feeds whichever stream is behind, so the muxer gets them interleaved
+        if (av_compare_ts(video_frame, enc.video->time_base, audio_sample, enc.audio->time_base) <= 0) {
+            ok = av_frame_make_writable(enc.picture) >= 0;
+            if (ok) {
+                draw_picture(enc.picture, segment, video_frame);
+                enc.picture->pts = video_frame++;
+                enc.picture->flags |= AV_FRAME_FLAG_INTERLACED | AV_FRAME_FLAG_TOP_FIELD_FIRST;
+                ok = avcodec_send_frame(enc.video, enc.picture) >= 0 && mux_packets(&enc, enc.video, enc.video_stream);
+            }
+        } else {
+            ok = av_frame_make_writable(enc.samples) >= 0;
+            if (ok) {
+                fill_tone(enc.samples, segment, audio_sample);
+                enc.samples->pts = audio_sample;
+                audio_sample += enc.samples->nb_samples;
+                ok = avcodec_send_frame(enc.audio, enc.samples) >= 0 && mux_packets(&enc, enc.audio, enc.audio_stream);
+            }
+        }
+    }
+
+    // drains the encoders and the muxer
+    ok = ok && avcodec_send_frame(enc.video, NULL) >= 0 && mux_packets(&enc, enc.video, enc.video_stream) &&
+        avcodec_send_frame(enc.audio, NULL) >= 0 && mux_packets(&enc, enc.audio, enc.audio_stream) &&
+        av_write_trailer(enc.mux) >= 0;
+    if (!ok) {
+        fprintf(stderr, "couldn't encode fixture segment %d\n", segment);
+        free_segment_encoder(&enc);
+        return -1;
+    }
+
+    const int64_t size = avio_close_dyn_buf(enc.mux->pb, output);
+    enc.mux->pb = NULL;
+    free_segment_encoder(&enc);
+    return size;
+}
+
+/**
+ * @brief builds a sector that is nothing but a pack header and a padding packet, the demuxer skips it
+ *
+ * @param sector DVD_SECTOR_SIZE bytes to fill
+ */
+static void build_padding_sector(uint8_t *sector) {
+    // mpeg-2 pack header, scr 0 at the dvd mux rate of 25200 * 50 bytes per second, no stuffing
+    static const uint8_t pack_header[PACK_HEADER_BYTES] = {
+        0x00, 0x00, 0x01, 0xBA, 0x44, 0x00, 0x04, 0x00, 0x04, 0x01, 0x01, 0x89, 0xC3, 0xF8,
+    };
+    const int padding_bytes = DVD_SECTOR_SIZE - PACK_HEADER_BYTES - PES_HEADER_BYTES;
+
+    memcpy(sector, pack_header, PACK_HEADER_BYTES);
+    uint8_t *pes = sector + PACK_HEADER_BYTES;
+    pes[0] = 0x00;
+    pes[1] = 0x00;
+    pes[2] = 0x01;
+    pes[3] = 0xBE;
+    pes[4] = (uint8_t)(padding_bytes >> 8);
+    pes[5] = (uint8_t)(padding_bytes & 0xFF);
+    memset(pes + PES_HEADER_BYTES, 0xFF, padding_bytes);
+}
+
+bool write_vob_fixture(const char *path, const uint32_t *segment_offsets, const int segment_count, const uint64_t total_bytes) {
+    if (segment_count < 1 || segment_offsets[0] != 0 || total_bytes % DVD_SECTOR_SIZE != 0 ||
+        total_bytes <= segment_offsets[segment_count - 1])
+    {
+        fprintf(stderr, "fixture layout doesn't start at 0 or doesn't end on a sector past its last segment\n");
+        return false;
+    }
+    for (int i = 0; i < segment_count; i++) {
+        if (segment_offsets[i] % DVD_SECTOR_SIZE != 0 || (i > 0 && segment_offsets[i] <= segment_offsets[i - 1])) {
+            fprintf(stderr, "fixture segment %d isn't sector aligned after the one before it\n", i);
+            return false;
+        }
+    }
+
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "couldn't create %s\n", path);
+        return false;
+    }
+
+    uint8_t padding[DVD_SECTOR_SIZE];
+    build_padding_sector(padding);
+    static const uint8_t zeroes[DVD_SECTOR_SIZE] = {0};
+
+    bool ok = true;
+    for (int i = 0; i < segment_count && ok; i++) {
+        const uint64_t end = i + 1 < segment_count ? segment_offsets[i + 1] : total_bytes;
+        const uint64_t segment_bytes = end - segment_offsets[i];
+
+        // sizes the segment from the bitrate, then shrinks it until the muxed output fits
+        const double bytes_per_frame = (double)(VIDEO_BIT_RATE + AUDIO_BIT_RATE) / 8.0 * 1001.0 / 30000.0;
+        int64_t frames = (int64_t)(FILL_TARGET * (double)segment_bytes / bytes_per_frame);
+        uint8_t *output = NULL;
+        int64_t size = -1;
+        for (int attempt = 0; attempt < MAX_ATTEMPTS && frames > 0; attempt++) {
+            size = encode_segment(i, frames, &output);
+            if (size < 0 || (uint64_t)size <= segment_bytes) {
+                break;
+            }
+            av_freep(&output);
+            frames = (int64_t)((double)frames * REFILL_TARGET * (double)segment_bytes / (double)size);
+            size = -1;
+        }
+        if (size < 0) {
+            fprintf(stderr, "couldn't fit fixture segment %d into %" PRIu64 " bytes\n", i, segment_bytes);
+            ok = false;
+            break;
+        }
+        printf("fixture segment %d: %" PRId64 " frames, %" PRId64 " of %" PRIu64 " bytes\n", i, frames, size, segment_bytes);
+
+        // the trailer's end code leaves the output off a sector boundary, zeroes are skipped over by the demuxer
+        uint64_t remaining = segment_bytes - (uint64_t)size;
+        const size_t alignment = (size_t)(remaining % DVD_SECTOR_SIZE);
+        ok = fwrite(output, 1, (size_t)size, file) == (size_t)size && fwrite(zeroes, 1, alignment, file) == alignment;
+        av_free(output);
+        remaining -= alignment;
+
+        for (; ok && remaining > 0; remaining -= DVD_SECTOR_SIZE) {
+            ok = fwrite(padding, 1, DVD_SECTOR_SIZE, file) == DVD_SECTOR_SIZE;
+        }
+        if (!ok) {
+            fprintf(stderr, "couldn't write %s\n", path);
+        }
+    }
+
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+    return ok;
+}
+
+bool prepare_game_fixture(const char *path) {
+    uint32_t offsets[STATE_COUNT];
+    for (int i = 0; i < STATE_COUNT; i++) {
+        offsets[i] = GAME_STATES[i].start_offset_bytes;
+    }
+    const uint64_t total_bytes = (uint64_t)GAME_STATES[STATE_COUNT - 1].end_offset_bytes + DVD_SECTOR_SIZE;
+
+    SDL_PathInfo info;
+    if (SDL_GetPathInfo(path, &info) && info.type == SDL_PATHTYPE_FILE && info.size == total_bytes) {
+        return true;
+    }
+
+    printf("writing %" PRIu64 " byte fixture to %s\n", total_bytes, path);
+    const Uint64 start_ns = SDL_GetTicksNS();
+    if (!write_vob_fixture(path, offsets, STATE_COUNT, total_bytes)) {
+        return false;
+    }
+    printf("fixture written in %.1f s\n", (double)(SDL_GetTicksNS() - start_ns) / SDL_NS_PER_SECOND);
+    return true;
+}
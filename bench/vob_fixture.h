@@ -0,0 +1,39 @@
+/**
+ * @file vob_fixture.h
+ *
+ * Writes a synthetic stand in for the game's vob, so the pipeline can be run without the disc.
+ * Every segment is an MPEG-2 program stream of its own, 720x480 interlaced MPEG-2 video and 48kHz stereo
+ * AC-3 audio, with timestamps starting over like the cells of a dvd. Each one starts exactly at its byte offset,
+ * the gaps up to the next one are filled with padding packs
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#ifndef VOB_FIXTURE_H
+#define VOB_FIXTURE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief encodes a fixture and writes it over whatever is at the path
+ *
+ * @param path file to write
+ * @param segment_offsets byte offset of every segment, ascending, sector aligned and starting at 0
+ * @param segment_count amount of segments
+ * @param total_bytes size of the whole file, sector aligned and past the last offset
+ * @return true on success, false otherwise
+ */
+bool write_vob_fixture(const char *path, const uint32_t *segment_offsets, int segment_count, uint64_t total_bytes);
+
+/**
+ * @brief checks there is a fixture laid out for the current GAME_STATES at the path, writing a new one otherwise
+ * every state gets its own segment, starting at its start offset
+ *
+ * @param path where the fixture lives
+ * @return true if a usable fixture is in place, false otherwise
+ */
+bool prepare_game_fixture(const char *path);
+
+#endif //VOB_FIXTURE_H
@@ -0,0 +1,135 @@
+/**
+ * @file audio_clock.c
+ *
+ * helper functions for the audio_clock struct
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#include <SDL3/SDL.h>
+#include <math.h>
+#include <stdint.h>
+
+#include <audio_clock.h>
+
+#define DEFAULT_PERIOD_SAMPLES 1024.0 // device buffer assumed if the device won't say
+#define LATENCY_PERIODS 2.0           // the buffer being played plus the one just pulled
+#define CALIBRATION_WEIGHT 0.05       // weight of each pull in the smoothed period and rate
+#define MAX_RATE_ERROR 0.05           // measured rates further than this from nominal are stalls, not drift
+
+#define SMOOTHING_WEIGHT 0.1          // how much of the gap to the raw position is closed per call
+#define SNAP_MS 40.0                  // gaps bigger than this are jumps, not jitter, and are taken as is
+
+audio_clock *create_audio_clock(SDL_AudioStream *stream, const SDL_AudioSpec *spec) {
+    audio_clock *clock = calloc(1, sizeof(audio_clock));
+    if (!clock) return NULL;
+
+    clock->sample_rate = spec->freq;
+    clock->frame_size = SDL_AUDIO_FRAMESIZE(*spec);
+    clock->measured_rate = spec->freq;
+    clock->period_samples = DEFAULT_PERIOD_SAMPLES;
+    clock->resets = 1;
+
+    // the device's buffer size is the starting guess, pulls calibrate it from there
+    SDL_AudioSpec device_spec;
+    int device_frames = 0;
+    if (SDL_GetAudioDeviceFormat(SDL_GetAudioStreamDevice(stream), &device_spec, &device_frames) &&
+        device_frames > 0 && device_spec.freq > 0)
+    {
+        clock->period_samples = (double)device_frames * spec->freq / device_spec.freq;
+    }
+
+    return clock;
+}
+
+void audio_clock_pulled(audio_clock *clock, const int additional_amount, const int total_amount) {
+    const Uint64 now_ns = SDL_GetTicksNS();
+
+    // whatever the stream was short of is padded with silence and doesn't advance playback
+    const int pulled_bytes = total_amount - additional_amount;
+    const uint32_t pulled = pulled_bytes > 0 ? (uint32_t)(pulled_bytes / clock->frame_size) : 0;
+
+    SDL_LockSpinlock(&clock->lock);
+
+    if (pulled == 0) {
+        // an empty pull breaks the interval the rate is measured over
+        clock->pull_ns = 0;
+        SDL_UnlockSpinlock(&clock->lock);
+        return;
+    }
+
+    // the previous pull played out over the time since it happened
+    if (clock->pull_ns && clock->last_pulled) {
+        const double rate = (double)clock->last_pulled * SDL_NS_PER_SECOND / (double)(now_ns - clock->pull_ns);
+        if (fabs(rate - clock->sample_rate) < clock->sample_rate * MAX_RATE_ERROR) {
+            clock->measured_rate += (rate - clock->measured_rate) * CALIBRATION_WEIGHT;
+        }
+    }
+    clock->period_samples += ((double)pulled - clock->period_samples) * CALIBRATION_WEIGHT;
+
+    clock->consumed_samples += pulled;
+    clock->last_pulled = pulled;
+    clock->pull_ns = now_ns;
+
+    SDL_UnlockSpinlock(&clock->lock);
+}
+
+void reset_audio_clock(audio_clock *clock) {
+    SDL_LockSpinlock(&clock->lock);
+
+    clock->consumed_samples = 0;
+    clock->last_pulled = 0;
+    clock->pull_ns = 0;
+    clock->resets++;
+    const double latency_ms = LATENCY_PERIODS * clock->period_samples * 1000.0 / clock->sample_rate;
+    const double rate = clock->measured_rate;
+
+    SDL_UnlockSpinlock(&clock->lock);
+
+    SDL_Log("audio clock: device latency %.1f ms, device rate %.1f Hz\n", latency_ms, rate);
+}
+
+double audio_clock_now_ms(audio_clock *clock) {
+    const Uint64 now_ns = SDL_GetTicksNS();
+
+    SDL_LockSpinlock(&clock->lock);
+    const uint64_t consumed = clock->consumed_samples;
+    const uint32_t last_pulled = clock->last_pulled;
+    const Uint64 pull_ns = clock->pull_ns;
+    const double period = clock->period_samples;
+    const double rate = clock->measured_rate;
+    const uint32_t resets = clock->resets;
+    SDL_UnlockSpinlock(&clock->lock);
+
+    // plays forward from the latest pull at the device's measured rate, never past what it pulled
+    double position = (double)consumed - LATENCY_PERIODS * period;
+    if (pull_ns) {
+        const double played = (double)(now_ns - pull_ns) * rate / SDL_NS_PER_SECOND;
+        position += played < last_pulled ? played : last_pulled;
+    } else {
+        position += last_pulled;
+    }
+    const double raw_ms = position > 0 ? position * 1000.0 / clock->sample_rate : 0.0;
+
+    // pulls land in device buffer sized steps, eases towards them instead of following every one
+    double now_ms = raw_ms;
+    if (clock->reported_resets == resets) {
+        const double predicted_ms = clock->reported_ms + (double)(now_ns - clock->reported_ns) / SDL_NS_PER_MS;
+        if (fabs(raw_ms - predicted_ms) < SNAP_MS) {
+            now_ms = predicted_ms + (raw_ms - predicted_ms) * SMOOTHING_WEIGHT;
+        }
+        if (now_ms < clock->reported_ms) {
+            now_ms = clock->reported_ms;
+        }
+    }
+
+    clock->reported_ms = now_ms;
+    clock->reported_ns = now_ns;
+    clock->reported_resets = resets;
+    return now_ms;
+}
+
+void destroy_audio_clock(audio_clock *clock) {
+    free(clock);
+}
@@ -0,0 +1,83 @@
+/**
+ * @file audio_clock.h
+ *
+ * Master clock for playback, driven by the audio device pulling from the audio stream.
+ * Keeps a 64 bit count of the samples the device has taken, calibrates the device latency
+ * and its real sample rate from the pulls, and hands the renderer a smoothed time in ms
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#ifndef AUDIO_CLOCK_H
+#define AUDIO_CLOCK_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @struct audio_clock
+ * @brief playback position of the audio device, everything but the smoothing is guarded by the spinlock
+ */
+typedef struct audio_clock {
+    SDL_SpinLock lock;           /**< guards the device side fields, held only for a few loads and stores */
+
+    int sample_rate;             /**< sample rate of the audio stream's input */
+    int frame_size;              /**< bytes per sample frame of the audio stream's input */
+
+    uint64_t consumed_samples;   /**< samples the device has pulled from the stream since the last reset */
+    uint32_t last_pulled;        /**< samples taken by the latest pull */
+    Uint64 pull_ns;              /**< time of the latest pull, 0 if none since the last reset or it came up empty */
+    double period_samples;       /**< smoothed samples per pull, the size of the device buffer */
+    double measured_rate;        /**< smoothed rate the device really plays at, in samples per second */
+    uint32_t resets;             /**< bumped by every reset, tells the renderer to drop its smoothing */
+
+    double reported_ms;          /**< last time handed out by audio_clock_now_ms, only touched by the renderer */
+    Uint64 reported_ns;          /**< when reported_ms was handed out */
+    uint32_t reported_resets;    /**< resets as of reported_ms, nothing has been reported since a reset if it differs */
+} audio_clock;
+
+/**
+ * @brief creates a clock for an audio stream bound to a device, seeding the latency from the device's buffer size
+ *
+ * @param stream audio stream the device plays from
+ * @param spec input format of the stream
+ * @return *audio_clock - pointer to the created clock, or NULL on failure
+ */
+audio_clock *create_audio_clock(SDL_AudioStream *stream, const SDL_AudioSpec *spec);
+
+/**
+ * @brief records a pull by the audio device, call from the audio stream's get callback
+ *
+ * @param clock clock to advance
+ * @param additional_amount bytes the stream was short of, passed to the get callback
+ * @param total_amount bytes the device asked for, passed to the get callback
+ */
+void audio_clock_pulled(audio_clock *clock, int additional_amount, int total_amount);
+
+/**
+ * @brief restarts the clock at zero, call after the audio stream is cleared for a new section
+ * keeps the calibrated latency and rate, safe to call while the renderer reads the clock
+ *
+ * @param clock clock to reset
+ */
+void reset_audio_clock(audio_clock *clock);
+
+/**
+ * @brief time of the sample currently coming out of the speakers, since the last reset
+ * only ever call from one thread, it keeps the smoothing state
+ *
+ * @param clock clock to read
+ * @return time in ms, never goes backwards between resets
+ */
+double audio_clock_now_ms(audio_clock *clock);
+
+/**
+ * @brief destroys a clock, the stream's get callback must not use it anymore
+ *
+ * @param clock clock to destroy, can be NULL
+ */
+void destroy_audio_clock(audio_clock *clock);
+
+#endif //AUDIO_CLOCK_H
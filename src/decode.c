@@ -12,69 +12,161 @@
 #include <libavutil/frame.h>
 #include <libavcodec/avcodec.h>
 #include <libavcodec/packet.h>
+#include <libavutil/mem.h>
 #include <libswresample/swresample.h>
 
 #include <decode.h>
 #include <frame_queue.h>
+#include <trace.h>
 
 static const Sint32 TIMEOUT_DELAY_MS = 400;
 
-static const int SAMPLE_RATE = 48000;
+#define NUM_CHANNELS 2 // stereo
+#define BYTES_PER_SAMPLE 2 // 16 bit
+
+#define SKIP_NONREF_LAG_MS 60  // renderer lag at which b-frames stop being decoded
+#define SKIP_NONKEY_LAG_MS 250 // renderer lag at which only I-frames are decoded
+#define RESTORE_LAG_MS 20      // renderer lag at or below which every frame is decoded again, the renderer tolerates this much too
+
+bool segment_is_live(const struct segment_tag *tag) {
+    return !tag->live_epoch || SDL_GetAtomicU32(tag->live_epoch) == tag->epoch;
+}
+
+void add_audio_samples(SDL_AtomicU32 *total_audio_samples, const uint32_t samples) {
+    uint32_t prev_samples;
+    do {
+        prev_samples = SDL_GetAtomicU32(total_audio_samples);
+    } while (!SDL_CompareAndSwapAtomicU32(total_audio_samples, prev_samples, prev_samples + samples));
+}
 
 bool decode_audio(AVCodecContext *dec_ctx, const AVPacket *packet, AVFrame *frame, SwrContext *resampler,
-                  SDL_AudioStream *stream, SDL_AtomicU32 *total_audio_samples)
+                  struct pcm_scratch *scratch, SDL_AudioStream *stream, SDL_AtomicU32 *total_audio_samples,
+                  struct pcm_buffer *capture, const struct segment_tag *tag)
 {
+    // the section was abandoned, the next one flushes the decoder anyway
+    if (!segment_is_live(tag)) {
+        if (capture) {
+            pcm_buffer_abandon(capture);
+        }
+        return true;
+    }
+
     //decodes packet
     if (avcodec_send_packet(dec_ctx, packet) != 0) {
-        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't decode video packet");
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't decode audio packet");
         return false;
     }
 
     //a full frame is ready, can be more than one, doesn't ever seem to happen
     while (avcodec_receive_frame(dec_ctx, frame) == 0) {
 
-        //create resampled frame
-        AVFrame *frame_resampled = av_frame_alloc();
-        if (!frame_resampled) {
-            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't alloc resampled frame");
+        // most samples the resampler can hand back for this frame, including what it buffered from the last one
+        const int max_samples = swr_get_out_samples(resampler, frame->nb_samples);
+        if (max_samples < 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't size resampled audio frame");
+            av_frame_unref(frame);
             return false;
         }
-        //fill new frames values
-        av_channel_layout_default(&frame_resampled->ch_layout, 2);
-        frame_resampled->format = AV_SAMPLE_FMT_S16;
-        frame_resampled->sample_rate = SAMPLE_RATE;
-        frame_resampled->nb_samples = frame->nb_samples;
-        if (av_frame_get_buffer(frame_resampled, 0) < 0) {
-            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't allocate audio frame copy buffer");
-            av_frame_free(&frame_resampled);
+
+        // only grows, so it settles after the first frame
+        av_fast_malloc(&scratch->data, &scratch->size, (size_t)max_samples * NUM_CHANNELS * BYTES_PER_SAMPLE);
+        if (!scratch->data) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't grow audio scratch buffer");
+            av_frame_unref(frame);
             return false;
         }
 
-        // convert the frame
-        if (swr_convert_frame(resampler, frame_resampled, frame) < 0) {
-            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't resample audio frame %s", SDL_GetError());
-            av_frame_free(&frame_resampled);
+        // convert the frame straight into the scratch buffer
+        uint8_t *output[] = { scratch->data };
+        const int samples = swr_convert(resampler, output, max_samples,
+                                        (const uint8_t * const *)frame->extended_data, frame->nb_samples);
+        av_frame_unref(frame);
+        if (samples < 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't resample audio frame");
             return false;
         }
-        // add data to queue
-        const int data_size = av_samples_get_buffer_size(NULL, 2, frame_resampled->nb_samples, AV_SAMPLE_FMT_S16, 0);
-        if (!SDL_PutAudioStreamData(stream, frame_resampled->data[0], data_size)) {
+
+        // add data to queue, the main thread clears the stream for a new epoch under the same lock
+        const int data_size = samples * NUM_CHANNELS * BYTES_PER_SAMPLE;
+        SDL_LockAudioStream(stream);
+        if (!segment_is_live(tag)) {
+            SDL_UnlockAudioStream(stream);
+            // a capture missing this frame would cut every replay short
+            if (capture) {
+                pcm_buffer_abandon(capture);
+            }
+            return true;
+        }
+        if (!SDL_PutAudioStreamData(stream, scratch->data, data_size)) {
+            SDL_UnlockAudioStream(stream);
             SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't push frame data to audio stream %s", SDL_GetError());
             return false;
         }
 
-        // increment total samples
-        const uint32_t prev_samples = SDL_GetAtomicU32(total_audio_samples);
-        SDL_SetAtomicU32(total_audio_samples, prev_samples + frame->nb_samples);
+        // counts what was actually pushed, so queued bytes and samples always agree
+        add_audio_samples(total_audio_samples, (uint32_t)samples);
+        SDL_UnlockAudioStream(stream);
 
-        av_frame_unref(frame);
-        av_frame_free(&frame_resampled);
+        if (capture) {
+            pcm_buffer_append(capture, scratch->data, data_size, samples);
+        }
     }
     return true;
 }
 
-bool decode_video(AVCodecContext *dec_ctx, const AVPacket *packet, AVFrame *frame, frame_queue *queue)
+/**
+ * @brief raises or lowers how much of the stream the decoder skips, from the lag the renderer last reported
+ * steps up one level at a time and only restores full quality once the renderer has caught up
+ * @param dec_ctx video decodec
+ * @param lag_ms lag the renderer reported
+ */
+static void adjust_frame_skipping(AVCodecContext *dec_ctx, const int lag_ms) {
+    enum AVDiscard skip = dec_ctx->skip_frame;
+
+    if (lag_ms >= SKIP_NONKEY_LAG_MS) {
+        skip = AVDISCARD_NONKEY;
+    } else if (lag_ms >= SKIP_NONREF_LAG_MS && skip < AVDISCARD_NONREF) {
+        skip = AVDISCARD_NONREF;
+    } else if (lag_ms <= RESTORE_LAG_MS) {
+        skip = AVDISCARD_DEFAULT;
+    }
+
+    if (skip != dec_ctx->skip_frame) {
+        SDL_Log("renderer %d ms behind, video decoder now %s\n", lag_ms,
+            skip == AVDISCARD_NONKEY ? "skipping all but I-frames" :
+            skip == AVDISCARD_NONREF ? "skipping b-frames" : "decoding every frame");
+        dec_ctx->skip_frame = skip;
+    }
+}
+
+/**
+ * @brief forgets the frames the filters compare against, call when the next frame to reach them won't follow on
+ * from the last one that did
+ * @param filters filters to reset, missing ones are skipped
+ */
+static void break_filter_chain(const struct video_filters *filters) {
+    if (filters->ivtc) {
+        reset_telecine_filter(filters->ivtc);
+    }
+    if (filters->deint) {
+        reset_deinterlacer(filters->deint);
+    }
+}
+
+bool decode_video(AVCodecContext *dec_ctx, const AVPacket *packet, AVFrame *frame, frame_queue *queue, const int64_t start_pts,
+                  const struct segment_tag *tag, const struct video_filters *filters)
 {
+    // the section was abandoned, the next one flushes the decoder anyway
+    if (!segment_is_live(tag)) {
+        return true;
+    }
+
+    // feedback from the renderer, frames it would drop anyway aren't worth decoding
+    const int lag_ms = frame_queue_lag_ms(queue);
+    if (packet) {
+        adjust_frame_skipping(dec_ctx, lag_ms);
+    }
+
     //decodes packet
     if (avcodec_send_packet(dec_ctx, packet) != 0) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't decode video packet");
@@ -84,24 +176,87 @@ bool decode_video(AVCodecContext *dec_ctx, const AVPacket *packet, AVFrame *fram
     //a full frame is ready, can be more than one, doesn't ever seem to happen
     while ( avcodec_receive_frame(dec_ctx, frame) == 0) {
 
-        SDL_LockMutex(queue->mutex); //waits for mutex
+        // b-frames ahead of the first I-frame reference the previous VOBU and can't be shown
+        if (start_pts != AV_NOPTS_VALUE && frame->best_effort_timestamp != AV_NOPTS_VALUE &&
+            frame->best_effort_timestamp < start_pts)
+        {
+            av_frame_unref(frame);
+            break_filter_chain(filters);
+            continue;
+        }
 
-        //queue is at capacity
-        if (queue->size == queue->capacity) {
-            //wait for free space
-            if (!SDL_WaitConditionTimeout(queue->not_full, queue->mutex, TIMEOUT_DELAY_MS)) {
-                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "waiting for video queue to empty timed out\n");
-                return false;
-            }
+        // frames already further behind the renderer's clock than it tolerates would only be dropped after being queued
+        if (lag_ms > RESTORE_LAG_MS && frame->best_effort_timestamp != AV_NOPTS_VALUE && dec_ctx->pkt_timebase.den &&
+            (double)frame->best_effort_timestamp * av_q2d(dec_ctx->pkt_timebase) * 1000.0 + RESTORE_LAG_MS <
+            frame_queue_clock_ms(queue))
+        {
+            queue->late_frames++;
+            av_frame_unref(frame);
+            break_filter_chain(filters);
+            continue;
+        }
+
+        // the renderer would only throw it away
+        if (!segment_is_live(tag)) {
+            av_frame_unref(frame);
+            break_filter_chain(filters);
+            continue;
+        }
+
+        // while the decoder skips frames the ones it does output aren't neighbours, weaving them would tear
+        if (dec_ctx->skip_frame != AVDISCARD_DEFAULT) {
+            break_filter_chain(filters);
+        }
+
+        // filtered before waiting, so it overlaps with the renderer draining a full queue
+        if (filters->ivtc && inverse_telecine(filters->ivtc, frame) == TELECINE_DROP) {
+            av_frame_unref(frame);
+            continue;
         }
 
-        if (!enqueue_frame(queue, frame)) {
-            SDL_UnlockMutex(queue->mutex);
+        // a frame that couldn't be filtered is still queued, combed is better than missing
+        if (filters->deint) {
+            deinterlace_frame(filters->deint, frame);
+        }
+
+        //queue is at capacity, wait for free space.
+        // the renderer can hold a frame on screen for longer than the timeout, a still or a clock jump, so live
+        // output waits for as long as its segment stays live. nothing drains standby output, it doesn't wait on
+        TRACE_BEGIN(wait_span);
+        bool has_space = wait_for_space(queue, TIMEOUT_DELAY_MS);
+        while (!has_space && tag->live_epoch && segment_is_live(tag)) {
+            has_space = wait_for_space(queue, TIMEOUT_DELAY_MS);
+        }
+        TRACE_END(wait_span, "wait_for_space");
+        if (!has_space && !segment_is_live(tag)) {
+            // abandoned while it waited
+            av_frame_unref(frame);
+            break_filter_chain(filters);
+            continue;
+        }
+        if (!has_space) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "waiting for video queue to empty timed out\n");
+            av_frame_unref(frame);
             return false;
         }
 
-        av_frame_unref(frame);
-        SDL_UnlockMutex(queue->mutex);
+        // lets the renderer convert timestamps without knowing the stream
+        frame->time_base = dec_ctx->pkt_timebase;
+
+        // lets the renderer skip uploading whatever didn't change, the comparison stays off its thread
+        struct frame_damage damage;
+        if (filters->tracker) {
+            find_frame_damage(filters->tracker, frame, &damage);
+        }
+
+        // leaves frame blank for the next receive
+        TRACE_BEGIN(enqueue_span);
+        const bool enqueued = enqueue_frame(queue, frame, tag->epoch, filters->tracker ? &damage : NULL);
+        TRACE_END(enqueue_span, "enqueue_frame");
+        if (!enqueued) {
+            av_frame_unref(frame);
+            return false;
+        }
     }
     return true;
 }
\ No newline at end of file
@@ -9,12 +9,63 @@
 #ifndef DECODE_H
 #define DECODE_H
 
+#include <SDL3/SDL.h>
+#include <stdint.h>
+
 #include <libavcodec/avcodec.h>
 #include <libavcodec/packet.h>
 #include <libavutil/frame.h>
 #include <libswresample/swresample.h>
 
 #include <frame_queue.h>
+#include <frame_damage.h>
+#include <deinterlace.h>
+#include <telecine.h>
+#include <pcm_cache.h>
+
+/**
+ * @struct pcm_scratch
+ * @brief grow only buffer the resampler writes into, owned by the audio decoder thread and reused for every frame
+ */
+struct pcm_scratch {
+    uint8_t *data;      /**< resampled interleaved S16 audio, allocated with av_fast_malloc */
+    unsigned int size;  /**< allocated size of data in bytes */
+};
+
+/**
+ * @struct segment_tag
+ * @brief the segment epoch decoded output belongs to, output of any epoch but the live one is stale and thrown away
+ */
+struct segment_tag {
+    uint32_t epoch;            /**< epoch the output is tagged with */
+    SDL_AtomicU32 *live_epoch; /**< epoch being played, NULL if the output never goes stale (standby buffers) */
+};
+
+/**
+ * @struct video_filters
+ * @brief stages decoded frames go through before they are queued, in this order, owned by the video decoder thread
+ */
+struct video_filters {
+    telecine_filter *ivtc;     /**< rebuilds film from telecined frames, NULL to queue them as decoded */
+    deinterlacer *deint;       /**< deinterlaces what is still interlaced, NULL to queue it as decoded */
+    damage_tracker *tracker;   /**< compares each queued frame with the one queued before it, NULL to queue every frame as fully changed */
+};
+
+/**
+ * @brief whether output tagged with the given segment is still wanted
+ *
+ * @param tag segment to check
+ * @return true if the segment is the one being played
+ */
+bool segment_is_live(const struct segment_tag *tag);
+
+/**
+ * @brief adds to the total amount of samples pushed to the audio stream in a single atomic step
+ *
+ * @param total_audio_samples counter to add to, the decoder threads and the prefetch commit add to it at once
+ * @param samples amount of samples to add
+ */
+void add_audio_samples(SDL_AtomicU32 *total_audio_samples, uint32_t samples);
 
 /**
  * Decodes an audio packet and queues and queues the resulting frames if any.
@@ -23,22 +74,31 @@
  * @param packet Incoming packet data to be parsed
  * @param frame Reusable AVFrame, can be half filled if one packet isn't enough
  * @param resampler resampler context for changing audio to an SDL3 playable format
+ * @param scratch buffer the resampled audio is written to before being pushed, free its data with av_freep
  * @param stream audio stream to push packet data to
- * @param total_audio_samples total amount of samples pushed to the audio queue, used to sync with renderer
+ * @param total_audio_samples total amount of samples pushed to the audio queue, a statistic nothing in playback reads
+ * @param capture buffer to also append the resampled audio to for caching, NULL to skip
+ * @param tag segment the audio is decoded for, checked under the stream's lock so stale audio never gets in
  * @return true on success false on error
  */
 bool decode_audio(AVCodecContext *dec_ctx, const AVPacket *packet, AVFrame *frame, SwrContext *resampler,
-                  SDL_AudioStream *stream, SDL_AtomicU32 *total_audio_samples);
+                  struct pcm_scratch *scratch, SDL_AudioStream *stream, SDL_AtomicU32 *total_audio_samples,
+                  struct pcm_buffer *capture, const struct segment_tag *tag);
 
 /**
  * Decodes a video packet and queues and queues the resulting frames if any.
+ * Passing a NULL packet drains the frames the decoder is still holding, the decoder has to be flushed before it is used again.
  *
  * @param dec_ctx deCodec to decode packet
- * @param packet Incoming packet data to be parsed
+ * @param packet Incoming packet data to be parsed, NULL to drain
  * @param frame Reusable AVFrame, can be half filled if one packet isn't enough
  * @param queue Queue to add frames to
+ * @param start_pts frames presented before this are dropped (leading frames of an open GOP), AV_NOPTS_VALUE to keep all
+ * @param tag segment the frames are decoded for, they are queued with its epoch
+ * @param filters stages each frame goes through before it is queued
  * @return true on success false on error
  */
-bool decode_video(AVCodecContext *dec_ctx, const AVPacket *packet, AVFrame *frame, frame_queue *queue);
+bool decode_video(AVCodecContext *dec_ctx, const AVPacket *packet, AVFrame *frame, frame_queue *queue, int64_t start_pts,
+                  const struct segment_tag *tag, const struct video_filters *filters);
 
 #endif //DECODE_H
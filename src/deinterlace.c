@@ -0,0 +1,381 @@
+/**
+ * @file deinterlace.c
+ *
+ * helper functions for the deinterlacer struct and its row kernels
+ *
+ * every kernel computes the same thing with unsigned saturating byte math, per pixel of a missing line:
+ * slack = 8 * max(threshold - |current - previous|, 0), saturated at 255,
+ * output = current clamped to [min(above, below) - slack, max(above, below) + slack]
+ * still pixels keep the other field's detail, moving ones end up as the median of the line and its neighbours
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <libavutil/frame.h>
+
+#include <deinterlace.h>
+#include <frame_pool.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#define HAVE_X86_KERNELS
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(_M_ARM64)
+#define HAVE_NEON_KERNEL
+#include <arm_neon.h>
+#endif
+
+// lets the x86 kernels use instructions the rest of the build isn't compiled for, they only run once the cpu is checked
+#if defined(__GNUC__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
+
+static const char DEINTERLACE_ENV[] = "AIRBUD_DEINTERLACE";                     // off, auto, scalar, sse2, avx2 or neon
+static const char DEINTERLACE_THRESHOLD_ENV[] = "AIRBUD_DEINTERLACE_THRESHOLD"; // overrides DEFAULT_MOTION_THRESHOLD, 0 to 255
+
+static const char *const KERNEL_NAMES[] = {
+    [DEINTERLACE_OFF] = "off",
+    [DEINTERLACE_AUTO] = "auto",
+    [DEINTERLACE_SCALAR] = "scalar",
+    [DEINTERLACE_SSE2] = "sse2",
+    [DEINTERLACE_AVX2] = "avx2",
+    [DEINTERLACE_NEON] = "neon",
+};
+#define KERNEL_COUNT ((int)(sizeof(KERNEL_NAMES) / sizeof(KERNEL_NAMES[0])))
+
+static void filter_row_scalar(uint8_t *dst, const uint8_t *above, const uint8_t *current, const uint8_t *below,
+                              const uint8_t *previous, const int width, const uint8_t threshold)
+{
+    for (int x = 0; x < width; x++) {
+        const int c = current[x];
+        const int motion = c > previous[x] ? c - previous[x] : previous[x] - c;
+        const int slack = SDL_min((threshold > motion ? threshold - motion : 0) * 8, 255);
+
+        const int lo = SDL_max(SDL_min(above[x], below[x]) - slack, 0);
+        const int hi = SDL_min(SDL_max(above[x], below[x]) + slack, 255);
+        dst[x] = (uint8_t)SDL_clamp(c, lo, hi);
+    }
+}
+
+#ifdef HAVE_X86_KERNELS
+TARGET_SSE2
+static void filter_row_sse2(uint8_t *dst, const uint8_t *above, const uint8_t *current, const uint8_t *below,
+                            const uint8_t *previous, const int width, const uint8_t threshold)
+{
+    const __m128i limit = _mm_set1_epi8((char)threshold);
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const __m128i a = _mm_loadu_si128((const __m128i *)(above + x));
+        const __m128i c = _mm_loadu_si128((const __m128i *)(current + x));
+        const __m128i b = _mm_loadu_si128((const __m128i *)(below + x));
+        const __m128i p = _mm_loadu_si128((const __m128i *)(previous + x));
+
+        const __m128i motion = _mm_or_si128(_mm_subs_epu8(c, p), _mm_subs_epu8(p, c));
+        __m128i slack = _mm_subs_epu8(limit, motion);
+        slack = _mm_adds_epu8(slack, slack);
+        slack = _mm_adds_epu8(slack, slack);
+        slack = _mm_adds_epu8(slack, slack);
+
+        const __m128i lo = _mm_subs_epu8(_mm_min_epu8(a, b), slack);
+        const __m128i hi = _mm_adds_epu8(_mm_max_epu8(a, b), slack);
+        _mm_storeu_si128((__m128i *)(dst + x), _mm_min_epu8(_mm_max_epu8(c, lo), hi));
+    }
+    filter_row_scalar(dst + x, above + x, current + x, below + x, previous + x, width - x, threshold);
+}
+
+TARGET_AVX2
+static void filter_row_avx2(uint8_t *dst, const uint8_t *above, const uint8_t *current, const uint8_t *below,
+                            const uint8_t *previous, const int width, const uint8_t threshold)
+{
+    const __m256i limit = _mm256_set1_epi8((char)threshold);
+
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        const __m256i a = _mm256_loadu_si256((const __m256i *)(above + x));
+        const __m256i c = _mm256_loadu_si256((const __m256i *)(current + x));
+        const __m256i b = _mm256_loadu_si256((const __m256i *)(below + x));
+        const __m256i p = _mm256_loadu_si256((const __m256i *)(previous + x));
+
+        const __m256i motion = _mm256_or_si256(_mm256_subs_epu8(c, p), _mm256_subs_epu8(p, c));
+        __m256i slack = _mm256_subs_epu8(limit, motion);
+        slack = _mm256_adds_epu8(slack, slack);
+        slack = _mm256_adds_epu8(slack, slack);
+        slack = _mm256_adds_epu8(slack, slack);
+
+        const __m256i lo = _mm256_subs_epu8(_mm256_min_epu8(a, b), slack);
+        const __m256i hi = _mm256_adds_epu8(_mm256_max_epu8(a, b), slack);
+        _mm256_storeu_si256((__m256i *)(dst + x), _mm256_min_epu8(_mm256_max_epu8(c, lo), hi));
+    }
+    // the sse2 code after this pays for every switch while the upper halves are dirty
+    _mm256_zeroupper();
+
+    // 720 wide luma leaves 16 and 360 wide chroma leaves 8, the narrower kernel takes what it can
+    filter_row_sse2(dst + x, above + x, current + x, below + x, previous + x, width - x, threshold);
+}
+#endif
+
+#ifdef HAVE_NEON_KERNEL
+static void filter_row_neon(uint8_t *dst, const uint8_t *above, const uint8_t *current, const uint8_t *below,
+                            const uint8_t *previous, const int width, const uint8_t threshold)
+{
+    const uint8x16_t limit = vdupq_n_u8(threshold);
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const uint8x16_t a = vld1q_u8(above + x);
+        const uint8x16_t c = vld1q_u8(current + x);
+        const uint8x16_t b = vld1q_u8(below + x);
+        const uint8x16_t p = vld1q_u8(previous + x);
+
+        uint8x16_t slack = vqsubq_u8(limit, vabdq_u8(c, p));
+        slack = vqaddq_u8(slack, slack);
+        slack = vqaddq_u8(slack, slack);
+        slack = vqaddq_u8(slack, slack);
+
+        const uint8x16_t lo = vqsubq_u8(vminq_u8(a, b), slack);
+        const uint8x16_t hi = vqaddq_u8(vmaxq_u8(a, b), slack);
+        vst1q_u8(dst + x, vminq_u8(vmaxq_u8(c, lo), hi));
+    }
+    filter_row_scalar(dst + x, above + x, current + x, below + x, previous + x, width - x, threshold);
+}
+#endif
+
+bool deinterlace_kernel_supported(const enum deinterlace_kernel kernel) {
+    switch (kernel) {
+        case DEINTERLACE_OFF:
+        case DEINTERLACE_AUTO:
+        case DEINTERLACE_SCALAR:
+            return true;
+#ifdef HAVE_X86_KERNELS
+        case DEINTERLACE_SSE2:
+            return SDL_HasSSE2();
+        case DEINTERLACE_AVX2:
+            return SDL_HasAVX2();
+#endif
+#ifdef HAVE_NEON_KERNEL
+        case DEINTERLACE_NEON:
+            return SDL_HasNEON();
+#endif
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief row filter of a kernel
+ *
+ * @param kernel supported kernel other than off and auto
+ * @return the kernel's row filter
+ */
+static deinterlace_row_fn kernel_row_fn(const enum deinterlace_kernel kernel) {
+    switch (kernel) {
+#ifdef HAVE_X86_KERNELS
+        case DEINTERLACE_SSE2:
+            return filter_row_sse2;
+        case DEINTERLACE_AVX2:
+            return filter_row_avx2;
+#endif
+#ifdef HAVE_NEON_KERNEL
+        case DEINTERLACE_NEON:
+            return filter_row_neon;
+#endif
+        default:
+            return filter_row_scalar;
+    }
+}
+
+const char *deinterlace_kernel_name(const enum deinterlace_kernel kernel) {
+    return kernel >= 0 && kernel < KERNEL_COUNT ? KERNEL_NAMES[kernel] : "unknown";
+}
+
+enum deinterlace_kernel deinterlace_kernel_from_env(void) {
+    const char *env = SDL_getenv(DEINTERLACE_ENV);
+    if (!env) return DEINTERLACE_AUTO;
+
+    for (int kernel = 0; kernel < KERNEL_COUNT; kernel++) {
+        if (SDL_strcasecmp(env, KERNEL_NAMES[kernel]) == 0) {
+            return (enum deinterlace_kernel)kernel;
+        }
+    }
+    SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "unknown deinterlacer %s, picking one automatically\n", env);
+    return DEINTERLACE_AUTO;
+}
+
+enum deinterlace_kernel next_deinterlace_kernel(const enum deinterlace_kernel kernel) {
+    // auto is skipped, it always resolves to one of the others
+    enum deinterlace_kernel next = kernel;
+    do {
+        next = (enum deinterlace_kernel)((next + 1) % KERNEL_COUNT);
+    } while (next == DEINTERLACE_AUTO || !deinterlace_kernel_supported(next));
+    return next;
+}
+
+bool set_deinterlace_kernel(deinterlacer *deint, enum deinterlace_kernel kernel) {
+    if (kernel == DEINTERLACE_AUTO) {
+        kernel = deinterlace_kernel_supported(DEINTERLACE_AVX2) ? DEINTERLACE_AVX2 :
+                 deinterlace_kernel_supported(DEINTERLACE_SSE2) ? DEINTERLACE_SSE2 :
+                 deinterlace_kernel_supported(DEINTERLACE_NEON) ? DEINTERLACE_NEON : DEINTERLACE_SCALAR;
+    }
+    if (!deinterlace_kernel_supported(kernel)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "%s deinterlacer isn't supported on this cpu\n",
+            deinterlace_kernel_name(kernel));
+        return false;
+    }
+
+    deint->kernel = kernel;
+    deint->filter_row = kernel == DEINTERLACE_OFF ? NULL : kernel_row_fn(kernel);
+    return true;
+}
+
+deinterlacer *create_deinterlacer(frame_pool *pool, SDL_AtomicInt *requested) {
+    deinterlacer *deint = calloc(1, sizeof(deinterlacer));
+    if (!deint) return NULL;
+
+    deint->pool = pool;
+    deint->requested = requested;
+    deint->previous = av_frame_alloc();
+    deint->output = av_frame_alloc();
+    if (!deint->previous || !deint->output) {
+        destroy_deinterlacer(deint);
+        return NULL;
+    }
+
+    const char *threshold_env = SDL_getenv(DEINTERLACE_THRESHOLD_ENV);
+    deint->threshold = (uint8_t)(threshold_env ? SDL_clamp(SDL_atoi(threshold_env), 0, 255) : DEFAULT_MOTION_THRESHOLD);
+
+    const enum deinterlace_kernel kernel = requested ? (enum deinterlace_kernel)SDL_GetAtomicInt(requested) : DEINTERLACE_AUTO;
+    if (!set_deinterlace_kernel(deint, kernel)) {
+        set_deinterlace_kernel(deint, DEINTERLACE_AUTO);
+    }
+    // whoever cycles through the kernels starts from the one actually picked
+    if (requested) {
+        SDL_SetAtomicInt(requested, deint->kernel);
+    }
+    SDL_Log("deinterlacing with the %s kernel\n", deinterlace_kernel_name(deint->kernel));
+    return deint;
+}
+
+/**
+ * @brief copies the kept field of a plane and filters the missing one
+ *
+ * @param deint deinterlacer holding the kernel
+ * @param dst output plane
+ * @param dst_linesize output plane linesize
+ * @param src plane as decoded
+ * @param src_linesize decoded plane linesize
+ * @param previous same plane of the previous frame
+ * @param previous_linesize previous plane linesize
+ * @param width pixels per line
+ * @param height lines in the plane
+ * @param missing parity of the lines to filter, 1 for the bottom field
+ * @param threshold motion threshold
+ */
+static void filter_plane(const deinterlacer *deint, uint8_t *dst, const int dst_linesize, const uint8_t *src,
+                         const int src_linesize, const uint8_t *previous, const int previous_linesize,
+                         const int width, const int height, const int missing, const uint8_t threshold)
+{
+    for (int y = 0; y < height; y++) {
+        uint8_t *dst_row = dst + (size_t)y * dst_linesize;
+        const uint8_t *row = src + (size_t)y * src_linesize;
+
+        if ((y & 1) != missing || height < 2) {
+            memcpy(dst_row, row, width);
+            continue;
+        }
+
+        // lines at the edges only have one kept neighbour
+        const uint8_t *above = y > 0 ? row - src_linesize : row + src_linesize;
+        const uint8_t *below = y + 1 < height ? row + src_linesize : row - src_linesize;
+        deint->filter_row(dst_row, above, row, below, previous + (size_t)y * previous_linesize, width, threshold);
+    }
+}
+
+bool deinterlace_frame(deinterlacer *deint, AVFrame *frame) {
+    // picks up a kernel switched from another thread
+    if (deint->requested) {
+        const enum deinterlace_kernel requested = (enum deinterlace_kernel)SDL_GetAtomicInt(deint->requested);
+        if (requested != deint->kernel && requested != DEINTERLACE_AUTO) {
+            if (set_deinterlace_kernel(deint, requested)) {
+                SDL_Log("deinterlacing with the %s kernel\n", deinterlace_kernel_name(deint->kernel));
+            }
+            SDL_SetAtomicInt(deint->requested, deint->kernel);
+        }
+    }
+
+    if (!deint->filter_row || frame->format != AV_PIX_FMT_YUV420P || !(frame->flags & AV_FRAME_FLAG_INTERLACED)) {
+        return true;
+    }
+    const Uint64 start_ns = SDL_GetTicksNS();
+
+    AVFrame *output = deint->output;
+    output->format = frame->format;
+    output->width = frame->width;
+    output->height = frame->height;
+    if (!acquire_picture(deint->pool, output)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't allocate deinterlaced picture\n");
+        av_frame_unref(output);
+        return false;
+    }
+
+    // motion is measured against the previous frame, without one every pixel counts as moving
+    const AVFrame *previous = deint->previous;
+    const bool has_previous = previous->data[0] && previous->format == frame->format &&
+        previous->width == frame->width && previous->height == frame->height;
+    const uint8_t threshold = has_previous ? deint->threshold : 0;
+
+    // keeps the first field, the frame's timestamp is when it was shot
+    const int missing = (frame->flags & AV_FRAME_FLAG_TOP_FIELD_FIRST) ? 1 : 0;
+
+    for (int plane = 0; plane < 3; plane++) {
+        const int width = plane ? (frame->width + 1) / 2 : frame->width;
+        const int height = plane ? (frame->height + 1) / 2 : frame->height;
+        filter_plane(deint, output->data[plane], output->linesize[plane], frame->data[plane], frame->linesize[plane],
+            has_previous ? previous->data[plane] : frame->data[plane],
+            has_previous ? previous->linesize[plane] : frame->linesize[plane], width, height, missing, threshold);
+    }
+
+    // the decoded picture is what the next frame's motion is measured against, the frame carries on with the output
+    av_frame_unref(deint->previous);
+    move_picture(deint->previous, frame);
+    move_picture(frame, output);
+    av_frame_unref(output);
+    frame->flags &= ~(AV_FRAME_FLAG_INTERLACED | AV_FRAME_FLAG_TOP_FIELD_FIRST);
+
+    deint->filter_ns += SDL_GetTicksNS() - start_ns;
+    deint->filtered_frames++;
+    return true;
+}
+
+void reset_deinterlacer(deinterlacer *deint) {
+    av_frame_unref(deint->previous);
+}
+
+void log_deinterlacing(deinterlacer *deint) {
+    if (deint->filtered_frames) {
+        SDL_Log("deinterlaced %" PRIu32 " frames with the %s kernel, %.3f ms per frame\n", deint->filtered_frames,
+            deinterlace_kernel_name(deint->kernel), (double)deint->filter_ns / deint->filtered_frames / SDL_NS_PER_MS);
+    }
+    deint->filter_ns = 0;
+    deint->filtered_frames = 0;
+}
+
+void destroy_deinterlacer(deinterlacer *deint) {
+    if (!deint) return;
+
+    av_frame_free(&deint->previous);
+    av_frame_free(&deint->output);
+    free(deint);
+}
@@ -0,0 +1,155 @@
+/**
+ * @file deinterlace.h
+ *
+ * Motion adaptive deinterlacer run on the video decoder thread between decoding and queueing.
+ * One field of an interlaced frame is kept, the other field's lines are kept where they match the
+ * previous frame and pulled into the range of the lines around them where they moved, which removes
+ * combing without halving the vertical resolution of still areas. The per-row kernel has SSE2, AVX2
+ * and NEON versions and a scalar fallback, all bit exact with each other, picked at startup from the
+ * environment and switchable while playing
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#ifndef DEINTERLACE_H
+#define DEINTERLACE_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <libavutil/frame.h>
+
+#include <frame_pool.h>
+
+/** difference from the previous frame at which a pixel counts as fully moving, lower combs less and softens more */
+#define DEFAULT_MOTION_THRESHOLD 24
+
+/**
+ * @enum deinterlace_kernel
+ * @brief implementations of the per-row filter, DEINTERLACE_AUTO picks the fastest the cpu supports
+ */
+enum deinterlace_kernel {
+    DEINTERLACE_OFF,     /**< frames are queued as decoded */
+    DEINTERLACE_AUTO,    /**< the fastest kernel the cpu supports */
+    DEINTERLACE_SCALAR,  /**< plain C, runs anywhere */
+    DEINTERLACE_SSE2,    /**< 16 pixels at a time on x86 */
+    DEINTERLACE_AVX2,    /**< 32 pixels at a time on x86 */
+    DEINTERLACE_NEON,    /**< 16 pixels at a time on arm */
+};
+
+/**
+ * @brief filters one missing line of a field
+ *
+ * @param dst line to write
+ * @param above kept line above it
+ * @param current the line as decoded, from the other field
+ * @param below kept line below it
+ * @param previous the same line of the previous frame
+ * @param width pixels in the line
+ * @param threshold motion threshold, 0 treats every pixel as moving
+ */
+typedef void (*deinterlace_row_fn)(uint8_t *dst, const uint8_t *above, const uint8_t *current, const uint8_t *below,
+                                   const uint8_t *previous, int width, uint8_t threshold);
+
+/**
+ * @struct deinterlacer
+ * @brief kernel choice and the frame motion is measured against, owned by the video decoder thread
+ */
+typedef struct deinterlacer {
+    enum deinterlace_kernel kernel;  /**< kernel in use, never DEINTERLACE_AUTO */
+    deinterlace_row_fn filter_row;   /**< the kernel's row filter, NULL when off */
+    uint8_t threshold;               /**< motion threshold */
+    SDL_AtomicInt *requested;        /**< kernel other threads want used, picked up on the next frame, can be NULL */
+
+    frame_pool *pool;                /**< pool output pictures are taken from */
+    AVFrame *previous;               /**< picture of the last interlaced frame as decoded, blank after a reset */
+    AVFrame *output;                 /**< blank frame the next output is built in */
+
+    Uint64 filter_ns;                /**< time spent filtering since the stats were last logged */
+    uint32_t filtered_frames;        /**< frames the time above covers */
+} deinterlacer;
+
+/**
+ * @brief reads the kernel to start with from AIRBUD_DEINTERLACE
+ * (off, auto, scalar, sse2, avx2 or neon), auto if it is unset or unknown
+ *
+ * @return kernel asked for, may be one the cpu doesn't support
+ */
+enum deinterlace_kernel deinterlace_kernel_from_env(void);
+
+/**
+ * @brief the kernel after the given one that the cpu supports, wrapping around to off, for cycling through them
+ *
+ * @param kernel current kernel
+ * @return next supported kernel
+ */
+enum deinterlace_kernel next_deinterlace_kernel(enum deinterlace_kernel kernel);
+
+/**
+ * @brief creates a deinterlacer running the requested kernel, the threshold is read from AIRBUD_DEINTERLACE_THRESHOLD
+ *
+ * @param pool pool output pictures are taken from
+ * @param requested kernel to use, changes are picked up on the next frame, NULL for auto
+ * @return *deinterlacer - pointer to the created deinterlacer, or NULL on failure
+ */
+deinterlacer *create_deinterlacer(frame_pool *pool, SDL_AtomicInt *requested);
+
+/**
+ * @brief whether the cpu can run a kernel
+ *
+ * @param kernel kernel to check
+ * @return true if it is compiled in and the cpu supports it, always true for off, auto and scalar
+ */
+bool deinterlace_kernel_supported(enum deinterlace_kernel kernel);
+
+/**
+ * @brief name of a kernel as AIRBUD_DEINTERLACE spells it
+ *
+ * @param kernel kernel to name
+ * @return static string
+ */
+const char *deinterlace_kernel_name(enum deinterlace_kernel kernel);
+
+/**
+ * @brief switches kernel, DEINTERLACE_AUTO picks the fastest supported one
+ *
+ * @param deint deinterlacer to switch
+ * @param kernel kernel to use
+ * @return true on success, false if the cpu doesn't support it, the kernel is then left as it was
+ */
+bool set_deinterlace_kernel(deinterlacer *deint, enum deinterlace_kernel kernel);
+
+/**
+ * @brief replaces an interlaced 4:2:0 frame's picture with a deinterlaced one drawn from the pool
+ * progressive frames, other formats and everything while off are left as they are
+ *
+ * @param deint deinterlacer to filter with
+ * @param frame decoded frame, its picture is swapped for the output's
+ * @return true on success, false if no output picture could be had, the frame is then left as it was
+ */
+bool deinterlace_frame(deinterlacer *deint, AVFrame *frame);
+
+/**
+ * @brief drops the previous frame, call whenever the frames stop following on from each other, e.g. after a flush
+ *
+ * @param deint deinterlacer to reset
+ */
+void reset_deinterlacer(deinterlacer *deint);
+
+/**
+ * @brief logs the average filter time since the last call and starts over
+ *
+ * @param deint deinterlacer to log
+ */
+void log_deinterlacing(deinterlacer *deint);
+
+/**
+ * @brief destroys a deinterlacer, releasing the frames it holds
+ *
+ * @param deint deinterlacer to destroy, can be NULL
+ */
+void destroy_deinterlacer(deinterlacer *deint);
+
+#endif //DEINTERLACE_H
@@ -0,0 +1,165 @@
+/**
+ * @file frame_damage.c
+ *
+ * helper functions for the frame_damage and damage_tracker structs
+ *
+ * rows are compared whole with memcmp first, which libc vectorizes, and only rows that differ
+ * are scanned tile by tile from both ends to find the changed span
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <libavutil/frame.h>
+
+#include <frame_damage.h>
+
+damage_tracker *create_damage_tracker(void) {
+    damage_tracker *tracker = calloc(1, sizeof(damage_tracker));
+    if (!tracker) return NULL;
+
+    tracker->previous = av_frame_alloc();
+    if (!tracker->previous) {
+        free(tracker);
+        return NULL;
+    }
+    return tracker;
+}
+
+/**
+ * @brief widens a band's span to cover the tiles that differ between two rows
+ *
+ * @param current row of the new frame
+ * @param previous same row of the last frame
+ * @param width bytes in the row
+ * @param tile bytes per tile in this plane
+ * @param scale luma columns per byte in this plane
+ * @param left first changed luma column of the band so far, updated
+ * @param right one past the last changed luma column of the band so far, updated
+ */
+static void widen_span(const uint8_t *current, const uint8_t *previous, const int width, const int tile,
+                       const int scale, uint16_t *left, uint16_t *right)
+{
+    // the common case on menus, the whole row is the same
+    if (memcmp(current, previous, width) == 0) {
+        return;
+    }
+
+    const int tiles = (width + tile - 1) / tile;
+
+    // only scans the tiles outside what is already known to have changed
+    const bool known = *left != *right;
+    int first = 0;
+    while (first < tiles && !(known && first * tile * scale >= *left)) {
+        const int bytes = SDL_min(tile, width - first * tile);
+        if (memcmp(current + first * tile, previous + first * tile, bytes) != 0) break;
+        first++;
+    }
+    int last = tiles - 1;
+    while (last > first && !(known && (last + 1) * tile * scale <= *right)) {
+        const int bytes = SDL_min(tile, width - last * tile);
+        if (memcmp(current + last * tile, previous + last * tile, bytes) != 0) break;
+        last--;
+    }
+
+    const int new_left = first * tile * scale;
+    const int new_right = (last + 1) * tile * scale;
+    if (!known) {
+        *left = (uint16_t)new_left;
+        *right = (uint16_t)new_right;
+    } else {
+        *left = (uint16_t)SDL_min(*left, new_left);
+        *right = (uint16_t)SDL_max(*right, new_right);
+    }
+}
+
+void find_frame_damage(damage_tracker *tracker, const AVFrame *frame, struct frame_damage *damage) {
+    const AVFrame *previous = tracker->previous;
+    const int bands = (frame->height + DAMAGE_TILE - 1) / DAMAGE_TILE;
+
+    const bool comparable = frame->format == AV_PIX_FMT_YUV420P && previous->data[0] &&
+        previous->format == frame->format && previous->width == frame->width && previous->height == frame->height &&
+        bands <= MAX_DAMAGE_BANDS && frame->width <= DAMAGE_FULL_WIDTH;
+
+    if (!comparable) {
+        set_full_damage(damage);
+    } else {
+        clear_damage(damage);
+        const int chroma_width = (frame->width + 1) / 2;
+        const int chroma_height = (frame->height + 1) / 2;
+
+        for (int band = 0; band < bands; band++) {
+            // luma rows of the band
+            const int y_end = SDL_min((band + 1) * DAMAGE_TILE, frame->height);
+            for (int y = band * DAMAGE_TILE; y < y_end; y++) {
+                widen_span(frame->data[0] + (size_t)y * frame->linesize[0],
+                    previous->data[0] + (size_t)y * previous->linesize[0],
+                    frame->width, DAMAGE_TILE, 1, &damage->left[band], &damage->right[band]);
+            }
+
+            // chroma rows of the band, half as many and half as wide
+            const int c_end = SDL_min((band + 1) * DAMAGE_TILE / 2, chroma_height);
+            for (int plane = 1; plane <= 2; plane++) {
+                for (int y = band * DAMAGE_TILE / 2; y < c_end; y++) {
+                    widen_span(frame->data[plane] + (size_t)y * frame->linesize[plane],
+                        previous->data[plane] + (size_t)y * previous->linesize[plane],
+                        chroma_width, DAMAGE_TILE / 2, 2, &damage->left[band], &damage->right[band]);
+                }
+            }
+        }
+    }
+
+    // holds on to the pooled picture until the next frame has been compared against it
+    av_frame_unref(tracker->previous);
+    if (av_frame_ref(tracker->previous, frame) < 0) {
+        av_frame_unref(tracker->previous);
+    }
+}
+
+void reset_damage_tracker(damage_tracker *tracker) {
+    av_frame_unref(tracker->previous);
+}
+
+void set_full_damage(struct frame_damage *damage) {
+    for (int band = 0; band < MAX_DAMAGE_BANDS; band++) {
+        damage->left[band] = 0;
+        damage->right[band] = DAMAGE_FULL_WIDTH;
+    }
+}
+
+void clear_damage(struct frame_damage *damage) {
+    SDL_memset(damage, 0, sizeof(struct frame_damage));
+}
+
+void add_damage(struct frame_damage *damage, const struct frame_damage *other) {
+    for (int band = 0; band < MAX_DAMAGE_BANDS; band++) {
+        if (other->left[band] == other->right[band]) continue;
+
+        if (damage->left[band] == damage->right[band]) {
+            damage->left[band] = other->left[band];
+            damage->right[band] = other->right[band];
+        } else {
+            damage->left[band] = SDL_min(damage->left[band], other->left[band]);
+            damage->right[band] = SDL_max(damage->right[band], other->right[band]);
+        }
+    }
+}
+
+bool damage_is_empty(const struct frame_damage *damage) {
+    for (int band = 0; band < MAX_DAMAGE_BANDS; band++) {
+        if (damage->left[band] != damage->right[band]) return false;
+    }
+    return true;
+}
+
+void destroy_damage_tracker(damage_tracker *tracker) {
+    if (!tracker) return;
+
+    av_frame_free(&tracker->previous);
+    free(tracker);
+}
@@ -0,0 +1,108 @@
+/**
+ * @file frame_damage.h
+ *
+ * Finds which parts of a decoded frame changed since the one decoded before it.
+ * Frames are split into bands of tile rows, each band records the span of tile columns that changed,
+ * so the renderer can skip uploading static frames and only upload the changed part of the rest.
+ * The comparison runs on the video decoder thread, right before a frame is queued
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#ifndef FRAME_DAMAGE_H
+#define FRAME_DAMAGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <libavutil/frame.h>
+
+/** width and height of a damage tile in luma pixels, keeps chroma tiles whole for 4:2:0 */
+#define DAMAGE_TILE 16
+
+/** bands tracked, enough for 576 line frames, taller frames are always fully damaged */
+#define MAX_DAMAGE_BANDS 36
+
+/** right edge of a fully damaged band, clamped to the frame width by whoever uses it */
+#define DAMAGE_FULL_WIDTH UINT16_MAX
+
+/**
+ * @struct frame_damage
+ * @brief the changed span of every band of DAMAGE_TILE luma rows, a band with left == right is unchanged
+ */
+struct frame_damage {
+    uint16_t left[MAX_DAMAGE_BANDS];   /**< first changed luma column of each band, a multiple of DAMAGE_TILE */
+    uint16_t right[MAX_DAMAGE_BANDS];  /**< one past the last changed luma column of each band */
+};
+
+/**
+ * @struct damage_tracker
+ * @brief the frame the next one is compared against, owned by the video decoder thread
+ */
+typedef struct damage_tracker {
+    AVFrame *previous;                 /**< reference to the last frame compared, blank after a reset */
+} damage_tracker;
+
+/**
+ * @brief creates a tracker with nothing to compare against, so the first frame is fully damaged
+ *
+ * @return *damage_tracker - pointer to the created tracker, or NULL on failure
+ */
+damage_tracker *create_damage_tracker(void);
+
+/**
+ * @brief finds what changed between a frame and the last one compared, then keeps a reference to the frame
+ * anything that isn't 4:2:0 or doesn't match the last frame's size is fully damaged
+ *
+ * @param tracker tracker holding the last frame
+ * @param frame decoded frame, keeps its buffers
+ * @param damage set to what changed
+ */
+void find_frame_damage(damage_tracker *tracker, const AVFrame *frame, struct frame_damage *damage);
+
+/**
+ * @brief drops the last frame, call whenever the frames stop following on from each other, e.g. after a flush
+ *
+ * @param tracker tracker to reset
+ */
+void reset_damage_tracker(damage_tracker *tracker);
+
+/**
+ * @brief marks every band as changed
+ *
+ * @param damage damage to fill
+ */
+void set_full_damage(struct frame_damage *damage);
+
+/**
+ * @brief marks every band as unchanged
+ *
+ * @param damage damage to clear
+ */
+void clear_damage(struct frame_damage *damage);
+
+/**
+ * @brief grows one damage to also cover another
+ *
+ * @param damage damage to grow
+ * @param other damage to add
+ */
+void add_damage(struct frame_damage *damage, const struct frame_damage *other);
+
+/**
+ * @brief whether nothing changed
+ *
+ * @param damage damage to check
+ * @return true if every band is unchanged
+ */
+bool damage_is_empty(const struct frame_damage *damage);
+
+/**
+ * @brief destroys a tracker, releasing the frame it holds
+ *
+ * @param tracker tracker to destroy, can be NULL
+ */
+void destroy_damage_tracker(damage_tracker *tracker);
+
+#endif //FRAME_DAMAGE_H
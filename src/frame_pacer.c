@@ -0,0 +1,191 @@
+/**
+ * @file frame_pacer.c
+ *
+ * helper functions for the frame_pacer struct
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#include <SDL3/SDL.h>
+#include <math.h>
+#include <stdint.h>
+
+#include <frame_pacer.h>
+
+#define DEFAULT_REFRESH_HZ 60.0  // assumed if the display won't say
+#define VBLANK_WEIGHT 0.125      // how much of a present's offset from the predicted vblank is taken as drift
+#define MAX_VBLANK_ERROR 0.25    // presents further than this fraction of a period from the grid resync it
+#define SUBMIT_SLACK_MS 1        // with vsync, frames are submitted this long after the vblank before theirs
+#define LONG_WAIT_MS 100.0       // waits longer than this are logged, the decoder or clock has probably jumped
+
+static const char VSYNC_ENV[] = "AIRBUD_VSYNC"; // set to 0 to pace against a virtual vblank grid without vsync
+
+frame_pacer *create_frame_pacer(SDL_Renderer *renderer, SDL_Window *window) {
+    frame_pacer *pacer = calloc(1, sizeof(frame_pacer));
+    if (!pacer) return NULL;
+
+    const char *vsync_env = SDL_getenv(VSYNC_ENV);
+    const bool want_vsync = !vsync_env || SDL_atoi(vsync_env) != 0;
+    pacer->vsync = want_vsync && SDL_SetRenderVSync(renderer, 1);
+    if (want_vsync && !pacer->vsync) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't enable vsync %s, pacing without it\n", SDL_GetError());
+    }
+
+    // the exact rational rate when the display has one, 59.94 Hz panels are common
+    double refresh_hz = DEFAULT_REFRESH_HZ;
+    const SDL_DisplayMode *mode = SDL_GetCurrentDisplayMode(SDL_GetDisplayForWindow(window));
+    if (mode && mode->refresh_rate_numerator > 0 && mode->refresh_rate_denominator > 0) {
+        refresh_hz = (double)mode->refresh_rate_numerator / mode->refresh_rate_denominator;
+    } else if (mode && mode->refresh_rate > 0.0f) {
+        refresh_hz = mode->refresh_rate;
+    }
+    pacer->period_ns = (Uint64)(SDL_NS_PER_SECOND / refresh_hz);
+    pacer->shown_ms = -1.0;
+
+    SDL_Log("frame pacer: %.3f Hz display, vsync %s\n", refresh_hz, pacer->vsync ? "on" : "off");
+    return pacer;
+}
+
+/**
+ * @brief time of the vblank some amount of periods after the latest one
+ * @param pacer pacer holding the grid
+ * @param periods periods after the latest vblank, negative for earlier ones
+ * @return time of the vblank in ns
+ */
+static Uint64 vblank_at(const frame_pacer *pacer, const int64_t periods) {
+    return (Uint64)((int64_t)pacer->vblank_ns + periods * (int64_t)pacer->period_ns);
+}
+
+/**
+ * @brief whole periods from the latest vblank to a time, rounded down so times before it come out negative
+ * @param pacer pacer holding the grid
+ * @param time_ns time to measure to
+ * @return periods, -1 for a time less than a period before the latest vblank
+ */
+static int64_t periods_since_vblank(const frame_pacer *pacer, const Uint64 time_ns) {
+    // signed, the estimate can be ahead of a time taken before it was eased forward
+    const int64_t since_ns = (int64_t)time_ns - (int64_t)pacer->vblank_ns;
+    const int64_t period_ns = (int64_t)pacer->period_ns;
+    const int64_t periods = since_ns / period_ns;
+    return since_ns % period_ns < 0 ? periods - 1 : periods;
+}
+
+enum pace_decision schedule_frame(frame_pacer *pacer, const double delay_ms, const double frame_ms, const double tolerance_ms) {
+    const Uint64 now_ns = SDL_GetTicksNS();
+
+    // the grid starts wherever the first frame lands, vsync pulls it onto the real vblanks from there
+    if (!pacer->vblank_ns) {
+        pacer->vblank_ns = now_ns;
+    }
+
+    const double period_ns = (double)pacer->period_ns;
+    const double deadline_ns = (double)now_ns + delay_ms * SDL_NS_PER_MS;
+
+    // the vblank closest to the deadline, and the first one a present issued now can still make
+    int64_t target = llround((deadline_ns - (double)pacer->vblank_ns) / period_ns);
+    const int64_t next = periods_since_vblank(pacer, now_ns) + 1;
+
+    if (target < next) {
+        // its vblank has gone by, shows it on the next one if that is still close enough
+        const double late_ms = ((double)vblank_at(pacer, next) - deadline_ns) / SDL_NS_PER_MS;
+        if (late_ms > tolerance_ms) {
+            pacer->dropped++;
+            return PACE_DROP;
+        }
+        pacer->late++;
+        target = next;
+    }
+
+    // with vsync presenting blocks until the vblank, so the frame goes in during the refresh before its own
+    Uint64 submit_ns = vblank_at(pacer, target);
+    if (pacer->vsync) {
+        submit_ns -= pacer->period_ns - SUBMIT_SLACK_MS * SDL_NS_PER_MS;
+    }
+
+    // holds the frame on screen until then
+    if (submit_ns > now_ns) {
+        const Uint64 wait_ns = submit_ns - now_ns;
+        if ((double)wait_ns / SDL_NS_PER_MS > LONG_WAIT_MS) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "large frame delay of %.1f ms\n", (double)wait_ns / SDL_NS_PER_MS);
+        }
+        SDL_DelayPrecise(wait_ns);
+    }
+
+    pacer->target_ns = deadline_ns;
+    pacer->frame_ms = frame_ms;
+    return PACE_PRESENT;
+}
+
+void frame_presented(frame_pacer *pacer) {
+    const Uint64 now_ns = SDL_GetTicksNS();
+    const double period_ns = (double)pacer->period_ns;
+
+    // the vblank the present landed on, the virtual grid's last one without vsync
+    int64_t periods;
+    if (pacer->vsync) {
+        periods = llround((double)((int64_t)now_ns - (int64_t)pacer->vblank_ns) / period_ns);
+    } else {
+        periods = periods_since_vblank(pacer, now_ns);
+    }
+    if (periods < 0) {
+        periods = 0;
+    }
+    double vblank_ns = (double)vblank_at(pacer, periods);
+
+    // present returns just after the vblank with vsync, eases the grid towards it or resyncs if way off
+    if (pacer->vsync) {
+        const double error_ns = (double)now_ns - vblank_ns;
+        if (fabs(error_ns) < period_ns * MAX_VBLANK_ERROR) {
+            vblank_ns += error_ns * VBLANK_WEIGHT;
+        } else {
+            vblank_ns = (double)now_ns;
+        }
+    }
+    // rounding up to the next vblank and easing towards an early present both leave the estimate ahead of now,
+    // the vblank a present landed on can't be
+    pacer->vblank_ns = (Uint64)SDL_min(vblank_ns, (double)now_ns);
+    pacer->vblank_count += (uint64_t)periods;
+
+    // how far from its deadline the frame was shown, half a period is the best the display allows
+    const double jitter_ms = fabs(vblank_ns - pacer->target_ns) / SDL_NS_PER_MS;
+    int bucket = 0;
+    for (double edge_ms = 1.0; bucket < PACER_JITTER_BUCKETS - 1 && jitter_ms >= edge_ms; edge_ms *= 2.0) {
+        bucket++;
+    }
+    pacer->jitter[bucket]++;
+
+    // the previous frame stayed up until now, longer than its duration plus rounding means the display repeated it.
+    // 3:2 cadences of 24p content on 60 Hz stay within the rounding
+    if (pacer->shown_ms >= 0.0) {
+        const double shown_vblanks = (double)(pacer->vblank_count - pacer->shown_vblank);
+        const double duration_vblanks = (pacer->frame_ms - pacer->shown_ms) * SDL_NS_PER_MS / period_ns;
+        if (shown_vblanks > duration_vblanks + 0.5) {
+            pacer->repeated++;
+        }
+    }
+    pacer->shown_ms = pacer->frame_ms;
+    pacer->shown_vblank = pacer->vblank_count;
+    pacer->presented++;
+}
+
+void restart_frame_pacer(frame_pacer *pacer) {
+    pacer->shown_ms = -1.0;
+}
+
+void log_frame_pacing(frame_pacer *pacer) {
+    SDL_Log("frame pacing: %" PRIu32 " presented, %" PRIu32 " late, %" PRIu32 " repeated, %" PRIu32 " dropped, "
+        "jitter <1 ms %" PRIu32 ", <2 ms %" PRIu32 ", <4 ms %" PRIu32 ", <8 ms %" PRIu32 ", <16 ms %" PRIu32 ", more %" PRIu32 "\n",
+        pacer->presented, pacer->late, pacer->repeated, pacer->dropped,
+        pacer->jitter[0], pacer->jitter[1], pacer->jitter[2], pacer->jitter[3], pacer->jitter[4], pacer->jitter[5]);
+
+    pacer->presented = 0;
+    pacer->late = 0;
+    pacer->repeated = 0;
+    pacer->dropped = 0;
+    SDL_memset(pacer->jitter, 0, sizeof(pacer->jitter));
+}
+
+void destroy_frame_pacer(frame_pacer *pacer) {
+    free(pacer);
+}
@@ -0,0 +1,102 @@
+/**
+ * @file frame_pacer.h
+ *
+ * Schedules video frames onto the display's refresh. Each frame is aimed at the vblank closest
+ * to its audio clock deadline, held with precise waits until it is time to present it, or dropped
+ * if that vblank has already gone by. Keeps pacing statistics for the log
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/** buckets of the jitter histogram, each twice as wide as the last starting at 1 ms, the last catches everything above */
+#define PACER_JITTER_BUCKETS 6
+
+/**
+ * @enum pace_decision
+ * @brief what to do with a frame once the pacer has scheduled it
+ */
+enum pace_decision {
+    PACE_PRESENT,  /**< the frame's vblank is up next, present it now */
+    PACE_DROP,     /**< the frame's vblank has gone by, throw it away */
+};
+
+/**
+ * @struct frame_pacer
+ * @brief the display's vblank grid and the pacing statistics, only touched by the render thread
+ */
+typedef struct frame_pacer {
+    Uint64 period_ns;              /**< display refresh period */
+    bool vsync;                    /**< whether presenting blocks until the vblank */
+
+    Uint64 vblank_ns;              /**< estimated time of the latest vblank, 0 until the first present */
+    uint64_t vblank_count;         /**< vblanks since the first present, vblank_ns is the last of them */
+
+    double target_ns;              /**< audio deadline of the frame being presented, can be before the clock started */
+    double frame_ms;               /**< timestamp of the frame being presented */
+    double shown_ms;               /**< timestamp of the frame on screen, negative if none since a restart */
+    uint64_t shown_vblank;         /**< vblank the frame on screen was presented at */
+
+    uint32_t presented;            /**< frames presented since the stats were last logged */
+    uint32_t late;                 /**< frames presented a vblank or more after their deadline */
+    uint32_t repeated;             /**< frames left on screen for more vblanks than their duration called for */
+    uint32_t dropped;              /**< frames thrown away because their vblank had gone by */
+    uint32_t jitter[PACER_JITTER_BUCKETS]; /**< presents by distance between their vblank and their deadline */
+} frame_pacer;
+
+/**
+ * @brief creates a pacer for the display the window is on, turning vsync on unless disabled from the environment
+ *
+ * @param renderer renderer frames are presented with
+ * @param window window the renderer draws to
+ * @return *frame_pacer - pointer to the created pacer, or NULL on failure
+ */
+frame_pacer *create_frame_pacer(SDL_Renderer *renderer, SDL_Window *window);
+
+/**
+ * @brief picks the vblank for a frame and waits until it is time to present it
+ *
+ * @param pacer pacer to schedule with
+ * @param delay_ms how far the frame's timestamp is ahead of the audio clock, negative when behind
+ * @param frame_ms the frame's timestamp, used to tell repeated frames from the content's own cadence
+ * @param tolerance_ms how late a frame may be shown before it is dropped instead
+ * @return PACE_PRESENT once it is time to present the frame, PACE_DROP straight away if it is too late
+ */
+enum pace_decision schedule_frame(frame_pacer *pacer, double delay_ms, double frame_ms, double tolerance_ms);
+
+/**
+ * @brief records that the scheduled frame was presented, call straight after SDL_RenderPresent
+ *
+ * @param pacer pacer the frame was scheduled with
+ */
+void frame_presented(frame_pacer *pacer);
+
+/**
+ * @brief forgets the frame on screen so a new segment's first frame isn't counted as repeating it
+ *
+ * @param pacer pacer to restart
+ */
+void restart_frame_pacer(frame_pacer *pacer);
+
+/**
+ * @brief logs the pacing statistics gathered since the last call and starts over
+ *
+ * @param pacer pacer to log
+ */
+void log_frame_pacing(frame_pacer *pacer);
+
+/**
+ * @brief destroys a pacer
+ *
+ * @param pacer pacer to destroy, can be NULL
+ */
+void destroy_frame_pacer(frame_pacer *pacer);
+
+#endif //FRAME_PACER_H
@@ -0,0 +1,222 @@
+/**
+ * @file frame_pool.c
+ *
+ * helper functions for the frame_pool struct and the get_buffer2 callback that draws from it
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#include <SDL3/SDL.h>
+#include <errno.h>
+#include <stdint.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/macros.h>
+
+#include <frame_pool.h>
+#include <lock_profile.h>
+
+#define PICTURE_ALIGN 64   // alignment of each plane and linesize, covers every simd width libavcodec uses
+#define PICTURE_PADDING 16 // bytes past each plane simd code is allowed to read
+
+/**
+ * @brief AVBufferPool allocator, only called when every pooled picture is in use
+ */
+static AVBufferRef *allocate_picture(void *opaque, const size_t size) {
+    frame_pool *pool = opaque;
+
+    SDL_AddAtomicInt(&pool->picture_allocs, 1);
+    return av_buffer_alloc(size);
+}
+
+/**
+ * @brief lays a 4:2:0 picture of the given size out in a single pooled buffer
+ *
+ * @param pool pool to take the buffer from
+ * @param frame frame to attach the picture to, its format must already be AV_PIX_FMT_YUV420P
+ * @param width width the picture is laid out for, at least the frame's
+ * @param height height the picture is laid out for, at least the frame's
+ * @param reuse_larger keep the current pool if its buffers are big enough, rather than only if they're the same size
+ * @return 0 on success, AVERROR(EINVAL) if the size can't be laid out, AVERROR(ENOMEM) if no buffer could be had
+ */
+static int get_pooled_picture(frame_pool *pool, AVFrame *frame, const int width, const int height, const bool reuse_larger) {
+    int linesizes[4];
+    if (av_image_fill_linesizes(linesizes, frame->format, width) < 0) {
+        return AVERROR(EINVAL);
+    }
+    ptrdiff_t plane_linesizes[4];
+    for (int i = 0; i < 4; i++) {
+        linesizes[i] = FFALIGN(linesizes[i], PICTURE_ALIGN);
+        plane_linesizes[i] = linesizes[i];
+    }
+
+    size_t plane_sizes[4];
+    if (av_image_fill_plane_sizes(plane_sizes, frame->format, height, plane_linesizes) < 0) {
+        return AVERROR(EINVAL);
+    }
+
+    // leaves room to align the first plane, av_malloc doesn't promise PICTURE_ALIGN
+    size_t picture_size = PICTURE_ALIGN;
+    for (int i = 0; i < 4; i++) {
+        if (plane_sizes[i]) {
+            picture_size += FFALIGN(plane_sizes[i] + PICTURE_PADDING, PICTURE_ALIGN);
+        }
+    }
+
+    LOCK_MUTEX(pool->mutex, LOCK_FRAME_POOL);
+    // a new resolution retires the old pool, buffers still in use free themselves once released
+    const bool fits = pool->pictures && (reuse_larger ? pool->picture_size >= picture_size : pool->picture_size == picture_size);
+    if (!fits) {
+        av_buffer_pool_uninit(&pool->pictures);
+        pool->pictures = av_buffer_pool_init2(picture_size, pool, allocate_picture, NULL);
+        pool->picture_size = picture_size;
+    }
+    AVBufferRef *buffer = pool->pictures ? av_buffer_pool_get(pool->pictures) : NULL;
+    UNLOCK_MUTEX(pool->mutex, LOCK_FRAME_POOL);
+
+    if (!buffer) {
+        return AVERROR(ENOMEM);
+    }
+
+    uint8_t *plane = (uint8_t *)FFALIGN((uintptr_t)buffer->data, PICTURE_ALIGN);
+    for (int i = 0; i < 4 && plane_sizes[i]; i++) {
+        frame->data[i] = plane;
+        frame->linesize[i] = linesizes[i];
+        plane += FFALIGN(plane_sizes[i] + PICTURE_PADDING, PICTURE_ALIGN);
+    }
+    frame->extended_data = frame->data;
+    frame->buf[0] = buffer;
+
+    return 0;
+}
+
+/**
+ * @brief get_buffer2 callback, lays a 4:2:0 picture out in a single pooled buffer
+ * anything else goes through libavcodec's default allocator
+ */
+static int get_pooled_buffer(AVCodecContext *codec_ctx, AVFrame *frame, const int flags) {
+    frame_pool *pool = codec_ctx->opaque;
+
+    if (frame->format != AV_PIX_FMT_YUV420P) {
+        return avcodec_default_get_buffer2(codec_ctx, frame, flags);
+    }
+
+    // the decoder may write past the visible picture, up to its macroblock aligned size
+    int width = frame->width;
+    int height = frame->height;
+    int linesize_align[AV_NUM_DATA_POINTERS];
+    avcodec_align_dimensions2(codec_ctx, &width, &height, linesize_align);
+
+    const int result = get_pooled_picture(pool, frame, width, height, false);
+    if (result == AVERROR(EINVAL)) {
+        return avcodec_default_get_buffer2(codec_ctx, frame, flags);
+    }
+    return result;
+}
+
+frame_pool *create_frame_pool(const int capacity) {
+    frame_pool *pool = calloc(1, sizeof(frame_pool));
+    if (!pool) return NULL;
+
+    pool->capacity = capacity;
+    pool->frames = calloc(capacity, sizeof(AVFrame *));
+    pool->mutex = SDL_CreateMutex();
+    if (!pool->frames || !pool->mutex) {
+        destroy_frame_pool(pool);
+        return NULL;
+    }
+
+    // allocated up front so the first section doesn't count against the pool
+    for (; pool->size < capacity; pool->size++) {
+        pool->frames[pool->size] = av_frame_alloc();
+        if (!pool->frames[pool->size]) {
+            destroy_frame_pool(pool);
+            return NULL;
+        }
+    }
+
+    SDL_SetAtomicInt(&pool->frame_allocs, 0);
+    SDL_SetAtomicInt(&pool->picture_allocs, 0);
+    return pool;
+}
+
+void use_frame_pool(AVCodecContext *codec_ctx, frame_pool *pool) {
+    // decoders without direct rendering copy into their own buffers anyway
+    if (!codec_ctx->codec || !(codec_ctx->codec->capabilities & AV_CODEC_CAP_DR1)) return;
+
+    codec_ctx->opaque = pool;
+    codec_ctx->get_buffer2 = get_pooled_buffer;
+}
+
+bool acquire_picture(frame_pool *pool, AVFrame *frame) {
+    // laid out like the decoder's pictures, so they share buffers instead of retiring each other's pool
+    return get_pooled_picture(pool, frame, FFALIGN(frame->width, 16), FFALIGN(frame->height, 32), true) == 0;
+}
+
+void move_picture(AVFrame *dst, AVFrame *src) {
+    for (int i = 0; i < AV_NUM_DATA_POINTERS; i++) {
+        dst->buf[i] = src->buf[i];
+        dst->data[i] = src->data[i];
+        dst->linesize[i] = src->linesize[i];
+        src->buf[i] = NULL;
+        src->data[i] = NULL;
+        src->linesize[i] = 0;
+    }
+    dst->extended_data = dst->data;
+    src->extended_data = src->data;
+    dst->format = src->format;
+    dst->width = src->width;
+    dst->height = src->height;
+}
+
+AVFrame *acquire_frame(frame_pool *pool) {
+    LOCK_MUTEX(pool->mutex, LOCK_FRAME_POOL);
+    AVFrame *frame = pool->size > 0 ? pool->frames[--pool->size] : NULL;
+    UNLOCK_MUTEX(pool->mutex, LOCK_FRAME_POOL);
+
+    if (!frame) {
+        SDL_AddAtomicInt(&pool->frame_allocs, 1);
+        frame = av_frame_alloc();
+    }
+    return frame;
+}
+
+void release_frame(frame_pool *pool, AVFrame **frame) {
+    if (!*frame) return;
+
+    // returns the picture buffer to its pool
+    av_frame_unref(*frame);
+
+    LOCK_MUTEX(pool->mutex, LOCK_FRAME_POOL);
+    if (pool->size < pool->capacity) {
+        pool->frames[pool->size++] = *frame;
+        *frame = NULL;
+    }
+    UNLOCK_MUTEX(pool->mutex, LOCK_FRAME_POOL);
+
+    // only happens if frames were allocated past capacity
+    av_frame_free(frame);
+}
+
+int frame_pool_allocations(frame_pool *pool) {
+    return SDL_GetAtomicInt(&pool->frame_allocs) + SDL_GetAtomicInt(&pool->picture_allocs);
+}
+
+void destroy_frame_pool(frame_pool *pool) {
+    if (!pool) return;
+
+    if (pool->frames) {
+        for (int i = 0; i < pool->size; i++) {
+            av_frame_free(&pool->frames[i]);
+        }
+    }
+    av_buffer_pool_uninit(&pool->pictures);
+    SDL_DestroyMutex(pool->mutex);
+
+    free(pool->frames);
+    free(pool);
+}
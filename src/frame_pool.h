@@ -0,0 +1,107 @@
+/**
+ * @file frame_pool.h
+ *
+ * Recycles the AVFrames that travel through the frame queues and the picture
+ * buffers the video decoder decodes into, so steady playback doesn't allocate
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <libavutil/frame.h>
+#include <libavutil/buffer.h>
+#include <libavcodec/avcodec.h>
+
+/**
+ * @struct frame_pool
+ * @brief free list of blank AVFrames and a pool of picture buffers, shared by every frame queue
+ */
+typedef struct frame_pool {
+    AVFrame **frames;              /**< stack of blank frames ready to be handed out */
+    int capacity;                  /**< Max amount of blank frames kept around */
+    int size;                      /**< Current number of blank frames on the stack */
+
+    AVBufferPool *pictures;        /**< picture buffers handed to the decoder through get_buffer2 */
+    size_t picture_size;           /**< size of a single picture buffer, the pool is rebuilt if this changes */
+
+    SDL_Mutex *mutex;              /**< Guards the stack and the picture pool, the decoder and renderer use them at once */
+
+    SDL_AtomicInt frame_allocs;    /**< frames allocated because the stack was empty, stays flat once warmed up */
+    SDL_AtomicInt picture_allocs;  /**< picture buffers allocated because the pool was empty, stays flat once warmed up */
+} frame_pool;
+
+/**
+ * @brief creates a frame pool and preallocates its blank frames
+ *
+ * @param capacity amount of frames to preallocate, should cover every queue sharing the pool
+ * @return *frame_pool - pointer to the created pool, or NULL on failure
+ */
+frame_pool *create_frame_pool(int capacity);
+
+/**
+ * @brief makes a video decoder allocate its pictures out of the pool, must be called before avcodec_open2
+ *
+ * @param codec_ctx video decoder
+ * @param pool pool to allocate from, has to outlive the decoder
+ */
+void use_frame_pool(AVCodecContext *codec_ctx, frame_pool *pool);
+
+/**
+ * @brief gives a frame a pooled 4:2:0 picture, for frames made outside the decoder like filter output
+ * reuses the decoder's pictures when they're big enough
+ *
+ * @param pool pool to take the picture from
+ * @param frame blank frame with its format set to AV_PIX_FMT_YUV420P and its width and height set
+ * @return true on success, false otherwise
+ */
+bool acquire_picture(frame_pool *pool, AVFrame *frame);
+
+/**
+ * @brief moves the picture of one frame to another, leaving the rest of both frames alone
+ * lets filters swap pictures without copying timestamps, flags or side data
+ *
+ * @param dst frame without a picture to move it to
+ * @param src frame to take it from, left without one
+ */
+void move_picture(AVFrame *dst, AVFrame *src);
+
+/**
+ * @brief takes a blank frame from the pool, only allocating if every frame is in use
+ * internally handles mutex
+ *
+ * @param pool pool to take from
+ * @return blank frame, or NULL on failure
+ */
+AVFrame *acquire_frame(frame_pool *pool);
+
+/**
+ * @brief unreferences a frame and gives it back to the pool, its picture buffer goes back to the picture pool
+ * internally handles mutex
+ *
+ * @param pool pool the frame came from
+ * @param frame frame to give back, set to NULL, can be NULL
+ */
+void release_frame(frame_pool *pool, AVFrame **frame);
+
+/**
+ * @brief total allocations the pool has had to make since it was created, frames and pictures
+ *
+ * @param pool pool to read
+ * @return amount of allocations
+ */
+int frame_pool_allocations(frame_pool *pool);
+
+/**
+ * @brief destroys a frame pool, picture buffers still held by frames are freed when those frames are
+ *
+ * @param pool pool to destroy, can be NULL
+ */
+void destroy_frame_pool(frame_pool *pool);
+
+#endif //FRAME_POOL_H
@@ -3,6 +3,9 @@
      *
      * helper functions for frame and frame_queue structs
      *
+     * SDL's atomic get and set are sequentially consistent, which covers the acquire on one side
+     * and the release on the other the ring needs, and lets the sleep and wake flags work without lost wakeups
+     *
      * @author Michael Metsker
      * @version 1.0
      */
@@ -10,111 +13,340 @@
     #include <SDL3/SDL.h>
     #include <libavutil/frame.h>
 
+    #include <math.h>
     #include <stdbool.h>
+    #include <stdint.h>
 
     #include <frame_queue.h>
+    #include <lock_profile.h>
+    #include <frame_pool.h>
+
+    #define MIN_HORIZON_MS 150.0      // never buffer less than this much video, unless the byte budget says so
+    #define MAX_HORIZON_MS 1000.0     // never buffer more than this much video
+    #define STALL_MARGIN 2.0          // buffers this many times the longest recent decode stall
+    #define STALL_DECAY 0.995         // per frame decay of the remembered stall, forgets a spike after a few seconds
+    #define MIN_DEPTH 2               // the renderer always needs one frame ready behind the one it's showing
 
-    /** the max amount of frames to buffer / hold in a queue */
-    static const int VIDEO_BUFFER_CAP = 32;
+    #define INTERVAL_WEIGHT 0.05      // weight of each dequeue in the smoothed consumption interval
+    #define MAX_INTERVAL_MS 250.0     // longer gaps between dequeues are pauses, not the playback rate
+    #define DEFAULT_INTERVAL_US 33367 // ntsc frame time, used until the consumer has measured its own
 
-    frame_queue *create_frame_queue() {
-        frame_queue *queue = malloc(sizeof(frame_queue));
+    frame_queue *create_frame_queue(frame_pool *pool, const size_t budget_bytes) {
+        frame_queue *queue = calloc(1, sizeof(frame_queue));
         if (!queue) return NULL;
 
         queue->capacity = VIDEO_BUFFER_CAP;
-        queue->frames = malloc(sizeof(AVFrame*)* queue->capacity);
-        if (!queue->frames) {
+        queue->frames = calloc(queue->capacity, sizeof(AVFrame*));
+        queue->epochs = calloc(queue->capacity, sizeof(uint32_t));
+        queue->damage = calloc(queue->capacity, sizeof(struct frame_damage));
+        if (!queue->frames || !queue->epochs || !queue->damage) {
+            free(queue->frames);
+            free(queue->epochs);
+            free(queue->damage);
             free(queue);
             return NULL;
         }
 
-        queue->size = 0;
-        queue->front = 0;
-        queue->rear = 0;
+        SDL_SetAtomicU32(&queue->head, 0);
+        SDL_SetAtomicU32(&queue->tail, 0);
+        SDL_SetAtomicInt(&queue->consumer_waiting, 0);
+        SDL_SetAtomicInt(&queue->producer_waiting, 0);
+        queue->pool = pool;
+
+        queue->budget_bytes = budget_bytes;
+        SDL_SetAtomicU32(&queue->depth, queue->capacity);
+        SDL_SetAtomicU32(&queue->high_water, 0);
+        SDL_SetAtomicU32(&queue->interval_us, DEFAULT_INTERVAL_US);
+        SDL_SetAtomicInt(&queue->lag_ms, 0);
+        SDL_SetAtomicU32(&queue->clock_origin_ms, 0);
 
         queue->mutex = SDL_CreateMutex();
         queue->not_empty = SDL_CreateCondition();
         queue->not_full = SDL_CreateCondition();
-        queue->empty = SDL_CreateCondition();
 
         if (!queue->mutex || !queue->not_empty || !queue->not_full) {
             SDL_DestroyMutex(queue->mutex);
             SDL_DestroyCondition(queue->not_empty);
             SDL_DestroyCondition(queue->not_full);
             free(queue->frames);
+            free(queue->epochs);
+            free(queue->damage);
             free(queue);
             return NULL;
         }
         return queue;
     }
 
-    bool enqueue_frame(frame_queue *queue, const AVFrame *frame) {
+    int frame_queue_size(frame_queue *queue) {
+        // unsigned subtraction stays right when the counters wrap
+        return (int)(SDL_GetAtomicU32(&queue->tail) - SDL_GetAtomicU32(&queue->head));
+    }
+
+    int frame_queue_depth(frame_queue *queue) {
+        return (int)SDL_GetAtomicU32(&queue->depth);
+    }
+
+    void pin_frame_queue_depth(frame_queue *queue, const int depth) {
+        queue->depth_pinned = true;
+        SDL_SetAtomicU32(&queue->depth, SDL_clamp(depth, MIN_DEPTH, (int)queue->capacity));
+    }
+
+    int frame_queue_high_water(frame_queue *queue) {
+        return (int)SDL_GetAtomicU32(&queue->high_water);
+    }
+
+    void report_frame_lag(frame_queue *queue, const double lag_ms, const double clock_ms) {
+        // a single word, so the producer never sees half of a report
+        SDL_SetAtomicU32(&queue->clock_origin_ms, (uint32_t)(int64_t)clock_ms - (uint32_t)SDL_GetTicks());
+        SDL_SetAtomicInt(&queue->lag_ms, lag_ms > 0 ? (int)lag_ms : 0);
+    }
+
+    int frame_queue_lag_ms(frame_queue *queue) {
+        return SDL_GetAtomicInt(&queue->lag_ms);
+    }
+
+    double frame_queue_clock_ms(frame_queue *queue) {
+        // unsigned addition undoes the wrap in the origin
+        return (double)(int32_t)(SDL_GetAtomicU32(&queue->clock_origin_ms) + (uint32_t)SDL_GetTicks());
+    }
+
+    /**
+     * @brief raises the high water mark if the queue is deeper than it has ever been
+     * @param queue queue to update, only call from the side that adds frames
+     */
+    static void update_high_water(frame_queue *queue) {
+        const uint32_t size = (uint32_t)frame_queue_size(queue);
+        if (size > SDL_GetAtomicU32(&queue->high_water)) {
+            SDL_SetAtomicU32(&queue->high_water, size);
+        }
+    }
+
+    /**
+     * @brief retunes the depth after an enqueue, only call from the producer
+     * covers the longest recent stall at the consumer's rate, clamped to the time horizon and byte budget
+     * @param queue queue to tune, left alone if its depth is pinned
+     * @param now_ns time of the enqueue
+     */
+    static void tune_depth(frame_queue *queue, const Uint64 now_ns) {
+        if (queue->depth_pinned) return;
+
+        // time spent decoding since the last enqueue, sleeping on a full queue isn't a stall
+        if (queue->last_enqueue_ns) {
+            const double gap_ms = (double)(now_ns - queue->last_enqueue_ns - queue->waited_ns) / SDL_NS_PER_MS;
+            queue->stall_ms *= STALL_DECAY;
+            if (gap_ms > queue->stall_ms) {
+                queue->stall_ms = gap_ms;
+            }
+        }
+        queue->last_enqueue_ns = now_ns;
+        queue->waited_ns = 0;
+
+        double horizon_ms = queue->stall_ms * STALL_MARGIN;
+        horizon_ms = SDL_clamp(horizon_ms, MIN_HORIZON_MS, MAX_HORIZON_MS);
+
+        const double interval_ms = (double)SDL_GetAtomicU32(&queue->interval_us) / 1000.0;
+        uint32_t depth = (uint32_t)ceil(horizon_ms / interval_ms);
+
+        if (queue->frame_bytes > 0) {
+            const size_t budget_frames = queue->budget_bytes / queue->frame_bytes;
+            if (budget_frames < depth) {
+                depth = (uint32_t)budget_frames;
+            }
+        }
+        depth = SDL_clamp(depth, MIN_DEPTH, queue->capacity);
+
+        SDL_SetAtomicU32(&queue->depth, depth);
+    }
+
+    /**
+     * @brief folds the time since the last dequeue into the consumption interval, only call from the consumer
+     * @param queue queue to update
+     */
+    static void measure_interval(frame_queue *queue) {
+        const Uint64 now_ns = SDL_GetTicksNS();
+
+        if (queue->last_dequeue_ns) {
+            const double interval_us = (double)(now_ns - queue->last_dequeue_ns) / 1000.0;
+            if (interval_us < MAX_INTERVAL_MS * 1000.0) {
+                const double smoothed_us = SDL_GetAtomicU32(&queue->interval_us);
+                const double updated_us = smoothed_us + (interval_us - smoothed_us) * INTERVAL_WEIGHT;
+                SDL_SetAtomicU32(&queue->interval_us, updated_us > 1.0 ? (uint32_t)updated_us : 1);
+            }
+        }
+        queue->last_dequeue_ns = now_ns;
+    }
+
+    /**
+     * @brief wakes the other side if it's sleeping, the flag is set before it checks the queue one last time
+     * @param queue queue the other side sleeps on
+     * @param waiting the other side's waiting flag
+     * @param condition condition the other side sleeps on
+     */
+    static void wake_waiting(frame_queue *queue, SDL_AtomicInt *waiting, SDL_Condition *condition) {
+        if (SDL_GetAtomicInt(waiting)) {
+            LOCK_MUTEX(queue->mutex, LOCK_FRAME_QUEUE);
+            SIGNAL_CONDITION(condition, LOCK_FRAME_QUEUE);
+            UNLOCK_MUTEX(queue->mutex, LOCK_FRAME_QUEUE);
+        }
+    }
+
+    bool enqueue_frame(frame_queue *queue, AVFrame *frame, const uint32_t epoch, const struct frame_damage *damage) {
+        const uint32_t tail = SDL_GetAtomicU32(&queue->tail);
 
         //queue is full, should not even be called if this is the case
-        if (queue->size == queue->capacity) {
+        if (tail - SDL_GetAtomicU32(&queue->head) == queue->capacity) {
             SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "can't queue frame, queue is full\n");
             return false;
         }
 
-        //clone the frame
-        AVFrame *frame_copy = av_frame_clone(frame);
-        if (!frame_copy) {
-            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't clone frame for queueing\n");
+        //takes ownership of the frame's buffers without copying them
+        AVFrame *queued_frame = acquire_frame(queue->pool);
+        if (!queued_frame) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't get a pooled frame for queueing\n");
             return false;
         }
+        // picture memory the frame holds, what the byte budget is counted in
+        queue->frame_bytes = 0;
+        for (int i = 0; i < AV_NUM_DATA_POINTERS && frame->buf[i]; i++) {
+            queue->frame_bytes += frame->buf[i]->size;
+        }
+        av_frame_move_ref(queued_frame, frame);
 
-        queue->frames[queue->rear] = frame_copy;
-        queue->rear = (queue->rear + 1) % queue->capacity;
-        queue->size++;
+        // the slot is written before the new tail publishes it
+        queue->frames[tail & (queue->capacity - 1)] = queued_frame;
+        queue->epochs[tail & (queue->capacity - 1)] = epoch;
+        if (damage) {
+            queue->damage[tail & (queue->capacity - 1)] = *damage;
+        } else {
+            set_full_damage(&queue->damage[tail & (queue->capacity - 1)]);
+        }
+        SDL_SetAtomicU32(&queue->tail, tail + 1);
+
+        update_high_water(queue);
+        tune_depth(queue, SDL_GetTicksNS());
 
-        SDL_SignalCondition(queue->not_empty);
+        wake_waiting(queue, &queue->consumer_waiting, queue->not_empty);
         return true;
     }
 
-    AVFrame *dequeue_frame(frame_queue *queue) {
+    AVFrame *dequeue_frame(frame_queue *queue, uint32_t *epoch, struct frame_damage *damage) {
+        const uint32_t head = SDL_GetAtomicU32(&queue->head);
 
         // if queue is empty, shouldn't even be called if this is the case
-        if (queue->size == 0) {
+        if (SDL_GetAtomicU32(&queue->tail) == head) {
             SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "can't dequeue frame, queue is empty\n");
             return NULL;
         }
 
-        AVFrame *frame = queue->frames[queue->front];
-        queue->frames[queue->front] = NULL;
+        // the slot is read before the new head hands it back to the producer
+        AVFrame **slot = &queue->frames[head & (queue->capacity - 1)];
+        AVFrame *frame = *slot;
+        *slot = NULL;
+        if (epoch) {
+            *epoch = queue->epochs[head & (queue->capacity - 1)];
+        }
+        if (damage) {
+            *damage = queue->damage[head & (queue->capacity - 1)];
+        }
+        SDL_SetAtomicU32(&queue->head, head + 1);
+
+        measure_interval(queue);
+        wake_waiting(queue, &queue->producer_waiting, queue->not_full);
+        return frame;
+    }
 
-        queue->front = (queue->front + 1) % queue->capacity;
-        queue->size--;
+    bool wait_for_frame(frame_queue *queue, const Sint32 timeout_ms) {
+        if (frame_queue_size(queue) > 0) return true;
 
-        SDL_SignalCondition(queue->not_full);
+        LOCK_MUTEX(queue->mutex, LOCK_FRAME_QUEUE);
+        SDL_SetAtomicInt(&queue->consumer_waiting, 1);
 
-        if (queue->size == 0) {
-            SDL_SignalCondition(queue->empty);
+        // rechecked after the flag is set, a frame enqueued from here on signals
+        if (frame_queue_size(queue) == 0) {
+            WAIT_CONDITION(queue->not_empty, queue->mutex, timeout_ms, LOCK_FRAME_QUEUE);
         }
 
-        return frame;
+        SDL_SetAtomicInt(&queue->consumer_waiting, 0);
+        UNLOCK_MUTEX(queue->mutex, LOCK_FRAME_QUEUE);
+        return frame_queue_size(queue) > 0;
+    }
+
+    bool wait_for_space(frame_queue *queue, const Sint32 timeout_ms) {
+        if (frame_queue_size(queue) < frame_queue_depth(queue)) return true;
+
+        const Uint64 wait_start_ns = SDL_GetTicksNS();
+        LOCK_MUTEX(queue->mutex, LOCK_FRAME_QUEUE);
+        SDL_SetAtomicInt(&queue->producer_waiting, 1);
+
+        // rechecked after the flag is set, a frame dequeued from here on signals
+        if (frame_queue_size(queue) >= frame_queue_depth(queue)) {
+            WAIT_CONDITION(queue->not_full, queue->mutex, timeout_ms, LOCK_FRAME_QUEUE);
+        }
+
+        SDL_SetAtomicInt(&queue->producer_waiting, 0);
+        UNLOCK_MUTEX(queue->mutex, LOCK_FRAME_QUEUE);
+
+        queue->waited_ns += SDL_GetTicksNS() - wait_start_ns;
+        return frame_queue_size(queue) < frame_queue_depth(queue);
+    }
+
+    void restart_frame_queue(frame_queue *queue) {
+        queue->last_enqueue_ns = 0;
+        queue->waited_ns = 0;
     }
 
     void clear_frame_queue(frame_queue *queue) {
         if (!queue) return;
 
-        SDL_LockMutex(queue->mutex);
+        // gives all frames in the queue back to the pool
+        while (frame_queue_size(queue) > 0) {
+            AVFrame *frame = dequeue_frame(queue, NULL, NULL);
+            release_frame(queue->pool, &frame);
+        }
 
-        if (queue->size > 0) {
-            // free all frames in the queue
-            for (int i = 0; i < queue->capacity; i++) {
-                if (queue->frames[i]) {
+        // the time until the next section starts is neither a stall nor the playback rate
+        restart_frame_queue(queue);
+        queue->last_dequeue_ns = 0;
 
-                    av_frame_free(&queue->frames[i]);
-                }
-            }
+        // the next section starts on time
+        SDL_SetAtomicInt(&queue->lag_ms, 0);
+    }
 
-            queue->size = 0;
-            queue->front = 0;
-            queue->rear = 0;
+    void wake_frame_queue(frame_queue *queue) {
+        if (!queue) return;
+
+        LOCK_MUTEX(queue->mutex, LOCK_FRAME_QUEUE);
+        BROADCAST_CONDITION(queue->not_empty, LOCK_FRAME_QUEUE);
+        BROADCAST_CONDITION(queue->not_full, LOCK_FRAME_QUEUE);
+        UNLOCK_MUTEX(queue->mutex, LOCK_FRAME_QUEUE);
+    }
+
+    int move_frame_queue(frame_queue *dst, frame_queue *src, const uint32_t epoch) {
+        if (!dst || !src) return 0;
+
+        int moved = 0;
+        while (frame_queue_size(src) > 0 && frame_queue_size(dst) < (int)dst->capacity) {
+            const uint32_t head = SDL_GetAtomicU32(&src->head);
+            const uint32_t tail = SDL_GetAtomicU32(&dst->tail);
+
+            // frames are moved as pointers, they stay out of the pool
+            AVFrame **slot = &src->frames[head & (src->capacity - 1)];
+            dst->frames[tail & (dst->capacity - 1)] = *slot;
+            dst->epochs[tail & (dst->capacity - 1)] = epoch;
+            dst->damage[tail & (dst->capacity - 1)] = src->damage[head & (src->capacity - 1)];
+            *slot = NULL;
+
+            SDL_SetAtomicU32(&dst->tail, tail + 1);
+            SDL_SetAtomicU32(&src->head, head + 1);
+            moved++;
         }
 
-        SDL_SignalCondition(queue->empty);
-        SDL_UnlockMutex(queue->mutex);
+        if (moved > 0) {
+            update_high_water(dst);
+            wake_waiting(dst, &dst->consumer_waiting, dst->not_empty);
+            wake_waiting(src, &src->producer_waiting, src->not_full);
+        }
+        return moved;
     }
 
     void destroy_frameQueue(frame_queue *queue) {
@@ -125,8 +357,9 @@
         SDL_DestroyMutex(queue->mutex);
         SDL_DestroyCondition(queue->not_empty);
         SDL_DestroyCondition(queue->not_full);
-        SDL_DestroyCondition(queue->empty);
 
         free(queue->frames);
+        free(queue->epochs);
+        free(queue->damage);
         free(queue);
-    }
\ No newline at end of file
+    }
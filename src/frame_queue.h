@@ -1,8 +1,9 @@
 /**
  * @file frame_queue.h
  *
- * Contains a memory safe queue of av frames
- * that will be accessible to multiple threads simultaneously
+ * Contains a lock free single producer single consumer queue of av frames,
+ * the video decoder thread produces and the render thread consumes.
+ * The mutex and conditions are only touched to sleep on an empty or full queue
  *
  * @author Michael Metsker
  * @version 1.0
@@ -13,60 +14,210 @@
 
 #include <SDL3/SDL.h>
 #include <libavutil/frame.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <frame_pool.h>
+#include <frame_damage.h>
+
+/** the most frames a queue can ever hold, must be a power of two. the byte budget usually keeps it far shallower */
+#define VIDEO_BUFFER_CAP 64
+
+/** default byte budget of a queue, about half a second of 720x480 video */
+#define DEFAULT_VIDEO_QUEUE_BYTES (8 * 1024 * 1024)
 
 /**
  * @struct frame_queue
- * @brief memory safe queue of AVFrames
+ * @brief lock free single producer single consumer ring of AVFrames
+ * head and tail count every frame ever dequeued and enqueued, their difference is the size.
+ * The producer only fills the ring up to depth, which it retunes on every enqueue to cover the longest
+ * recent decode stall at the rate the consumer plays frames, within a time horizon and the byte budget,
+ * unless the depth has been pinned
  */
 typedef struct frame_queue {
-    AVFrame **frames;         /**< Dynamic circular buffer of frame pointers */
-    int capacity;             /**< Max capacity of the array */
-    int size;                 /**< Current number of frames in the queue */
-    int front;                /**< Index of first frame */
-    int rear;                 /**< Index of last frame */
-
-    SDL_Mutex *mutex;         /**< Guards access from multiple threads to prevent data corruption */
-    SDL_Condition *not_empty; /**< Signaled when frames are added */
-    SDL_Condition *not_full;  /**< Signaled when frames are removed */
-    SDL_Condition *empty;     /**< Signaled when the queue is becomes empty from dequeueing */
+    AVFrame **frames;              /**< circular buffer of frame pointers */
+    uint32_t *epochs;              /**< segment epoch each slot's frame was decoded for, written with the frame */
+    struct frame_damage *damage;   /**< what changed in each slot's frame since the one queued before it, written with the frame */
+    uint32_t capacity;             /**< Max capacity of the array, a power of two */
+
+    SDL_AtomicU32 head;            /**< frames dequeued so far, only written by the consumer */
+    SDL_AtomicU32 tail;            /**< frames enqueued so far, only written by the producer */
+
+    SDL_AtomicInt consumer_waiting; /**< set while the consumer sleeps on an empty queue */
+    SDL_AtomicInt producer_waiting; /**< set while the producer sleeps on a full queue */
+    SDL_Mutex *mutex;              /**< only taken to sleep and wake, never to access frames */
+    SDL_Condition *not_empty;      /**< Signaled when frames are added to a queue the consumer sleeps on */
+    SDL_Condition *not_full;       /**< Signaled when frames are removed from a queue the producer sleeps on */
+
+    frame_pool *pool;              /**< pool the queued frames are taken from and given back to */
+
+    size_t budget_bytes;           /**< most picture memory the queued frames may hold */
+    SDL_AtomicU32 depth;           /**< frames the producer fills the queue up to, at most capacity */
+    SDL_AtomicU32 high_water;      /**< most frames the queue has held since it was created */
+    SDL_AtomicU32 interval_us;     /**< smoothed time between dequeues, written by the consumer */
+
+    size_t frame_bytes;            /**< picture memory of the last enqueued frame, producer only */
+    Uint64 last_enqueue_ns;        /**< when the producer last enqueued, 0 after a clear, producer only */
+    Uint64 waited_ns;              /**< time the producer slept on a full queue since then, producer only */
+    double stall_ms;               /**< longest recent gap between enqueues, decaying, producer only */
+    bool depth_pinned;             /**< set by pin_frame_queue_depth, the depth is then never retuned */
+    Uint64 last_dequeue_ns;        /**< when the consumer last dequeued, 0 after a clear, consumer only */
+
+    SDL_AtomicInt lag_ms;          /**< how far behind the clock the consumer's last frame was, 0 when on time */
+    SDL_AtomicU32 clock_origin_ms; /**< the consumer's clock minus SDL_GetTicks when lag_ms was reported, wraps */
+    uint32_t late_frames;          /**< frames the producer skipped because they were already late, producer only */
 } frame_queue;
 
 /**
  * @brief creates and populates a frame queue
+ * @param pool pool frames are taken from and given back to, shared between queues that move frames between them
+ * @param budget_bytes most picture memory the queued frames may hold
  * @return *frame_queue - pointer to the created queue
  */
-frame_queue *create_frame_queue();
+frame_queue *create_frame_queue(frame_pool *pool, size_t budget_bytes);
+
+/**
+ * @brief amount of frames in the queue, exact for the producer and consumer, a snapshot for anyone else
+ *
+ * @param queue queue to read
+ * @return amount of frames queued
+ */
+int frame_queue_size(frame_queue *queue);
+
+/**
+ * @brief frames the producer currently fills the queue up to
+ *
+ * @param queue queue to read
+ * @return current depth
+ */
+int frame_queue_depth(frame_queue *queue);
+
+/**
+ * @brief fixes the depth instead of tuning it, for a queue nobody consumes from while it fills
+ * call before the first enqueue
+ *
+ * @param queue queue to pin
+ * @param depth frames the producer fills the queue up to, clamped to the capacity
+ */
+void pin_frame_queue_depth(frame_queue *queue, int depth);
 
 /**
- * @brief takes a copy of a frame and sends it to the queue
- * does not internally handle mutex
+ * @brief most frames the queue has held at once since it was created
+ *
+ * @param queue queue to read
+ * @return high water mark
+ */
+int frame_queue_high_water(frame_queue *queue);
+
+/**
+ * @brief tells the producer how late the consumer's latest frame was, only call from the consumer
+ *
+ * @param queue queue to report on
+ * @param lag_ms how far the frame's timestamp was behind the clock, 0 or less when on time
+ * @param clock_ms the clock the frame was compared against
+ */
+void report_frame_lag(frame_queue *queue, double lag_ms, double clock_ms);
+
+/**
+ * @brief how far behind the consumer was with its latest frame
+ *
+ * @param queue queue to read
+ * @return lag in ms, 0 when on time
+ */
+int frame_queue_lag_ms(frame_queue *queue);
+
+/**
+ * @brief the consumer's clock as of now, extrapolated from its latest report
+ * only meaningful while frame_queue_lag_ms is above 0
+ *
+ * @param queue queue to read
+ * @return clock in ms
+ */
+double frame_queue_clock_ms(frame_queue *queue);
+
+/**
+ * @brief moves a frame into a pooled frame and sends it to the queue, no copy is made, never blocks
+ * only call from the producer
  *
  * @param queue queue to be added to
- * @param frame AVFrame to clone and add to the queue
- * @return true on success false on failure
+ * @param frame AVFrame to move into the queue, it is left blank
+ * @param epoch segment epoch the frame was decoded for, handed to the consumer with it
+ * @param damage what changed since the frame decoded before it, NULL if it all did
+ * @return true on success false on failure or if the queue is full
  */
-bool enqueue_frame(frame_queue *queue, const AVFrame *frame);
+bool enqueue_frame(frame_queue *queue, AVFrame *frame, uint32_t epoch, const struct frame_damage *damage);
 
 /**
- * @brief pops the first frame in the given queue
- * does not internally handle mutex
+ * @brief pops the first frame in the given queue, give it back with release_frame once done with it, never blocks
+ * only call from the consumer
  *
  * @param queue queue to pop from
+ * @param epoch set to the segment epoch the frame was decoded for, can be NULL
+ * @param damage set to what changed since the frame decoded before it, can be NULL
  * @return frame* - pointer to the AVFrame that has been popped or NULL if empty
  */
-AVFrame *dequeue_frame(frame_queue *queue);
+AVFrame *dequeue_frame(frame_queue *queue, uint32_t *epoch, struct frame_damage *damage);
 
 /**
- * @brief clears the given frame_queue
- * internally handles mutex
+ * @brief sleeps until the queue has a frame, only call from the consumer
+ * can return early when woken with wake_frame_queue
+ *
+ * @param queue queue to wait on
+ * @param timeout_ms longest time to sleep
+ * @return true if there is a frame to dequeue
+ */
+bool wait_for_frame(frame_queue *queue, Sint32 timeout_ms);
+
+/**
+ * @brief sleeps until the queue is below its depth, only call from the producer
+ * can return early when woken with wake_frame_queue
+ *
+ * @param queue queue to wait on
+ * @param timeout_ms longest time to sleep
+ * @return true if there is room to enqueue
+ */
+bool wait_for_space(frame_queue *queue, Sint32 timeout_ms);
+
+/**
+ * @brief starts a new segment on the producer side without touching the queued frames
+ * the time since the last enqueue isn't counted as a stall, only call from the producer
+ *
+ * @param queue queue to restart
+ */
+void restart_frame_queue(frame_queue *queue);
+
+/**
+ * @brief clears the given frame_queue, giving every frame back to the pool
+ * the time the queue sat idle isn't counted as a stall, the tuned depth is kept, the reported lag is dropped
+ * the producer and consumer must both be idle
  *
  * @param queue pointer to queue to clear
  */
 void clear_frame_queue(frame_queue *queue);
 
+/**
+ * @brief wakes every thread waiting on the queue so it can recheck its exit flag
+ * internally handles mutex
+ *
+ * @param queue queue to wake
+ */
+void wake_frame_queue(frame_queue *queue);
+
+/**
+ * @brief moves every frame from one queue to the back of another without copying them
+ * frames that don't fit in the destination stay in the source
+ * the caller acts as the destination's producer and the source's consumer, their own must be idle
+ *
+ * @param dst queue to move frames into
+ * @param src queue to take frames from
+ * @param epoch segment epoch the moved frames are tagged with in the destination, their damage moves with them
+ * @return the amount of frames moved
+ */
+int move_frame_queue(frame_queue *dst, frame_queue *src, uint32_t epoch);
+
 /**
  * @brief destroys a frame_queue freeing all associated resources
- * internally handle mutex
+ * the producer and consumer must both be done with it
  *
  * @param queue queue to be destroyed
  */
@@ -2,7 +2,7 @@
 * @file game_states.c
  *
  * definitions of games states and what buttons they contain and a function to change between them
- * start and end byte offsets are set as the chunk value then multiplied by bytes per chunk at compile time,
+ * start and end byte offsets are set as the sector then multiplied by the vob's sector size at compile time,
  * this is to lessen confusion over a potentially mis-inputted value
  *
  * @author Michael Metsker
@@ -12,68 +12,78 @@
 #include <game_states.h>
 #include <read_file.h>
 #include <game_logic.h>
-
-
-#define BYTES_PER_CHUNK 2048
+#include <thread_gate.h>
+#include <audio_clock.h>
+#include <trace.h>
+#include <lock_profile.h>
+#include <vob_index.h>
 
 bool change_game_state(app_state *appstate, const STATE_ID destination) {
+    TRACE_BEGIN(span);
 
-    // waits for decode loop to exit cleanly
-    SDL_SetAtomicInt(&appstate->stop_decoder_thread, 1);
-    SDL_LockMutex(appstate->playback_instructions->mutex);
+    // starts a new epoch, the decoder and renderer throw away anything older on their own.
+    // done under the audio stream's lock so no decoder thread can push stale audio after the clear
+    SDL_LockAudioStream(appstate->audio_stream);
+    const uint32_t epoch = SDL_GetAtomicU32(&appstate->segment_epoch) + 1;
+    stats_state_changed(&appstate->stats, epoch, destination);
+    SDL_SetAtomicU32(&appstate->segment_epoch, epoch);
 
-    // waits for render loop to exit cleanly
-    SDL_SetAtomicInt(&appstate->stop_render_thread, 1);
-    SDL_LockMutex(appstate->renderer_mutex);
-
-    // sets audio samples to zero and clears audio stream
+    // sets audio samples to zero and clears audio stream, restarting the clock with it
     SDL_SetAtomicU32(&appstate->total_audio_samples, 0);
     SDL_ClearAudioStream(appstate->audio_stream);
-
-    // clears frame queue
-    clear_frame_queue(appstate->render_queue);
+    reset_audio_clock(appstate->audio_clock);
+    SDL_UnlockAudioStream(appstate->audio_stream);
 
     // changes main thread gamestate
     appstate->current_game_state = &GAME_STATES[destination];
 
-    // updates decoding instructions
+    // publishes the decoding instructions, the decoder commits its prefetch itself if it predicted this state
+    LOCK_MUTEX(appstate->instructions_mutex, LOCK_INSTRUCTIONS);
+    appstate->playback_instructions->state = destination;
     appstate->playback_instructions->start_offset_bytes = appstate->current_game_state->start_offset_bytes;
     appstate->playback_instructions->end_offset_bytes = appstate->current_game_state->end_offset_bytes;
     appstate->playback_instructions->audio_only = appstate->current_game_state->audio_only;
+    appstate->playback_instructions->predicted_next = appstate->current_game_state->predicted_next;
+    appstate->playback_instructions->epoch = epoch;
+    UNLOCK_MUTEX(appstate->instructions_mutex, LOCK_INSTRUCTIONS);
 
     //TODO conditionally run the pre commands
 
-    // resumes threads
-    SDL_UnlockMutex(appstate->playback_instructions->mutex);
-    SDL_UnlockMutex(appstate->renderer_mutex);
+    // wakes the decoder wherever it is waiting, never waits on it
+    publish_generation(appstate->decoder_gate);
 
+    TRACE_END(span, "change_game_state");
     return true;
 }
 
 const struct game_state GAME_STATES[STATE_COUNT] = {
     [MAIN_MENU_1] = {
-        .start_offset_bytes = 0 * BYTES_PER_CHUNK,
-        .end_offset_bytes = 6462 * BYTES_PER_CHUNK,
+        .start_offset_bytes = 0 * DVD_SECTOR_SIZE,
+        .end_offset_bytes = 6462 * DVD_SECTOR_SIZE,
         .audio_only = false,
         .pre_commands = NULL,
         .next_state = next_MAIN_MENU_1,
+        .predicted_next = MAIN_MENU_2,
         .buttons_count = 4,
     },
     [MAIN_MENU_2] = {
-        .start_offset_bytes = 6463 * BYTES_PER_CHUNK,
-        .end_offset_bytes = 6761 * BYTES_PER_CHUNK,
+        .start_offset_bytes = 6463 * DVD_SECTOR_SIZE,
+        .end_offset_bytes = 6761 * DVD_SECTOR_SIZE,
         .audio_only = true,
         .next_state = next_MAIN_MENU_2,
+        .predicted_next = MAIN_MENU_3,
     },
     [MAIN_MENU_3] = {
-        .start_offset_bytes = 6762 * BYTES_PER_CHUNK,
-        .end_offset_bytes = 7296 * BYTES_PER_CHUNK,
+        .start_offset_bytes = 6762 * DVD_SECTOR_SIZE,
+        .end_offset_bytes = 7296 * DVD_SECTOR_SIZE,
         .audio_only = true,
         .next_state = next_MAIN_MENU_3,
+        .predicted_next = MAIN_MENU_1,
     },
     [TUTORIAL] = {
-        .start_offset_bytes = 7297 * BYTES_PER_CHUNK,
-        .end_offset_bytes = 24292 * BYTES_PER_CHUNK,
+        .start_offset_bytes = 7297 * DVD_SECTOR_SIZE,
+        .end_offset_bytes = 24292 * DVD_SECTOR_SIZE,
         .audio_only = false,
+        .predicted_next = NO_STATE,
     },
 };
@@ -21,6 +21,7 @@
  * @brief names that corrospond to positions in the GAME_STATES array of game_states
  */
 typedef enum STATE_ID {
+    NO_STATE = -1,  /**< placeholder for when there is no state, not an index into GAME_STATES */
     MAIN_MENU_1,
     MAIN_MENU_2,
     MAIN_MENU_3,
@@ -38,7 +39,8 @@ typedef STATE_ID (*next_state_func)(struct game_data *data);
 
 /**
  * @brief cleanly updates the gamestate
- * makes sure all threads are aware of the change, should only be called from main thread
+ * publishes a new segment epoch and instructions without waiting on the other threads, they drop stale data lazily.
+ * should only be called from main thread
  *
  * @param appstate basic information struct from main thread
  * @param destination gamestate to change to
@@ -72,6 +74,7 @@ struct game_state {
 
     void (* const pre_commands)(struct game_data *data);  /** pointer to a void function that runs when the state is reached initially, can be null */
     const next_state_func next_state;                     /** a function that returns the id of the next gamestate and updates the passed gamedata accordingly */
+    const STATE_ID predicted_next;                        /** the state that most likely follows, pre-decoded while this one plays, NO_STATE if unknown */
 
     const button *buttons;                                /** array of buttons that corrospond to the section being decoded*/
     const uint8_t buttons_count;                          /** the size of the buttons array */
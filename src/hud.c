@@ -0,0 +1,209 @@
+/**
+ * @file hud.c
+ *
+ * sampling and drawing of the performance hud
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <hud.h>
+
+#define HUD_INTERVAL_MS 250   // how often the numbers are sampled, so they can be read and the text is rarely redrawn
+#define HUD_LINES 7
+#define HUD_COLUMNS 40        // characters per line there is room for
+#define HUD_PADDING 4         // pixels between the text and the edge of its background
+#define HUD_MARGIN 8          // pixels between the hud and the edge of the screen
+#define HUD_LINE_HEIGHT (SDL_DEBUG_TEXT_FONT_CHARACTER_SIZE + 2)
+#define HUD_WIDTH (HUD_COLUMNS * SDL_DEBUG_TEXT_FONT_CHARACTER_SIZE + 2 * HUD_PADDING)
+#define HUD_HEIGHT (HUD_LINES * HUD_LINE_HEIGHT + 2 * HUD_PADDING)
+
+/**
+ * @struct hud
+ * @brief the hud's texture and what it needs to work out the numbers, only touched by the render thread
+ */
+struct hud {
+    SDL_Renderer *renderer;                       /**< renderer the hud is drawn with */
+    SDL_Texture *texture;                         /**< rasterized text on a translucent background */
+    pipeline_stats *stats;                        /**< stats the numbers are read from */
+    frame_queue *queue;                           /**< queue the depth is read from */
+
+    char lines[HUD_LINES][HUD_COLUMNS + 1];       /**< text in the texture */
+    bool rasterized;                              /**< false until the texture holds the current lines */
+
+    Uint64 sample_ns;                             /**< when the counters below were read */
+    int decoded_frames;                           /**< pipeline_stats counters at that time */
+    int decode_us;
+    int presented_frames;
+    int upload_us;
+    int dropped_frames;
+
+    double drift_sum_ms;                          /**< drift of the frames shown since then */
+    int drift_frames;                             /**< amount of them */
+};
+
+/**
+ * @brief reads the counters the next sample is measured from
+ *
+ * @param hud hud to store them in
+ * @param now_ns time they were read
+ */
+static void read_counters(hud *hud, const Uint64 now_ns) {
+    hud->sample_ns = now_ns;
+    hud->decoded_frames = SDL_GetAtomicInt(&hud->stats->decoded_frames);
+    hud->decode_us = SDL_GetAtomicInt(&hud->stats->decode_us);
+    hud->presented_frames = SDL_GetAtomicInt(&hud->stats->presented_frames);
+    hud->upload_us = SDL_GetAtomicInt(&hud->stats->upload_us);
+    hud->dropped_frames = SDL_GetAtomicInt(&hud->stats->dropped_frames);
+    hud->drift_sum_ms = 0.0;
+    hud->drift_frames = 0;
+}
+
+hud *create_hud(SDL_Renderer *renderer, pipeline_stats *stats, frame_queue *queue) {
+    hud *hud = calloc(1, sizeof(struct hud));
+    if (!hud) return NULL;
+
+    hud->renderer = renderer;
+    hud->stats = stats;
+    hud->queue = queue;
+
+    // rendered into once per change, drawn over the video with its background see through
+    hud->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_TARGET, HUD_WIDTH, HUD_HEIGHT);
+    if (!hud->texture ||
+        !SDL_SetTextureBlendMode(hud->texture, SDL_BLENDMODE_BLEND) ||
+        !SDL_SetTextureScaleMode(hud->texture, SDL_SCALEMODE_NEAREST))
+    {
+        destroy_hud(hud);
+        return NULL;
+    }
+
+    read_counters(hud, SDL_GetTicksNS());
+    return hud;
+}
+
+void record_hud_drift(hud *hud, const double drift_ms) {
+    hud->drift_sum_ms += drift_ms;
+    hud->drift_frames++;
+}
+
+/**
+ * @brief formats a latency since the last state change, or a dash if that stage hasn't been reached yet
+ *
+ * @param text buffer to write to
+ * @param size size of it
+ * @param stage_epoch epoch the latency was measured for
+ * @param change_epoch epoch of the last state change
+ * @param latency_us the latency
+ */
+static void format_latency(char *text, const size_t size, const uint32_t stage_epoch, const uint32_t change_epoch,
+                           const uint32_t latency_us)
+{
+    if (stage_epoch == change_epoch) {
+        SDL_snprintf(text, size, "%.1f", (double)latency_us / 1000.0);
+    } else {
+        SDL_snprintf(text, size, "-");
+    }
+}
+
+/**
+ * @brief works out the numbers over the interval since the last sample and formats them
+ *
+ * @param hud hud to sample for, its counters move on to now
+ * @param now_ns current time
+ * @param lines zeroed lines to write to
+ */
+static void sample_lines(hud *hud, const Uint64 now_ns, char lines[HUD_LINES][HUD_COLUMNS + 1]) {
+    pipeline_stats *stats = hud->stats;
+    const double elapsed_s = (double)(now_ns - hud->sample_ns) / SDL_NS_PER_SECOND;
+
+    // counters wrap, differences of them don't
+    const int decoded = (int)((uint32_t)SDL_GetAtomicInt(&stats->decoded_frames) - (uint32_t)hud->decoded_frames);
+    const int decode_us = (int)((uint32_t)SDL_GetAtomicInt(&stats->decode_us) - (uint32_t)hud->decode_us);
+    const int presented = (int)((uint32_t)SDL_GetAtomicInt(&stats->presented_frames) - (uint32_t)hud->presented_frames);
+    const int upload_us = (int)((uint32_t)SDL_GetAtomicInt(&stats->upload_us) - (uint32_t)hud->upload_us);
+    const int dropped = (int)((uint32_t)SDL_GetAtomicInt(&stats->dropped_frames) - (uint32_t)hud->dropped_frames);
+
+    // a latency only counts for the state change it was measured from
+    const uint32_t change_epoch = SDL_GetAtomicU32(&stats->change_epoch);
+    char section_ms[16];
+    char present_ms[16];
+    format_latency(section_ms, sizeof(section_ms), SDL_GetAtomicU32(&stats->section_epoch), change_epoch,
+        SDL_GetAtomicU32(&stats->section_latency_us));
+    format_latency(present_ms, sizeof(present_ms), SDL_GetAtomicU32(&stats->present_epoch), change_epoch,
+        SDL_GetAtomicU32(&stats->present_latency_us));
+
+    int line = 0;
+    SDL_snprintf(lines[line++], HUD_COLUMNS + 1, "state %d  epoch %" PRIu32, SDL_GetAtomicInt(&stats->state), change_epoch);
+    SDL_snprintf(lines[line++], HUD_COLUMNS + 1, "queue %d/%d frames", frame_queue_size(hud->queue),
+        frame_queue_depth(hud->queue));
+    if (hud->drift_frames > 0) {
+        SDL_snprintf(lines[line++], HUD_COLUMNS + 1, "a/v drift %+.1f ms", hud->drift_sum_ms / hud->drift_frames);
+    } else {
+        SDL_snprintf(lines[line++], HUD_COLUMNS + 1, "a/v drift -");
+    }
+    SDL_snprintf(lines[line++], HUD_COLUMNS + 1, "decode %.2f ms/frame", decoded > 0 ? decode_us / 1000.0 / decoded : 0.0);
+    SDL_snprintf(lines[line++], HUD_COLUMNS + 1, "upload %.2f ms", presented > 0 ? upload_us / 1000.0 / presented : 0.0);
+    SDL_snprintf(lines[line++], HUD_COLUMNS + 1, "drops %.1f/s", elapsed_s > 0.0 ? dropped / elapsed_s : 0.0);
+    SDL_snprintf(lines[line++], HUD_COLUMNS + 1, "switch %s ms, first frame %s ms", section_ms, present_ms);
+
+    read_counters(hud, now_ns);
+}
+
+/**
+ * @brief rasterizes the hud's lines into its texture, leaving the renderer as it found it
+ *
+ * @param hud hud to rasterize
+ * @return true on success, false otherwise
+ */
+static bool rasterize_lines(hud *hud) {
+    SDL_Renderer *renderer = hud->renderer;
+
+    // the base layer clears with the draw color
+    Uint8 r, g, b, a;
+    if (!SDL_GetRenderDrawColor(renderer, &r, &g, &b, &a) || !SDL_SetRenderTarget(renderer, hud->texture)) {
+        return false;
+    }
+
+    bool ok = SDL_SetRenderDrawColor(renderer, 0, 0, 0, 160) && SDL_RenderClear(renderer) &&
+              SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+    for (int i = 0; i < HUD_LINES && ok; i++) {
+        ok = SDL_RenderDebugText(renderer, HUD_PADDING, (float)(HUD_PADDING + i * HUD_LINE_HEIGHT), hud->lines[i]);
+    }
+
+    ok = SDL_SetRenderTarget(renderer, NULL) && ok;
+    return SDL_SetRenderDrawColor(renderer, r, g, b, a) && ok;
+}
+
+bool draw_hud(hud *hud) {
+    const Uint64 now_ns = SDL_GetTicksNS();
+
+    // most frames only draw the texture, the text is redrawn when a sample comes out different
+    if (!hud->rasterized || now_ns - hud->sample_ns >= HUD_INTERVAL_MS * SDL_NS_PER_MS) {
+        char lines[HUD_LINES][HUD_COLUMNS + 1] = {{0}};
+        sample_lines(hud, now_ns, lines);
+
+        if (!hud->rasterized || SDL_memcmp(lines, hud->lines, sizeof(lines)) != 0) {
+            SDL_memcpy(hud->lines, lines, sizeof(lines));
+            hud->rasterized = rasterize_lines(hud);
+            if (!hud->rasterized) {
+                return false;
+            }
+        }
+    }
+
+    const SDL_FRect dst = { HUD_MARGIN, HUD_MARGIN, HUD_WIDTH, HUD_HEIGHT };
+    return SDL_RenderTexture(hud->renderer, hud->texture, NULL, &dst);
+}
+
+void destroy_hud(hud *hud) {
+    if (!hud) return;
+
+    if (hud->texture) {
+        SDL_DestroyTexture(hud->texture);
+    }
+    free(hud);
+}
@@ -0,0 +1,57 @@
+/**
+ * @file hud.h
+ *
+ * On screen overlay of the playback pipeline's numbers, drawn by the render thread on top of every frame.
+ * The numbers are sampled every HUD_INTERVAL_MS and the text is only rasterized into its texture when
+ * they change, every other frame just draws the texture
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#ifndef HUD_H
+#define HUD_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+
+#include <frame_queue.h>
+#include <pipeline_stats.h>
+
+typedef struct hud hud;
+
+/**
+ * @brief creates the hud and its texture, only use it from the thread rendering with the renderer
+ *
+ * @param renderer renderer the hud is drawn with
+ * @param stats stats the numbers are read from
+ * @param queue queue the depth is read from
+ * @return the hud, or NULL on failure
+ */
+hud *create_hud(SDL_Renderer *renderer, pipeline_stats *stats, frame_queue *queue);
+
+/**
+ * @brief adds the A/V drift of a frame about to be shown, the hud shows the average over each interval
+ *
+ * @param hud hud to add to
+ * @param drift_ms audio clock minus the frame's timestamp
+ */
+void record_hud_drift(hud *hud, double drift_ms);
+
+/**
+ * @brief draws the hud in the top left corner, rasterizing its text again first if the numbers changed
+ * call between drawing the frame and presenting it
+ *
+ * @param hud hud to draw
+ * @return true on success, false otherwise
+ */
+bool draw_hud(hud *hud);
+
+/**
+ * @brief frees the hud and its texture
+ *
+ * @param hud hud to free, can be NULL
+ */
+void destroy_hud(hud *hud);
+
+#endif //HUD_H
@@ -13,10 +13,18 @@
 #include <render.h>
 #include <game_states.h>
 #include <game_logic.h>
+#include <thread_gate.h>
+#include <audio_clock.h>
+#include <deinterlace.h>
+#include <trace.h>
+#include <lock_profile.h>
 
 #define SCREEN_WIDTH 720
 #define SCREEN_HEIGHT 480
 
+static const char VIDEO_QUEUE_BYTES_ENV[] = "AIRBUD_VIDEO_QUEUE_BYTES"; // overrides the byte budget of the video frame queues
+static const char HUD_ENV[] = "AIRBUD_HUD"; // set to 1 to start with the performance hud shown
+
 //audio packet format stream
 static const SDL_AudioSpec format = {
     .freq = 48000,
@@ -25,6 +33,8 @@ static const SDL_AudioSpec format = {
 };
 
 app_state *initialize() {
+    TRACE_THREAD("main");
+    LOCK_PROFILE_THREAD("main");
     SDL_SetAppMetadata("airbud", "1.0", "com.airbud.renderer");
 
     if (!SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO)) {
@@ -46,28 +56,57 @@ app_state *initialize() {
         return NULL;
     }
 
-    // frame_queue for the app
-    appstate->render_queue = create_frame_queue();
+    // frames for the render queue and the prefetch queue, frames move between the two without copying
+    appstate->frame_pool = create_frame_pool(2 * VIDEO_BUFFER_CAP);
+    if (!appstate->frame_pool) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't allocate video frame pool\n");
+        return NULL;
+    }
+
+    // frame_queue for the app, the budget can be overridden from the environment
+    size_t video_queue_bytes = DEFAULT_VIDEO_QUEUE_BYTES;
+    const char *video_queue_env = SDL_getenv(VIDEO_QUEUE_BYTES_ENV);
+    if (video_queue_env) {
+        video_queue_bytes = (size_t)SDL_strtoull(video_queue_env, NULL, 10);
+    }
+    appstate->render_queue = create_frame_queue(appstate->frame_pool, video_queue_bytes);
     if (!appstate->render_queue) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't allocate video frame_queue\n");
         return NULL;
     }
 
-    //creates reused texture for rendering
-    appstate->base_texture = SDL_CreateTexture(appstate->renderer,
-        SDL_PIXELFORMAT_IYUV,   // Equivalent to YUV420 planar
-        SDL_TEXTUREACCESS_STREAMING,
-        SCREEN_WIDTH,
-        SCREEN_HEIGHT);
+    //creates the ring of reused textures for rendering
+    for (int i = 0; i < BASE_TEXTURE_COUNT; i++) {
+        appstate->base_textures[i] = SDL_CreateTexture(appstate->renderer,
+            SDL_PIXELFORMAT_IYUV,   // Equivalent to YUV420 planar
+            SDL_TEXTUREACCESS_STREAMING,
+            SCREEN_WIDTH,
+            SCREEN_HEIGHT);
+        if (!appstate->base_textures[i]) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't create video texture %s\n", SDL_GetError());
+            return NULL;
+        }
+    }
 
     // sets total_audio_samples to 0
     SDL_SetAtomicU32(&appstate->total_audio_samples, 0);
     // set initial gamestate to the main menu
 
     appstate->current_game_state = &GAME_STATES[MAIN_MENU_1];
-    appstate->renderer_mutex = SDL_CreateMutex();
-    if (!appstate->renderer_mutex) {
-        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't create mutex\n");
+    SDL_SetAtomicU32(&appstate->segment_epoch, 0);
+    reset_pipeline_stats(&appstate->stats, MAIN_MENU_1);
+
+    // hidden unless asked for, the H key toggles it either way
+    const char *hud_env = SDL_getenv(HUD_ENV);
+    SDL_SetAtomicInt(&appstate->show_hud, hud_env && SDL_atoi(hud_env) != 0);
+
+    // the video decoder resolves auto to the fastest kernel once it starts
+    SDL_SetAtomicInt(&appstate->deinterlace_kernel, deinterlace_kernel_from_env());
+
+    // creates the handoff the decoder thread picks up new instructions through
+    appstate->decoder_gate = create_thread_gate(&appstate->stop_decoder_thread);
+    if (!appstate->decoder_gate) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't create decoder gate\n");
         return NULL;
     }
 
@@ -89,6 +128,13 @@ bool  start_threads(app_state *appstate) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't create audio stream\n");
         return false;
     }
+
+    // clock the renderer syncs to, advanced by the decoder thread's audio stream callback
+    appstate->audio_clock = create_audio_clock(appstate->audio_stream, &format);
+    if (!appstate->audio_clock) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't create audio clock\n");
+        return false;
+    }
     SDL_ResumeAudioStreamDevice(appstate->audio_stream);
 
     //starts both threads
@@ -103,4 +149,24 @@ bool  start_threads(app_state *appstate) {
     }
 
     return true;
-}
\ No newline at end of file
+}
+
+void stop_threads(app_state *appstate) {
+    SDL_SetAtomicInt(&appstate->stop_decoder_thread, -1);
+    SDL_SetAtomicInt(&appstate->stop_render_thread, -1);
+
+    // live output goes stale, a video decoder waiting on the renderer for room stops waiting once woken
+    SDL_SetAtomicU32(&appstate->segment_epoch, SDL_GetAtomicU32(&appstate->segment_epoch) + 1);
+
+    // wakes the demuxer if it's parked and the renderer and video decoder if they're waiting on the queue
+    if (appstate->decoder_gate) {
+        publish_generation(appstate->decoder_gate);
+    }
+    wake_frame_queue(appstate->render_queue);
+
+    // the demuxer joins its decoder workers before it returns
+    SDL_WaitThread(appstate->decoder_thread, NULL);
+    SDL_WaitThread(appstate->render_thread, NULL);
+    appstate->decoder_thread = NULL;
+    appstate->render_thread = NULL;
+}
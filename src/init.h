@@ -16,6 +16,10 @@
 #include <stdbool.h>
 
 #include <frame_queue.h>
+#include <pipeline_stats.h>
+
+/** streaming textures the renderer cycles through, uploading one frame while the last is still being drawn */
+#define BASE_TEXTURE_COUNT 3
 
 /**
  * @struct app_state
@@ -25,24 +29,32 @@ typedef struct app_state { //TODO see what of these pointers can be made const
 
     SDL_Window                  *window;                /**< main Window for the program */
     SDL_Renderer                *renderer;              /**< main Renderer for the program */
-    SDL_Texture                 *base_texture;          /**< Reused texture for main video playback */
+    SDL_Texture                 *base_textures[BASE_TEXTURE_COUNT]; /**< ring of reused textures for main video playback */
 
     SDL_AudioStream             *audio_stream;          /**< audio stream for sound playback */
-    SDL_AtomicU32                total_audio_samples;   /**< total amount of packets of audio enqueued, used for syncing renderer */
+    SDL_AtomicU32                total_audio_samples;   /**< samples of audio enqueued for the current section, only counted, the renderer syncs to audio_clock */
+    struct audio_clock          *audio_clock;           /**< playback position of the audio device, the renderer syncs to it */
 
+    frame_pool                  *frame_pool;            /**< recycles video frames and pictures shared by every frame queue */
     frame_queue                 *render_queue;          /**< render queue of buffered video frames */
+    SDL_AtomicInt                deinterlace_kernel;    /**< enum deinterlace_kernel the video decoder filters with, cycled with the D key */
 
     SDL_Thread                  *render_thread;         /**< thread that handles rendering */
-    SDL_AtomicInt                stop_render_thread;    /**< the exit flag for the render thread, 1 to break main loop, -1 for hard exit */
+    SDL_AtomicInt                stop_render_thread;    /**< the exit flag for the render thread, -1 for hard exit */
 
     SDL_Thread                  *decoder_thread;        /**< pointer to the thread that handles decoding */
-    SDL_AtomicInt                stop_decoder_thread;   /**< the exit flag for the decoder thread, 1 to break main loop, -1 for hard exit */
+    SDL_AtomicInt                stop_decoder_thread;   /**< the exit flag for the decoder thread, -1 for hard exit */
 
     const struct game_state     *current_game_state;    /**< current state of the game, containing playback isntructions and buttons */
-    SDL_Mutex                   *renderer_mutex;        /**< mutex normally held by the render thread, blocks changing the gamestate during rendering */
+    SDL_AtomicU32                segment_epoch;         /**< bumped by every gamestate change, decoded frames and audio of older epochs are stale */
+    struct thread_gate          *decoder_gate;          /**< wakes the decoder thread when new playback instructions are published */
 
     uint32_t                     decoding_ended_event;  /** id of the SDL event that triggers when the decoder thread needs new instructions */
-    struct decoder_instructions *playback_instructions; /**< Instructions to tell what part of the file to decode and mutex signals */
+    struct decoder_instructions *playback_instructions; /**< Instructions to tell what part of the file to decode */
+    SDL_Mutex                   *instructions_mutex;    /**< held while the playback instructions are published or copied */
+
+    pipeline_stats               stats;                 /**< decode, present and state change counters published by every thread */
+    SDL_AtomicInt                show_hud;              /**< nonzero while the renderer draws the performance hud, toggled with the H key */
 
     struct game_data            *game_data;              /**< collection of variables related to the actual gameplay, edited from main thread */
 
@@ -63,4 +75,11 @@ app_state *initialize();
  */
 bool start_threads(app_state *appstate);
 
+/**
+ * @brief hard exits the decoder and render threads and waits for them, call before freeing anything they use
+ *
+ * @param appstate app state the threads were started with, threads that never started are skipped
+ */
+void stop_threads(app_state *appstate);
+
 #endif //INIT_H
@@ -0,0 +1,309 @@
+/**
+ * @file lock_profile.c
+ *
+ * per lock histograms and per thread blocked times, see lock_profile.h
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#ifdef AIRBUD_LOCK_PROFILE
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <lock_profile.h>
+
+#define PROFILE_THREADS 16       // threads that can be profiled, locks taken by any past that aren't timed
+#define PROFILE_NAME_BYTES 32
+#define HISTOGRAM_BUCKETS 24     // bucket 0 is under 1us, bucket i up to 2^i us, the last one everything past ~4s
+#define HISTOGRAM_LINE_BYTES 512
+
+static const char *const LOCK_NAMES[LOCK_COUNT] = {
+    [LOCK_FRAME_QUEUE] = "frame_queue",
+    [LOCK_FRAME_POOL] = "frame_pool",
+    [LOCK_PACKET_QUEUE] = "packet_queue",
+    [LOCK_INSTRUCTIONS] = "instructions",
+    [LOCK_THREAD_GATE] = "thread_gate",
+};
+
+/**
+ * @struct lock_stats
+ * @brief everything recorded about one kind of lock, added to by every thread, times in microseconds that wrap
+ */
+struct lock_stats {
+    SDL_AtomicInt acquisitions;                          /**< times the mutex was locked */
+    SDL_AtomicInt contended;                             /**< times it was already locked by another thread */
+    SDL_AtomicInt acquire_us;                            /**< time spent waiting to lock it */
+    SDL_AtomicInt hold_us;                               /**< time it was held, not counting condition waits */
+    SDL_AtomicInt waits;                                 /**< condition waits */
+    SDL_AtomicInt timeouts;                              /**< condition waits that timed out */
+    SDL_AtomicInt wait_us;                               /**< time spent in condition waits */
+    SDL_AtomicInt last_waker;                            /**< slot + 1 of the thread that last signaled, 0 for none yet */
+    SDL_AtomicInt woken_by[PROFILE_THREADS];             /**< signaled waits per waking thread */
+    SDL_AtomicInt acquire_histogram[HISTOGRAM_BUCKETS];  /**< time to lock */
+    SDL_AtomicInt hold_histogram[HISTOGRAM_BUCKETS];     /**< time held */
+    SDL_AtomicInt wait_histogram[HISTOGRAM_BUCKETS];     /**< time waited on a condition */
+};
+
+/**
+ * @struct profile_thread
+ * @brief a profiled thread, only written by that thread
+ */
+struct profile_thread {
+    char name[PROFILE_NAME_BYTES];        /**< name shown in the profile */
+    int slot;                             /**< index in threads */
+    Uint64 acquired_ns[LOCK_COUNT];       /**< when the thread took each kind of lock it holds */
+    SDL_AtomicU32 blocked_us[LOCK_COUNT]; /**< time spent locking and waiting on each kind of lock, wraps */
+};
+
+static struct lock_stats lock_stats[LOCK_COUNT];
+
+// threads are never freed, the dump can run after they have exited
+static struct profile_thread *threads[PROFILE_THREADS];
+static SDL_AtomicInt thread_count;
+static SDL_TLSID current_thread;
+
+/**
+ * @brief creates the record of the calling thread and publishes it to the dump
+ *
+ * @param name thread name, NULL to use the thread id
+ * @return the record, or NULL if there are too many threads or it couldn't be allocated
+ */
+static struct profile_thread *register_thread(const char *name) {
+    const int slot = SDL_AddAtomicInt(&thread_count, 1);
+    if (slot >= PROFILE_THREADS) {
+        return NULL;
+    }
+
+    struct profile_thread *thread = calloc(1, sizeof(struct profile_thread));
+    if (!thread) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't allocate lock profile\n");
+        return NULL;
+    }
+
+    if (name) {
+        SDL_strlcpy(thread->name, name, sizeof(thread->name));
+    } else {
+        SDL_snprintf(thread->name, sizeof(thread->name), "thread %" SDL_PRIu64, SDL_GetCurrentThreadID());
+    }
+    thread->slot = slot;
+
+    SDL_SetTLS(&current_thread, thread, NULL);
+    SDL_SetAtomicPointer((void **)&threads[slot], thread);
+    return thread;
+}
+
+/**
+ * @return the calling thread's record, registered on first use, NULL if it couldn't be
+ */
+static struct profile_thread *get_thread(void) {
+    struct profile_thread *thread = SDL_GetTLS(&current_thread);
+    return thread ? thread : register_thread(NULL);
+}
+
+void lock_profile_thread(const char *name) {
+    struct profile_thread *thread = SDL_GetTLS(&current_thread);
+    if (thread) {
+        SDL_strlcpy(thread->name, name, sizeof(thread->name));
+        return;
+    }
+    register_thread(name);
+}
+
+/**
+ * @brief adds a time to a histogram and a running total
+ *
+ * @param histogram histogram to add to
+ * @param total_us total to add to
+ * @param ns time to add
+ */
+static void record_time(SDL_AtomicInt *histogram, SDL_AtomicInt *total_us, const Uint64 ns) {
+    const Uint64 us = ns / SDL_NS_PER_US;
+
+    int bucket = 0;
+    while (bucket < HISTOGRAM_BUCKETS - 1 && (us >> bucket) != 0) {
+        bucket++;
+    }
+    SDL_AddAtomicInt(&histogram[bucket], 1);
+    SDL_AddAtomicInt(total_us, (int)us);
+}
+
+/**
+ * @brief adds to the time a thread spent blocked on a kind of lock
+ */
+static void add_blocked(struct profile_thread *thread, const enum profiled_lock lock, const Uint64 ns) {
+    // only this thread writes it
+    SDL_SetAtomicU32(&thread->blocked_us[lock],
+        SDL_GetAtomicU32(&thread->blocked_us[lock]) + (uint32_t)(ns / SDL_NS_PER_US));
+}
+
+/**
+ * @brief records the end of a stretch of holding a lock
+ */
+static void end_hold(struct profile_thread *thread, const enum profiled_lock lock, const Uint64 now_ns) {
+    struct lock_stats *stats = &lock_stats[lock];
+    record_time(stats->hold_histogram, &stats->hold_us, now_ns - thread->acquired_ns[lock]);
+}
+
+void profiled_lock_mutex(SDL_Mutex *mutex, const enum profiled_lock lock) {
+    struct lock_stats *stats = &lock_stats[lock];
+    struct profile_thread *thread = get_thread();
+
+    // the uncontended case costs one clock read, for the hold time
+    Uint64 acquire_ns = 0;
+    if (!SDL_TryLockMutex(mutex)) {
+        const Uint64 start_ns = SDL_GetTicksNS();
+        SDL_LockMutex(mutex);
+        acquire_ns = SDL_GetTicksNS() - start_ns;
+        SDL_AddAtomicInt(&stats->contended, 1);
+    }
+    SDL_AddAtomicInt(&stats->acquisitions, 1);
+    record_time(stats->acquire_histogram, &stats->acquire_us, acquire_ns);
+
+    if (thread) {
+        thread->acquired_ns[lock] = SDL_GetTicksNS();
+        add_blocked(thread, lock, acquire_ns);
+    }
+}
+
+void profiled_unlock_mutex(SDL_Mutex *mutex, const enum profiled_lock lock) {
+    struct profile_thread *thread = SDL_GetTLS(&current_thread);
+    if (thread) {
+        end_hold(thread, lock, SDL_GetTicksNS());
+    }
+    SDL_UnlockMutex(mutex);
+}
+
+bool profiled_wait_condition(SDL_Condition *condition, SDL_Mutex *mutex, const Sint32 timeout_ms,
+                             const enum profiled_lock lock)
+{
+    struct lock_stats *stats = &lock_stats[lock];
+    struct profile_thread *thread = SDL_GetTLS(&current_thread);
+
+    const Uint64 wait_start_ns = SDL_GetTicksNS();
+    if (thread) {
+        end_hold(thread, lock, wait_start_ns);
+    }
+
+    const bool signaled = SDL_WaitConditionTimeout(condition, mutex, timeout_ms);
+
+    // held again from here, the time waiting counts as blocked
+    const Uint64 wait_end_ns = SDL_GetTicksNS();
+    SDL_AddAtomicInt(&stats->waits, 1);
+    record_time(stats->wait_histogram, &stats->wait_us, wait_end_ns - wait_start_ns);
+    if (thread) {
+        thread->acquired_ns[lock] = wait_end_ns;
+        add_blocked(thread, lock, wait_end_ns - wait_start_ns);
+    }
+
+    if (!signaled) {
+        SDL_AddAtomicInt(&stats->timeouts, 1);
+    } else {
+        const int waker = SDL_GetAtomicInt(&stats->last_waker);
+        if (waker > 0) {
+            SDL_AddAtomicInt(&stats->woken_by[waker - 1], 1);
+        }
+    }
+    return signaled;
+}
+
+void profiled_signal_condition(SDL_Condition *condition, const enum profiled_lock lock, const bool broadcast) {
+    const struct profile_thread *thread = get_thread();
+    if (thread) {
+        SDL_SetAtomicInt(&lock_stats[lock].last_waker, thread->slot + 1);
+    }
+
+    if (broadcast) {
+        SDL_BroadcastCondition(condition);
+    } else {
+        SDL_SignalCondition(condition);
+    }
+}
+
+/**
+ * @brief logs the non empty buckets of a histogram on one line
+ *
+ * @param label what the histogram measures
+ * @param histogram histogram to log
+ */
+static void log_histogram(const char *label, SDL_AtomicInt *histogram) {
+    char line[HISTOGRAM_LINE_BYTES];
+    int length = SDL_snprintf(line, sizeof(line), "  %-8s", label);
+
+    bool empty = true;
+    for (int i = 0; i < HISTOGRAM_BUCKETS && length < (int)sizeof(line); i++) {
+        const int count = SDL_GetAtomicInt(&histogram[i]);
+        if (count == 0) continue;
+
+        empty = false;
+        if (i == 0) {
+            length += SDL_snprintf(line + length, sizeof(line) - length, " <1us:%d", count);
+        } else if (i == HISTOGRAM_BUCKETS - 1) {
+            length += SDL_snprintf(line + length, sizeof(line) - length, " >=%" SDL_PRIu64 "us:%d", (Uint64)1 << (i - 1), count);
+        } else {
+            length += SDL_snprintf(line + length, sizeof(line) - length, " <%" SDL_PRIu64 "us:%d", (Uint64)1 << i, count);
+        }
+    }
+    if (!empty) {
+        SDL_Log("%s\n", line);
+    }
+}
+
+void dump_lock_profile(void) {
+    const int thread_total = SDL_min(SDL_GetAtomicInt(&thread_count), PROFILE_THREADS);
+
+    for (int lock = 0; lock < LOCK_COUNT; lock++) {
+        struct lock_stats *stats = &lock_stats[lock];
+        const int acquisitions = SDL_GetAtomicInt(&stats->acquisitions);
+        const int waits = SDL_GetAtomicInt(&stats->waits);
+        if (acquisitions == 0) continue;
+
+        SDL_Log("lock %s: %d locked, %d contended, %.2f ms locking, %.2f ms held, "
+            "%d waits, %d timed out, %.2f ms waiting\n", LOCK_NAMES[lock], acquisitions,
+            SDL_GetAtomicInt(&stats->contended), (double)(uint32_t)SDL_GetAtomicInt(&stats->acquire_us) / 1000.0,
+            (double)(uint32_t)SDL_GetAtomicInt(&stats->hold_us) / 1000.0, waits, SDL_GetAtomicInt(&stats->timeouts),
+            (double)(uint32_t)SDL_GetAtomicInt(&stats->wait_us) / 1000.0);
+
+        // which threads end the waits on this lock
+        char line[HISTOGRAM_LINE_BYTES];
+        int length = SDL_snprintf(line, sizeof(line), "  woken by");
+        bool woken = false;
+        for (int slot = 0; slot < thread_total && length < (int)sizeof(line); slot++) {
+            const struct profile_thread *thread = SDL_GetAtomicPointer((void **)&threads[slot]);
+            const int count = SDL_GetAtomicInt(&stats->woken_by[slot]);
+            if (!thread || count == 0) continue;
+
+            length += SDL_snprintf(line + length, sizeof(line) - length, "%s %s %d", woken ? "," : "", thread->name, count);
+            woken = true;
+        }
+        if (woken) {
+            SDL_Log("%s\n", line);
+        }
+
+        log_histogram("locking", stats->acquire_histogram);
+        log_histogram("held", stats->hold_histogram);
+        log_histogram("waiting", stats->wait_histogram);
+    }
+
+    // wall time each thread spent blocked, locking or waiting, per kind of lock
+    for (int slot = 0; slot < thread_total; slot++) {
+        struct profile_thread *thread = SDL_GetAtomicPointer((void **)&threads[slot]);
+        if (!thread) continue;
+
+        char line[HISTOGRAM_LINE_BYTES];
+        int length = SDL_snprintf(line, sizeof(line), "%s blocked on", thread->name);
+        for (int lock = 0; lock < LOCK_COUNT && length < (int)sizeof(line); lock++) {
+            const uint32_t blocked_us = SDL_GetAtomicU32(&thread->blocked_us[lock]);
+            if (blocked_us == 0) continue;
+
+            length += SDL_snprintf(line + length, sizeof(line) - length, " %s %.2f ms", LOCK_NAMES[lock],
+                (double)blocked_us / 1000.0);
+        }
+        SDL_Log("%s\n", line);
+    }
+}
+
+#endif //AIRBUD_LOCK_PROFILE
@@ -0,0 +1,111 @@
+/**
+ * @file lock_profile.h
+ *
+ * Contention profile of the pipeline's mutexes and condition waits, to tell whether a stutter comes from
+ * decoding or from threads waiting on each other. Locks are profiled by kind, every packet queue counts as
+ * one lock and so on. For each kind it records how long taking the mutex took, how long it was held, how
+ * long condition waits took, how many of them timed out and which thread woke them, as log2 histograms.
+ * Only compiled in when AIRBUD_LOCK_PROFILE is defined, otherwise every macro is the plain SDL call
+ *
+ * usage:
+ *     LOCK_MUTEX(queue->mutex, LOCK_PACKET_QUEUE);
+ *     while (queue->size == 0) {
+ *         WAIT_CONDITION(queue->not_empty, queue->mutex, -1, LOCK_PACKET_QUEUE);
+ *     }
+ *     UNLOCK_MUTEX(queue->mutex, LOCK_PACKET_QUEUE);
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#ifndef LOCK_PROFILE_H
+#define LOCK_PROFILE_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+
+/**
+ * @enum profiled_lock
+ * @brief kinds of lock that are profiled
+ */
+enum profiled_lock {
+    LOCK_FRAME_QUEUE,   /**< frame_queue mutex, only taken to sleep on and wake the other side */
+    LOCK_FRAME_POOL,    /**< frame_pool free list */
+    LOCK_PACKET_QUEUE,  /**< packet queues between the demuxer and the decoder threads */
+    LOCK_INSTRUCTIONS,  /**< decoding instructions the main thread publishes */
+    LOCK_THREAD_GATE,   /**< publish / park handoff and audio drain waits */
+    LOCK_COUNT,
+};
+
+#ifdef AIRBUD_LOCK_PROFILE
+
+#define LOCK_MUTEX(mutex, lock) profiled_lock_mutex(mutex, lock)
+#define UNLOCK_MUTEX(mutex, lock) profiled_unlock_mutex(mutex, lock)
+#define WAIT_CONDITION(condition, mutex, timeout_ms, lock) profiled_wait_condition(condition, mutex, timeout_ms, lock)
+#define SIGNAL_CONDITION(condition, lock) profiled_signal_condition(condition, lock, false)
+#define BROADCAST_CONDITION(condition, lock) profiled_signal_condition(condition, lock, true)
+#define LOCK_PROFILE_THREAD(name) lock_profile_thread(name)
+#define DUMP_LOCK_PROFILE() dump_lock_profile()
+
+/**
+ * @brief names the calling thread in the profile, threads that never call it show up under their thread id
+ *
+ * @param name name to show, copied
+ */
+void lock_profile_thread(const char *name);
+
+/**
+ * @brief locks a mutex, recording how long it took
+ *
+ * @param mutex mutex to lock
+ * @param lock kind of lock it is
+ */
+void profiled_lock_mutex(SDL_Mutex *mutex, enum profiled_lock lock);
+
+/**
+ * @brief unlocks a mutex locked with profiled_lock_mutex, recording how long it was held
+ *
+ * @param mutex mutex to unlock
+ * @param lock kind of lock it is
+ */
+void profiled_unlock_mutex(SDL_Mutex *mutex, enum profiled_lock lock);
+
+/**
+ * @brief waits on a condition, recording how long for, whether it timed out and who woke it
+ * the time waiting doesn't count as holding the mutex
+ *
+ * @param condition condition to wait on
+ * @param mutex mutex it is waited on with, locked with profiled_lock_mutex
+ * @param timeout_ms longest wait, -1 to wait until signaled
+ * @param lock kind of lock it is
+ * @return true if signaled, false on timeout
+ */
+bool profiled_wait_condition(SDL_Condition *condition, SDL_Mutex *mutex, Sint32 timeout_ms, enum profiled_lock lock);
+
+/**
+ * @brief signals a condition, waiters woken by it count the calling thread as their waker
+ *
+ * @param condition condition to signal
+ * @param lock kind of lock it is waited on with
+ * @param broadcast true to wake every waiter, false to wake one
+ */
+void profiled_signal_condition(SDL_Condition *condition, enum profiled_lock lock, bool broadcast);
+
+/**
+ * @brief logs the profile of every lock and how long each thread was blocked on them, counting from startup
+ */
+void dump_lock_profile(void);
+
+#else
+
+#define LOCK_MUTEX(mutex, lock) SDL_LockMutex(mutex)
+#define UNLOCK_MUTEX(mutex, lock) SDL_UnlockMutex(mutex)
+#define WAIT_CONDITION(condition, mutex, timeout_ms, lock) SDL_WaitConditionTimeout(condition, mutex, timeout_ms)
+#define SIGNAL_CONDITION(condition, lock) SDL_SignalCondition(condition)
+#define BROADCAST_CONDITION(condition, lock) SDL_BroadcastCondition(condition)
+#define LOCK_PROFILE_THREAD(name) ((void)0)
+#define DUMP_LOCK_PROFILE() ((void)0)
+
+#endif //AIRBUD_LOCK_PROFILE
+
+#endif //LOCK_PROFILE_H
@@ -12,6 +12,9 @@
 
 #include <init.h>
 #include <game_states.h>
+#include <deinterlace.h>
+#include <trace.h>
+#include <lock_profile.h>
 
 /* runs on startup */
 SDL_AppResult SDL_AppInit(void **appstate, int argc, char *argv[]) { //TODO add usage
@@ -82,11 +85,30 @@ SDL_AppResult SDL_AppEvent(void *appstate, SDL_Event *event) {
                     // currently windowed, changes to fullscreen
                     SDL_SetWindowFullscreen(state->window, true);
                 }
+            } else if (event->key.key == SDLK_D) {
+                // cycles the deinterlacer, the video decoder switches on its next frame
+                const enum deinterlace_kernel kernel =
+                    next_deinterlace_kernel((enum deinterlace_kernel)SDL_GetAtomicInt(&state->deinterlace_kernel));
+                SDL_SetAtomicInt(&state->deinterlace_kernel, kernel);
+                SDL_Log("switching deinterlacer to %s\n", deinterlace_kernel_name(kernel));
+            } else if (event->key.key == SDLK_H) {
+                // the renderer picks it up on its next frame
+                SDL_SetAtomicInt(&state->show_hud, !SDL_GetAtomicInt(&state->show_hud));
+            } else if (event->key.key == SDLK_T) {
+                // snapshot of the latest spans, only does anything in builds with AIRBUD_TRACE on
+                TRACE_EXPORT();
+            } else if (event->key.key == SDLK_L) {
+                // lock contention so far, only does anything in builds with AIRBUD_LOCK_PROFILE on
+                DUMP_LOCK_PROFILE();
             }
             break;
         default:
 
             if (event->type == state->decoding_ended_event) {
+                // the section it ended was already left behind
+                if ((uint32_t)event->user.code != SDL_GetAtomicU32(&state->segment_epoch)) {
+                    break;
+                }
                 SDL_Log("signal read by main thread \n");
 
                 //audio and video queues will inherently be clear when this is called, this wastes time double clearing them
@@ -108,7 +130,14 @@ void SDL_AppQuit(void *appstate, SDL_AppResult result) {
 
     //TODO end whole program when a single thread errors out
 
+    // the threads use the queue and the pool until they have exited
+    stop_threads(state);
+
+    TRACE_EXPORT();
+    DUMP_LOCK_PROFILE();
+
     destroy_frameQueue(state->render_queue);
+    destroy_frame_pool(state->frame_pool);
     //SDL_DestroyAudioStream
 }
 
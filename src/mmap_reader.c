@@ -0,0 +1,200 @@
+/**
+ * @file mmap_reader.c
+ *
+ * mmap backed reader for libavformat, using MapViewOfFile on windows and mmap everywhere else
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#include <SDL3/SDL.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <libavformat/avio.h>
+#include <libavutil/avutil.h>
+#include <libavutil/mem.h>
+
+#include <mmap_reader.h>
+
+#define IO_BUFFER_SIZE 32768 // size of the buffer the demuxer reads through, every read is copied into it
+
+/**
+ * @brief AVIOContext read callback, copies the next part of the mapping into the context's buffer
+ */
+static int copy_from_mapping(void *opaque, uint8_t *buffer, const int buffer_size) {
+    struct mmap_reader *reader = opaque;
+
+    if (reader->position >= reader->size) {
+        return AVERROR_EOF;
+    }
+
+    const uint64_t remaining = reader->size - reader->position;
+    const int read_size = remaining < (uint64_t)buffer_size ? (int)remaining : buffer_size;
+
+    memcpy(buffer, reader->data + reader->position, read_size);
+    reader->position += read_size;
+    return read_size;
+}
+
+/**
+ * @brief AVIOContext seek callback, only moves the read position
+ */
+static int64_t seek_mapping(void *opaque, const int64_t offset, const int whence) {
+    struct mmap_reader *reader = opaque;
+
+    int64_t position;
+    switch (whence & ~AVSEEK_FORCE) {
+        case AVSEEK_SIZE:
+            return (int64_t)reader->size;
+        case SEEK_SET:
+            position = offset;
+            break;
+        case SEEK_CUR:
+            position = (int64_t)reader->position + offset;
+            break;
+        case SEEK_END:
+            position = (int64_t)reader->size + offset;
+            break;
+        default:
+            return AVERROR(EINVAL);
+    }
+
+    if (position < 0 || (uint64_t)position > reader->size) {
+        return AVERROR(EINVAL);
+    }
+    reader->position = (uint64_t)position;
+    return position;
+}
+
+/**
+ * @brief maps a whole file read only
+ * @param path path to the file
+ * @param reader populates data and size
+ * @return true on success, false otherwise
+ */
+static bool map_file(const char *path, struct mmap_reader *reader) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping) {
+        return false;
+    }
+
+    // the view keeps the mapping alive on its own
+    reader->data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    reader->size = (uint64_t)size.QuadPart;
+#else
+    const int file = open(path, O_RDONLY);
+    if (file < 0) {
+        return false;
+    }
+
+    struct stat file_stat;
+    if (fstat(file, &file_stat) < 0 || file_stat.st_size == 0) {
+        close(file);
+        return false;
+    }
+
+    // the mapping stays valid after the descriptor is closed
+    void *data = mmap(NULL, (size_t)file_stat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    reader->data = data == MAP_FAILED ? NULL : data;
+    reader->size = (uint64_t)file_stat.st_size;
+#endif
+    return reader->data != NULL;
+}
+
+/**
+ * @brief unmaps a file mapped with map_file
+ * @param reader reader
+ */
+static void unmap_file(const struct mmap_reader *reader) {
+    if (!reader->data) return;
+#ifdef _WIN32
+    UnmapViewOfFile(reader->data);
+#else
+    munmap((void *)reader->data, (size_t)reader->size);
+#endif
+}
+
+struct mmap_reader *open_mmap_reader(const char *path) {
+    struct mmap_reader *reader = calloc(1, sizeof(struct mmap_reader));
+    if (!reader) return NULL;
+
+    if (!map_file(path, reader)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't map %s\n", path);
+        free(reader);
+        return NULL;
+    }
+
+    uint8_t *io_buffer = av_malloc(IO_BUFFER_SIZE);
+    if (!io_buffer) {
+        close_mmap_reader(reader);
+        return NULL;
+    }
+
+    reader->io_context = avio_alloc_context(io_buffer, IO_BUFFER_SIZE, 0, reader, copy_from_mapping, NULL, seek_mapping);
+    if (!reader->io_context) {
+        av_free(io_buffer);
+        close_mmap_reader(reader);
+        return NULL;
+    }
+
+    return reader;
+}
+
+void advise_mmap_range(const struct mmap_reader *reader, uint64_t start_offset_bytes, uint64_t end_offset_bytes,
+                         const bool sequential)
+{
+    if (start_offset_bytes >= reader->size) return;
+    if (end_offset_bytes > reader->size) {
+        end_offset_bytes = reader->size;
+    }
+
+#ifndef _WIN32
+    // madvise needs a page aligned start
+    const uint64_t page_size = (uint64_t)sysconf(_SC_PAGESIZE);
+    start_offset_bytes -= start_offset_bytes % page_size;
+
+    madvise((void *)(reader->data + start_offset_bytes), (size_t)(end_offset_bytes - start_offset_bytes),
+        sequential ? MADV_SEQUENTIAL : MADV_WILLNEED);
+#else
+    // windows has no per range read ahead hints for mapped views, its own read ahead handles sequential access
+    (void)sequential;
+#endif
+}
+
+void close_mmap_reader(struct mmap_reader *reader) {
+    if (!reader) return;
+
+    if (reader->io_context) {
+        av_freep(&reader->io_context->buffer);
+        avio_context_free(&reader->io_context);
+    }
+    unmap_file(reader);
+    free(reader);
+}
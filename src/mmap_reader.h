@@ -0,0 +1,59 @@
+/**
+ * @file mmap_reader.h
+ *
+ * mmap backed reader for libavformat. The whole vob is mapped once and read by the demuxer through a
+ * custom AVIOContext, so reads need no syscalls, seeks only move an offset, and the os can be told which
+ * ranges to read ahead. It isn't zero copy, every read still copies from the mapping into the AVIOContext's buffer
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#ifndef MMAP_READER_H
+#define MMAP_READER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <libavformat/avio.h>
+
+/**
+ * @struct mmap_reader
+ * @brief a read only mapping of a file and the AVIOContext that copies out of it
+ */
+struct mmap_reader {
+    const uint8_t *data;          /**< start of the mapping */
+    uint64_t size;                /**< size of the file in bytes */
+    uint64_t position;            /**< read position of the AVIOContext */
+
+    AVIOContext *io_context;      /**< context to hand to the AVFormatContext as its pb */
+};
+
+/**
+ * @brief maps a file and creates an AVIOContext that copies out of the mapping
+ *
+ * @param path path to the file
+ * @return pointer to the reader, or NULL on failure
+ */
+struct mmap_reader *open_mmap_reader(const char *path);
+
+/**
+ * @brief hints to the os how a range of the file will be used so it can read ahead, does nothing where unsupported
+ *
+ * @param reader reader
+ * @param start_offset_bytes start of the range
+ * @param end_offset_bytes end of the range
+ * @param sequential true if the range is about to be read front to back, false to just start reading it in ahead of time
+ */
+void advise_mmap_range(const struct mmap_reader *reader, uint64_t start_offset_bytes, uint64_t end_offset_bytes,
+                         bool sequential);
+
+/**
+ * @brief frees the AVIOContext and unmaps the file
+ * the AVFormatContext using it must be closed first
+ *
+ * @param reader reader to close, can be NULL
+ */
+void close_mmap_reader(struct mmap_reader *reader);
+
+#endif //MMAP_READER_H
@@ -0,0 +1,129 @@
+/**
+ * @file packet_queue.c
+ *
+ * helper functions for the packet_queue struct
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#include <SDL3/SDL.h>
+#include <libavcodec/packet.h>
+
+#include <stdbool.h>
+
+#include <packet_queue.h>
+#include <lock_profile.h>
+
+packet_queue *create_packet_queue(const int capacity) {
+    packet_queue *queue = calloc(1, sizeof(packet_queue));
+    if (!queue) return NULL;
+
+    queue->capacity = capacity;
+    queue->entries = calloc(capacity, sizeof(struct packet_entry));
+    if (!queue->entries) {
+        free(queue);
+        return NULL;
+    }
+
+    // packets are allocated once, data is moved in and out of them
+    for (int i = 0; i < capacity; i++) {
+        queue->entries[i].packet = av_packet_alloc();
+        if (!queue->entries[i].packet) {
+            destroy_packet_queue(queue);
+            return NULL;
+        }
+    }
+
+    queue->mutex = SDL_CreateMutex();
+    queue->not_empty = SDL_CreateCondition();
+    queue->not_full = SDL_CreateCondition();
+    if (!queue->mutex || !queue->not_empty || !queue->not_full) {
+        destroy_packet_queue(queue);
+        return NULL;
+    }
+    return queue;
+}
+
+bool push_packet(packet_queue *queue, const enum packet_command command, AVPacket *packet, const void *target,
+                 const Sint32 timeout_ms)
+{
+    LOCK_MUTEX(queue->mutex, LOCK_PACKET_QUEUE);
+
+    if (queue->size == queue->capacity) {
+        if (!WAIT_CONDITION(queue->not_full, queue->mutex, timeout_ms, LOCK_PACKET_QUEUE) || queue->size == queue->capacity) {
+            UNLOCK_MUTEX(queue->mutex, LOCK_PACKET_QUEUE);
+            return false;
+        }
+    }
+
+    struct packet_entry *entry = &queue->entries[queue->rear];
+    entry->command = command;
+    entry->target = target;
+    if (packet) {
+        av_packet_move_ref(entry->packet, packet);
+    }
+
+    queue->rear = (queue->rear + 1) % queue->capacity;
+    queue->size++;
+
+    SIGNAL_CONDITION(queue->not_empty, LOCK_PACKET_QUEUE);
+    UNLOCK_MUTEX(queue->mutex, LOCK_PACKET_QUEUE);
+    return true;
+}
+
+enum packet_command pop_packet(packet_queue *queue, AVPacket *packet, const void **target) {
+    LOCK_MUTEX(queue->mutex, LOCK_PACKET_QUEUE);
+
+    while (queue->size == 0) {
+        WAIT_CONDITION(queue->not_empty, queue->mutex, -1, LOCK_PACKET_QUEUE);
+    }
+
+    struct packet_entry *entry = &queue->entries[queue->front];
+    const enum packet_command command = entry->command;
+    *target = entry->target;
+    if (command == PACKET_DATA) {
+        av_packet_move_ref(packet, entry->packet);
+    }
+
+    queue->front = (queue->front + 1) % queue->capacity;
+    queue->size--;
+
+    SIGNAL_CONDITION(queue->not_full, LOCK_PACKET_QUEUE);
+    UNLOCK_MUTEX(queue->mutex, LOCK_PACKET_QUEUE);
+    return command;
+}
+
+void clear_packet_queue(packet_queue *queue) {
+    if (!queue) return;
+
+    LOCK_MUTEX(queue->mutex, LOCK_PACKET_QUEUE);
+
+    while (queue->size > 0) {
+        av_packet_unref(queue->entries[queue->front].packet);
+        queue->front = (queue->front + 1) % queue->capacity;
+        queue->size--;
+    }
+    queue->front = 0;
+    queue->rear = 0;
+
+    BROADCAST_CONDITION(queue->not_full, LOCK_PACKET_QUEUE);
+    UNLOCK_MUTEX(queue->mutex, LOCK_PACKET_QUEUE);
+}
+
+void destroy_packet_queue(packet_queue *queue) {
+    if (!queue) return;
+
+    if (queue->entries) {
+        for (int i = 0; i < queue->capacity; i++) {
+            av_packet_free(&queue->entries[i].packet);
+        }
+    }
+
+    SDL_DestroyMutex(queue->mutex);
+    SDL_DestroyCondition(queue->not_empty);
+    SDL_DestroyCondition(queue->not_full);
+
+    free(queue->entries);
+    free(queue);
+}
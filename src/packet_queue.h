@@ -0,0 +1,105 @@
+/**
+ * @file packet_queue.h
+ *
+ * Bounded queue of demuxed packets and in-band commands, used to hand
+ * packets from the demuxer thread to the audio and video decoder threads
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#ifndef PACKET_QUEUE_H
+#define PACKET_QUEUE_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <libavcodec/packet.h>
+
+/**
+ * @enum packet_command
+ * @brief what a decoder thread should do with an entry, commands travel in order with the packets around them
+ */
+enum packet_command {
+    PACKET_DATA,      /**< decode the packet */
+    PACKET_FLUSH,     /**< flush the decoder, then switch to the entry's target */
+    PACKET_RETARGET,  /**< switch to the entry's target without flushing */
+    PACKET_SYNC,      /**< acknowledge once everything before this has been decoded */
+    PACKET_END,       /**< the section has been fully demuxed, drain the decoder then acknowledge */
+    PACKET_QUIT       /**< exit the decoder thread */
+};
+
+/**
+ * @struct packet_entry
+ * @brief a single entry in a packet_queue
+ */
+struct packet_entry {
+    AVPacket *packet;             /**< preallocated packet, only holds data for PACKET_DATA entries */
+    enum packet_command command;  /**< what to do with the entry */
+    const void *target;           /**< where decoded output goes for PACKET_FLUSH and PACKET_RETARGET, owned by the demuxer */
+};
+
+/**
+ * @struct packet_queue
+ * @brief memory safe circular queue of packet entries, the packets are allocated once and reused
+ */
+typedef struct packet_queue {
+    struct packet_entry *entries; /**< circular buffer of entries */
+    int capacity;                 /**< Max capacity of the array */
+    int size;                     /**< Current number of entries in the queue */
+    int front;                    /**< Index of first entry */
+    int rear;                     /**< Index after the last entry */
+
+    SDL_Mutex *mutex;             /**< Guards access from multiple threads to prevent data corruption */
+    SDL_Condition *not_empty;     /**< Signaled when entries are added */
+    SDL_Condition *not_full;      /**< Signaled when entries are removed */
+} packet_queue;
+
+/**
+ * @brief creates and populates a packet queue
+ *
+ * @param capacity max amount of entries the queue can hold
+ * @return *packet_queue - pointer to the created queue, or NULL on failure
+ */
+packet_queue *create_packet_queue(int capacity);
+
+/**
+ * @brief adds an entry to the back of the queue, waiting for space if it is full
+ * internally handles mutex
+ *
+ * @param queue queue to be added to
+ * @param command what the decoder should do with the entry
+ * @param packet packet to move into the queue for PACKET_DATA, it is left blank. NULL for commands
+ * @param target where decoded output goes for PACKET_FLUSH and PACKET_RETARGET, NULL otherwise
+ * @param timeout_ms how long to wait for space
+ * @return true on success, false if the queue stayed full for the whole timeout
+ */
+bool push_packet(packet_queue *queue, enum packet_command command, AVPacket *packet, const void *target,
+                 Sint32 timeout_ms);
+
+/**
+ * @brief takes the first entry from the queue, waiting until there is one
+ * internally handles mutex
+ *
+ * @param queue queue to pop from
+ * @param packet blank packet the entry's data is moved into
+ * @param target set to the entry's target
+ * @return the entry's command
+ */
+enum packet_command pop_packet(packet_queue *queue, AVPacket *packet, const void **target);
+
+/**
+ * @brief drops every entry in the queue
+ * internally handles mutex
+ *
+ * @param queue queue to clear
+ */
+void clear_packet_queue(packet_queue *queue);
+
+/**
+ * @brief destroys a packet_queue freeing all associated resources
+ *
+ * @param queue queue to be destroyed, can be NULL
+ */
+void destroy_packet_queue(packet_queue *queue);
+
+#endif //PACKET_QUEUE_H
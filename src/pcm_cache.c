@@ -0,0 +1,142 @@
+/**
+ * @file pcm_cache.c
+ *
+ * LRU cache of resampled audio for short audio only game states
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#include <SDL3/SDL.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pcm_cache.h>
+
+struct pcm_cache *create_pcm_cache(const size_t budget_bytes) {
+    struct pcm_cache *cache = calloc(1, sizeof(struct pcm_cache));
+    if (!cache) return NULL;
+
+    cache->budget_bytes = budget_bytes;
+    return cache;
+}
+
+const struct pcm_cache_entry *pcm_cache_lookup(struct pcm_cache *cache, const STATE_ID state) {
+    struct pcm_cache_entry *entry = &cache->entries[state];
+
+    if (!entry->data) {
+        cache->misses++;
+        return NULL;
+    }
+
+    cache->hits++;
+    entry->last_used = ++cache->clock;
+    return entry;
+}
+
+bool pcm_cache_contains(const struct pcm_cache *cache, const STATE_ID state) {
+    return cache->entries[state].data != NULL;
+}
+
+/**
+ * @brief frees a single entry
+ * @param cache cache the entry is in
+ * @param entry entry to free
+ */
+static void evict_entry(struct pcm_cache *cache, struct pcm_cache_entry *entry) {
+    cache->used_bytes -= entry->size;
+    free(entry->data);
+    memset(entry, 0, sizeof(struct pcm_cache_entry));
+}
+
+bool pcm_cache_insert(struct pcm_cache *cache, const STATE_ID state, struct pcm_buffer *buffer) {
+
+    if (buffer->overflowed || !buffer->data || buffer->size > cache->budget_bytes) {
+        pcm_buffer_reset(buffer);
+        return false;
+    }
+
+    // replaces an older copy of the same state
+    if (cache->entries[state].data) {
+        evict_entry(cache, &cache->entries[state]);
+    }
+
+    // evicts the least recently used states until the new one fits
+    while (cache->used_bytes + buffer->size > cache->budget_bytes) {
+        struct pcm_cache_entry *oldest = NULL;
+        for (int i = 0; i < STATE_COUNT; i++) {
+            if (cache->entries[i].data && (!oldest || cache->entries[i].last_used < oldest->last_used)) {
+                oldest = &cache->entries[i];
+            }
+        }
+        evict_entry(cache, oldest);
+    }
+
+    struct pcm_cache_entry *entry = &cache->entries[state];
+    entry->data = buffer->data;
+    entry->size = buffer->size;
+    entry->samples = buffer->samples;
+    entry->last_used = ++cache->clock;
+    cache->used_bytes += entry->size;
+
+    // the cache owns the data now
+    buffer->data = NULL;
+    pcm_buffer_reset(buffer);
+
+    SDL_Log("cached %zu bytes of audio for state %d, %zu/%zu bytes used\n",
+        entry->size, state, cache->used_bytes, cache->budget_bytes);
+    return true;
+}
+
+void destroy_pcm_cache(struct pcm_cache *cache) {
+    if (!cache) return;
+
+    SDL_Log("pcm cache: %" PRIu32 " hits, %" PRIu32 " misses\n", cache->hits, cache->misses);
+
+    for (int i = 0; i < STATE_COUNT; i++) {
+        free(cache->entries[i].data);
+    }
+    free(cache);
+}
+
+void pcm_buffer_append(struct pcm_buffer *buffer, const uint8_t *data, const size_t size, const uint32_t samples) {
+    if (buffer->overflowed) return;
+
+    if (buffer->size + size > buffer->limit) {
+        // too big to ever be cached, stop capturing
+        pcm_buffer_abandon(buffer);
+        return;
+    }
+
+    if (buffer->size + size > buffer->capacity) {
+        size_t new_capacity = buffer->capacity ? buffer->capacity * 2 : 65536;
+        while (new_capacity < buffer->size + size) {
+            new_capacity *= 2;
+        }
+        uint8_t *new_data = realloc(buffer->data, new_capacity);
+        if (!new_data) {
+            pcm_buffer_abandon(buffer);
+            return;
+        }
+        buffer->data = new_data;
+        buffer->capacity = new_capacity;
+    }
+
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+    buffer->samples += samples;
+}
+
+void pcm_buffer_abandon(struct pcm_buffer *buffer) {
+    pcm_buffer_reset(buffer);
+    buffer->overflowed = true;
+}
+
+void pcm_buffer_reset(struct pcm_buffer *buffer) {
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->size = 0;
+    buffer->capacity = 0;
+    buffer->samples = 0;
+    buffer->overflowed = false;
+}
@@ -0,0 +1,127 @@
+/**
+ * @file pcm_cache.h
+ *
+ * Memory bounded LRU cache of resampled audio for short audio only game states,
+ * so looping menus can be replayed straight from memory without demuxing or decoding
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#ifndef PCM_CACHE_H
+#define PCM_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <game_states.h>
+
+/**
+ * @struct pcm_buffer
+ * @brief growable buffer of resampled S16 stereo audio, used to capture a section while it is decoded
+ */
+struct pcm_buffer {
+    uint8_t *data;            /**< captured audio, NULL until something is appended */
+    size_t size;              /**< bytes used */
+    size_t capacity;          /**< bytes allocated */
+    size_t limit;             /**< max bytes to capture, going over it abandons the capture */
+    uint32_t samples;         /**< amount of samples captured */
+    bool overflowed;          /**< true once the limit was hit or an allocation failed, the data is freed */
+};
+
+/**
+ * @struct pcm_cache_entry
+ * @brief cached audio of a single game state
+ */
+struct pcm_cache_entry {
+    uint8_t *data;            /**< resampled audio, NULL if the state isn't cached */
+    size_t size;              /**< size of data in bytes */
+    uint32_t samples;         /**< amount of samples in data */
+    uint64_t last_used;       /**< value of the cache clock when the entry was last used, for LRU eviction */
+};
+
+/**
+ * @struct pcm_cache
+ * @brief cache of resampled audio keyed by STATE_ID, only used from the decoder thread
+ */
+struct pcm_cache {
+    struct pcm_cache_entry entries[STATE_COUNT]; /**< one slot per game state */
+    size_t budget_bytes;      /**< max bytes held by all entries together */
+    size_t used_bytes;        /**< bytes currently held by all entries */
+    uint64_t clock;           /**< incremented on every use */
+
+    uint32_t hits;            /**< lookups that found the state */
+    uint32_t misses;          /**< lookups that didn't */
+};
+
+/**
+ * @brief creates an empty cache
+ *
+ * @param budget_bytes max amount of audio to hold, 0 disables caching
+ * @return pointer to the cache, or NULL on failure
+ */
+struct pcm_cache *create_pcm_cache(size_t budget_bytes);
+
+/**
+ * @brief looks a state up and counts the hit or miss
+ *
+ * @param cache cache to search
+ * @param state state to look up
+ * @return pointer to the entry, or NULL on a miss
+ */
+const struct pcm_cache_entry *pcm_cache_lookup(struct pcm_cache *cache, STATE_ID state);
+
+/**
+ * @brief checks if a state is cached without counting a hit or miss
+ *
+ * @param cache cache to search
+ * @param state state to look up
+ * @return true if the state is cached
+ */
+bool pcm_cache_contains(const struct pcm_cache *cache, STATE_ID state);
+
+/**
+ * @brief moves captured audio into the cache, evicting the least recently used states until it fits
+ * the buffer is emptied either way
+ *
+ * @param cache cache to insert into
+ * @param state state the audio belongs to
+ * @param buffer captured audio, ownership of its data is taken
+ * @return true if the audio was cached, false if it didn't fit in the budget
+ */
+bool pcm_cache_insert(struct pcm_cache *cache, STATE_ID state, struct pcm_buffer *buffer);
+
+/**
+ * @brief frees a cache and everything in it
+ *
+ * @param cache cache to destroy, can be NULL
+ */
+void destroy_pcm_cache(struct pcm_cache *cache);
+
+/**
+ * @brief appends audio to a capture buffer, growing it as needed
+ * abandons the capture if it goes over the buffer's limit
+ *
+ * @param buffer buffer to append to
+ * @param data audio to append
+ * @param size size of data in bytes
+ * @param samples amount of samples in data
+ */
+void pcm_buffer_append(struct pcm_buffer *buffer, const uint8_t *data, size_t size, uint32_t samples);
+
+/**
+ * @brief gives up on a capture that is missing audio, it is never cached and ignores appends until reset
+ *
+ * @param buffer buffer to abandon
+ */
+void pcm_buffer_abandon(struct pcm_buffer *buffer);
+
+/**
+ * @brief frees a capture buffer's data and resets it, keeping its limit
+ *
+ * @param buffer buffer to reset
+ */
+void pcm_buffer_reset(struct pcm_buffer *buffer);
+
+#endif //PCM_CACHE_H
@@ -0,0 +1,95 @@
+/**
+ * @file pipeline_stats.c
+ *
+ * helper functions for the pipeline_stats struct
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#include <SDL3/SDL.h>
+#include <stdint.h>
+
+#include <pipeline_stats.h>
+
+void reset_pipeline_stats(pipeline_stats *stats, const int state) {
+    SDL_SetAtomicInt(&stats->decoded_frames, 0);
+    SDL_SetAtomicInt(&stats->decode_us, 0);
+    SDL_SetAtomicInt(&stats->presented_frames, 0);
+    SDL_SetAtomicInt(&stats->dropped_frames, 0);
+    SDL_SetAtomicInt(&stats->upload_us, 0);
+
+    // startup counts as the change into the first state
+    SDL_SetAtomicInt(&stats->state, state);
+    SDL_SetAtomicU32(&stats->change_us, stats_clock_us());
+    SDL_SetAtomicU32(&stats->change_epoch, 0);
+
+    // nothing has been started or presented yet, no epoch is this far ahead
+    SDL_SetAtomicU32(&stats->section_latency_us, 0);
+    SDL_SetAtomicU32(&stats->section_epoch, UINT32_MAX);
+    SDL_SetAtomicInt(&stats->prefetch_frames, 0);
+    SDL_SetAtomicU32(&stats->prefetch_epoch, UINT32_MAX);
+    SDL_SetAtomicU32(&stats->present_latency_us, 0);
+    SDL_SetAtomicU32(&stats->present_epoch, UINT32_MAX);
+}
+
+uint32_t stats_clock_us(void) {
+    return (uint32_t)(SDL_GetTicksNS() / SDL_NS_PER_US);
+}
+
+void stats_state_changed(pipeline_stats *stats, const uint32_t epoch, const int state) {
+    SDL_SetAtomicInt(&stats->state, state);
+    SDL_SetAtomicU32(&stats->change_us, stats_clock_us());
+    SDL_SetAtomicU32(&stats->change_epoch, epoch);
+}
+
+/**
+ * @brief time since the state change into an epoch
+ *
+ * @param stats stats holding the last state change
+ * @param epoch epoch to measure for
+ * @return microseconds since its state change, 0 if it has already been changed away from
+ */
+static uint32_t since_state_change(pipeline_stats *stats, const uint32_t epoch) {
+    if (SDL_GetAtomicU32(&stats->change_epoch) != epoch) {
+        return 0;
+    }
+
+    // a change that lands between the two reads may already have replaced change_us
+    const uint32_t change_us = SDL_GetAtomicU32(&stats->change_us);
+    if (SDL_GetAtomicU32(&stats->change_epoch) != epoch) {
+        return 0;
+    }
+    return stats_clock_us() - change_us;
+}
+
+void stats_section_started(pipeline_stats *stats, const uint32_t epoch) {
+    if (SDL_GetAtomicU32(&stats->section_epoch) == epoch) return;
+
+    SDL_SetAtomicU32(&stats->section_latency_us, since_state_change(stats, epoch));
+    SDL_SetAtomicU32(&stats->section_epoch, epoch);
+}
+
+void stats_prefetch_committed(pipeline_stats *stats, const uint32_t epoch, const int frames) {
+    SDL_SetAtomicInt(&stats->prefetch_frames, frames);
+    SDL_SetAtomicU32(&stats->prefetch_epoch, epoch);
+}
+
+void stats_frames_decoded(pipeline_stats *stats, const int frames, const uint32_t decode_us) {
+    SDL_AddAtomicInt(&stats->decoded_frames, frames);
+    SDL_AddAtomicInt(&stats->decode_us, (int)decode_us);
+}
+
+void stats_frame_presented(pipeline_stats *stats, const uint32_t epoch, const uint32_t upload_us) {
+    SDL_AddAtomicInt(&stats->presented_frames, 1);
+    SDL_AddAtomicInt(&stats->upload_us, (int)upload_us);
+
+    if (SDL_GetAtomicU32(&stats->present_epoch) != epoch) {
+        SDL_SetAtomicU32(&stats->present_latency_us, since_state_change(stats, epoch));
+        SDL_SetAtomicU32(&stats->present_epoch, epoch);
+    }
+}
+
+void stats_frame_dropped(pipeline_stats *stats) {
+    SDL_AddAtomicInt(&stats->dropped_frames, 1);
+}
@@ -0,0 +1,108 @@
+/**
+ * @file pipeline_stats.h
+ *
+ * Counters the decoder, renderer and main thread publish about the playback pipeline,
+ * so it can be watched without touching any thread's own state. Every field is an atomic
+ * written by a single thread. Counters and times only grow and wrap, readers take the
+ * difference between two snapshots
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#ifndef PIPELINE_STATS_H
+#define PIPELINE_STATS_H
+
+#include <SDL3/SDL.h>
+#include <stdint.h>
+
+/**
+ * @struct pipeline_stats
+ * @brief running totals and the latencies of the last state change, times in stats_clock_us microseconds
+ */
+typedef struct pipeline_stats {
+    SDL_AtomicInt decoded_frames;      /**< video frames out of the decoder, written by the video decoder */
+    SDL_AtomicInt decode_us;           /**< time spent decoding them, written by the video decoder */
+    SDL_AtomicInt presented_frames;    /**< frames presented, written by the renderer */
+    SDL_AtomicInt dropped_frames;      /**< frames the renderer threw away as stale or too late, written by the renderer */
+    SDL_AtomicInt upload_us;           /**< time spent uploading frames, written by the renderer */
+
+    SDL_AtomicInt state;               /**< STATE_ID of the state being played, written by the main thread */
+    SDL_AtomicU32 change_epoch;        /**< epoch of the last state change, written by the main thread after change_us */
+    SDL_AtomicU32 change_us;           /**< when the last state change happened, written by the main thread */
+    SDL_AtomicU32 section_epoch;       /**< last epoch the decoder started a section for, written after section_latency_us */
+    SDL_AtomicU32 section_latency_us;  /**< from that epoch's state change to the decoder starting its section */
+    SDL_AtomicInt prefetch_frames;     /**< video frames that prefetch handed the renderer, written by the decoder before prefetch_epoch */
+    SDL_AtomicU32 prefetch_epoch;      /**< last epoch whose section started from a committed prefetch, written by the decoder */
+    SDL_AtomicU32 present_epoch;       /**< last epoch the renderer presented a frame of, written after present_latency_us */
+    SDL_AtomicU32 present_latency_us;  /**< from that epoch's state change to its first frame being presented */
+} pipeline_stats;
+
+/**
+ * @brief zeroes every counter and stamps the start of epoch 0 as its state change
+ *
+ * @param stats stats to reset, no thread may be writing them
+ * @param state STATE_ID the app starts in
+ */
+void reset_pipeline_stats(pipeline_stats *stats, int state);
+
+/**
+ * @brief the clock the stats are kept in, wraps every 71 minutes so only differences mean anything
+ *
+ * @return microseconds since SDL was initialized, truncated to 32 bits
+ */
+uint32_t stats_clock_us(void);
+
+/**
+ * @brief records a state change, call from the main thread before the new epoch is published
+ *
+ * @param stats stats to record into
+ * @param epoch epoch about to be published
+ * @param state STATE_ID being changed to
+ */
+void stats_state_changed(pipeline_stats *stats, uint32_t epoch, int state);
+
+/**
+ * @brief records the decoder starting a section, call from the decoder thread
+ *
+ * @param stats stats to record into
+ * @param epoch epoch the section is decoded for
+ */
+void stats_section_started(pipeline_stats *stats, uint32_t epoch);
+
+/**
+ * @brief records a section starting from the predicted state's pre-decoded buffers, call from the decoder thread
+ *
+ * @param stats stats to record into
+ * @param epoch epoch the section is decoded for
+ * @param frames video frames moved into the live queue
+ */
+void stats_prefetch_committed(pipeline_stats *stats, uint32_t epoch, int frames);
+
+/**
+ * @brief records decoded video frames, call from the video decoder thread
+ *
+ * @param stats stats to record into
+ * @param frames frames out of the decoder
+ * @param decode_us time it took
+ */
+void stats_frames_decoded(pipeline_stats *stats, int frames, uint32_t decode_us);
+
+/**
+ * @brief records a presented frame, the first of an epoch also stamps the latency since its state change.
+ * call from the renderer
+ *
+ * @param stats stats to record into
+ * @param epoch epoch the frame was decoded for
+ * @param upload_us time its upload took
+ */
+void stats_frame_presented(pipeline_stats *stats, uint32_t epoch, uint32_t upload_us);
+
+/**
+ * @brief records a frame the renderer threw away, call from the renderer
+ *
+ * @param stats stats to record into
+ */
+void stats_frame_dropped(pipeline_stats *stats);
+
+#endif //PIPELINE_STATS_H
@@ -3,6 +3,8 @@
  *
  * Main file for the decoder thread.
  * Handles opening files, decoding and adding frames to the queue.
+ * The decoder thread itself only demuxes, audio and video packets are decoded on their own threads
+ * fed through bounded packet queues so one stream backing up can't starve the other.
  *
  * @author Michael Metsker
  * @version 1.0
@@ -14,35 +16,124 @@
 #include <read_file.h>
 #include <decode.h>
 #include <frame_queue.h>
+#include <frame_pool.h>
 #include <game_states.h>
+#include <vob_index.h>
+#include <pcm_cache.h>
+#include <mmap_reader.h>
+#include <packet_queue.h>
+#include <thread_gate.h>
+#include <audio_clock.h>
+#include <pipeline_stats.h>
+#include <trace.h>
+#include <lock_profile.h>
 
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 #include <libavutil/channel_layout.h>
 #include <libavutil/samplefmt.h>
+#include <libavutil/mem.h>
 
 #define SAMPLE_RATE 48000 // audio sample rate
 
-#define VIDEO_STREAM_INDEX 1
+#define VIDEO_STREAM_INDEX 1 // streams of the game's vob, other files fall back to their best video and audio streams
 #define AUDIO_STREAM_INDEX 3
 
+#define PREFETCH_MS 300                        // how much of the predicted next state to pre-decode
+#define PREFETCH_MAX_FPS 60                    // fastest video the standby queue has room for PREFETCH_MS of
+#define PCM_MOVE_CHUNK_BYTES 16384             // chunk size when moving standby audio into the live stream
+#define DEFAULT_PCM_CACHE_BYTES (16 * 1024 * 1024) // about 87 seconds of 48kHz stereo audio
+#define WILLNEED_BYTES (1024 * 1024)           // how much of the predicted next state to ask the os to read ahead
+
+#define VIDEO_PACKET_CAP 1024                  // packets buffered for the video decoder, roughly a second of video
+#define AUDIO_PACKET_CAP 256                   // packets buffered for the audio decoder
+#define PUSH_TIMEOUT_MS 10                     // how often the demuxer rechecks the exit flag while a packet queue is full
+
+//format of the resampled audio, the standby stream neither converts nor plays it
+static const SDL_AudioSpec PCM_FORMAT = {
+    .freq = SAMPLE_RATE,
+    .format = SDL_AUDIO_S16LE,
+    .channels = 2,
+};
+
 static const char FILEPATH[] = "Z:/projects/airbud/VTS_03_0.VOB";
+static const char PCM_CACHE_BYTES_ENV[] = "AIRBUD_PCM_CACHE_BYTES"; // overrides the audio cache budget, 0 disables it
+static const char MMAP_INPUT_ENV[] = "AIRBUD_MMAP_INPUT";           // set to 0 to read through the ffmpeg file protocol
+static const char DECODER_THREADS_ENV[] = "AIRBUD_DECODER_THREADS"; // video decoder thread count, 0 or unset picks one per core
+static const char IVTC_ENV[] = "AIRBUD_IVTC";                       // set to 0 to queue telecined film as decoded
+static const char VOB_PATH_ENV[] = "AIRBUD_VOB_PATH";               // overrides FILEPATH, the benchmark points it at its fixture
+
+struct media_context;
+
+/**
+ * @struct decode_target
+ * @brief where a decoder thread sends its output, switched in-band with PACKET_FLUSH and PACKET_RETARGET
+ */
+struct decode_target {
+    frame_queue *video_queue;                  /**< queue to add video frames to */
+    SDL_AudioStream *audio_stream;             /**< stream to push resampled audio to */
+    SDL_AtomicU32 *audio_samples;              /**< count of samples pushed to audio_stream */
+    struct pcm_buffer *capture;                /**< buffer to also capture the audio into for the cache, NULL to skip */
+    int64_t start_pts;                         /**< video frames before this are dropped, AV_NOPTS_VALUE to keep all */
+    struct segment_tag tag;                    /**< segment the output belongs to, stale output is dropped */
+};
+
+/**
+ * @struct stream_worker
+ * @brief a decoder thread for a single stream and the queue of packets it decodes
+ */
+struct stream_worker {
+    packet_queue *queue;                       /**< packets and commands from the demuxer */
+    SDL_Semaphore *ack;                        /**< signaled after every PACKET_SYNC and PACKET_END */
+    SDL_Thread *thread;                        /**< the decoder thread */
+    AVPacket *packet;                          /**< packet entries are moved into for decoding */
+
+    const struct media_context *media_ctx;     /**< decodec information, each worker only uses its own stream's decoder */
+    SDL_AtomicInt *exit_flag;                  /**< set to -1 on a decoding error */
+};
 
 /**
  * @struct decoder_thread_args
  * @brief Parameters for the decoder thread.
  */
 struct decoder_thread_args {
-    SDL_AtomicInt *exit_flag;                  /**< 0, for continuing, 1 for soft exit decoding lool, -1 for hard exit */
+    SDL_AtomicInt *exit_flag;                  /**< 0, for continuing, -1 for hard exit */
+    SDL_AtomicU32 *epoch;                      /**< segment epoch being played, the current section is abandoned once it changes */
+    thread_gate *gate;                         /**< parks this thread until the main thread publishes new instructions */
+    audio_clock *clock;                        /**< advanced every time the audio device pulls from the audio stream */
 
     frame_queue *video_queue;                  /**< video queue to add frames to */
-    SDL_AtomicU32 *total_audio_samples;        /**< total ammount of samples added to the audio queue, used to sync renderer */
+    SDL_AtomicInt *deinterlace_kernel;         /**< kernel the video decoder deinterlaces with, switched from the main thread */
+    pipeline_stats *stats;                     /**< decode times and section starts are recorded here */
+    SDL_AtomicU32 *total_audio_samples;        /**< total amount of samples added to the audio queue, only counted */
     SDL_AudioStream *audio_stream;             /**< audio stream for sound playback */
 
-    SDL_Event request_instruction;             /**< event to trigger when decoding is finished with current instructions */
-    struct decoder_instructions *instructions; /**< what part of the file should be decoded, also handles swapping conds */
+    SDL_Event request_instruction;             /**< event to trigger when decoding is finished with current instructions, tagged with the epoch */
+    struct decoder_instructions *instructions; /**< what part of the file should be decoded, published by the main thread */
+    SDL_Mutex *instructions_mutex;             /**< held while the instructions are published or copied */
+    struct decoder_instructions section;       /**< copy of the instructions the current section is decoded with */
+    struct prefetch_buffers *prefetch;         /**< standby buffers for the predicted next state */
+
+    struct pcm_cache *pcm_cache;               /**< resampled audio of audio only states that have been played before */
+    struct pcm_buffer pcm_capture;             /**< audio of the current audio only state, captured for the cache */
+
+    struct stream_worker video_worker;         /**< thread decoding the video stream */
+    struct stream_worker audio_worker;         /**< thread decoding the audio stream */
+    struct decode_target live_target;          /**< decodes into the queues that are being played */
+    struct decode_target prefetch_target;      /**< decodes into the standby buffers of the predicted next state */
 };
 
+/**
+ * @brief audio stream callback, runs on the audio device thread every time it pulls data from the stream
+ * @param userdata the decoder_thread_args
+ */
+static void SDLCALL on_audio_pulled(void *userdata, SDL_AudioStream *stream, const int additional_amount, const int total_amount) {
+    const struct decoder_thread_args *args = userdata;
+
+    audio_clock_pulled(args->clock, additional_amount, total_amount);
+    wake_gate(args->gate);
+}
+
 bool create_decoder_thread(app_state *appstate) {
 
     SDL_SetAtomicInt(&appstate->stop_decoder_thread, 0);
@@ -54,39 +145,101 @@ bool create_decoder_thread(app_state *appstate) {
         return false;
     }
     //populates playback instructions
+    appstate->playback_instructions->state = (STATE_ID)(appstate->current_game_state - GAME_STATES);
     appstate->playback_instructions->start_offset_bytes = appstate->current_game_state->start_offset_bytes;
     appstate->playback_instructions->end_offset_bytes = appstate->current_game_state->end_offset_bytes;
     appstate->playback_instructions->audio_only = appstate->current_game_state->audio_only;
+    appstate->playback_instructions->predicted_next = appstate->current_game_state->predicted_next;
+    appstate->playback_instructions->epoch = SDL_GetAtomicU32(&appstate->segment_epoch);
+    appstate->instructions_mutex = SDL_CreateMutex();
+    if (!appstate->instructions_mutex) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't create playback instructions mutex\n");
+        return false;
+    }
 
-    appstate->playback_instructions->mutex = SDL_CreateMutex();
-    if (!appstate->playback_instructions->mutex) {
-        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't populate initial playback instructions\n");
+    // creates the standby buffers for pre-decoding the next state
+    struct prefetch_buffers *prefetch = malloc(sizeof(struct prefetch_buffers));
+    if (!prefetch) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't allocate prefetch buffers\n");
+        return false;
+    }
+    prefetch->state = NO_STATE;
+    prefetch->resume_offset_bytes = 0;
+    prefetch->start_pts = AV_NOPTS_VALUE;
+    SDL_SetAtomicU32(&prefetch->audio_samples, 0);
+    prefetch->video_queue = create_frame_queue(appstate->frame_pool, appstate->render_queue->budget_bytes);
+    prefetch->audio_stream = SDL_CreateAudioStream(&PCM_FORMAT, &PCM_FORMAT);
+    if (!prefetch->video_queue || !prefetch->audio_stream) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't create prefetch queues\n");
         return false;
     }
+    // nothing consumes the standby queue while it fills, a tuned depth would block the decoder part way through
+    pin_frame_queue_depth(prefetch->video_queue, PREFETCH_MS * PREFETCH_MAX_FPS / 1000);
 
     // creates and populates args
-    struct decoder_thread_args *args = malloc(sizeof(struct decoder_thread_args));
+    struct decoder_thread_args *args = calloc(1, sizeof(struct decoder_thread_args));
     if (!args) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't allocate args for decoder thread\n");
         return false;
     }
     args->audio_stream = appstate->audio_stream;
     args->exit_flag = &appstate->stop_decoder_thread;
+    args->epoch = &appstate->segment_epoch;
+    args->gate = appstate->decoder_gate;
+    args->clock = appstate->audio_clock;
     args->video_queue = appstate->render_queue;
+    args->deinterlace_kernel = &appstate->deinterlace_kernel;
+    args->stats = &appstate->stats;
     args->total_audio_samples = &appstate->total_audio_samples;
     args->instructions = appstate->playback_instructions;
+    args->instructions_mutex = appstate->instructions_mutex;
+    args->prefetch = prefetch;
 
-    //starts decoder thread
-    appstate->decoder_thread = SDL_CreateThread(play_file, "decoder", args);
-    if (!appstate->decoder_thread) {
-        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't allocate decoder thread\n");
+    // output targets for the decoder threads
+    args->live_target = (struct decode_target){
+        .video_queue = appstate->render_queue,
+        .audio_stream = appstate->audio_stream,
+        .audio_samples = &appstate->total_audio_samples,
+        .start_pts = AV_NOPTS_VALUE,
+        .tag = { .live_epoch = &appstate->segment_epoch },
+    };
+    args->prefetch_target = (struct decode_target){
+        .video_queue = prefetch->video_queue,
+        .audio_stream = prefetch->audio_stream,
+        .audio_samples = &prefetch->audio_samples,
+        .start_pts = AV_NOPTS_VALUE,
+    };
+
+    // creates the audio cache, the budget can be overridden from the environment
+    size_t pcm_cache_bytes = DEFAULT_PCM_CACHE_BYTES;
+    const char *pcm_cache_env = SDL_getenv(PCM_CACHE_BYTES_ENV);
+    if (pcm_cache_env) {
+        pcm_cache_bytes = (size_t)SDL_strtoull(pcm_cache_env, NULL, 10);
+    }
+    args->pcm_cache = create_pcm_cache(pcm_cache_bytes);
+    if (!args->pcm_cache) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't allocate audio cache\n");
         return false;
     }
+    args->pcm_capture = (struct pcm_buffer){ .limit = pcm_cache_bytes };
 
     //creates end decoding event
     SDL_zero(args->request_instruction);
     args->request_instruction.type = appstate->decoding_ended_event;
 
+    // advances the audio clock and wakes the decoder every time the audio device pulls from the stream
+    if (!SDL_SetAudioStreamGetCallback(appstate->audio_stream, on_audio_pulled, args)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't set audio stream callback %s\n", SDL_GetError());
+        return false;
+    }
+
+    //starts decoder thread
+    appstate->decoder_thread = SDL_CreateThread(play_file, "decoder", args);
+    if (!appstate->decoder_thread) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't allocate decoder thread\n");
+        return false;
+    }
+
     return true;
 }
 
@@ -99,13 +252,21 @@ bool create_decoder_thread(app_state *appstate) {
 struct media_context {
     AVFormatContext *format_context;         /**< information about the file being decoded */
     AVPacket        *packet;                 /**< packet of decoded data of any stream */
+    int              video_stream;           /**< index of the video stream that is played */
+    int              audio_stream;           /**< index of the audio stream that is played */
 
     AVCodecContext  *video_codec_ctx;        /**< decodec for decoding the video stream */
-    AVFrame         *video_frame;            /**< reused video frame, its data is copied to a queue */
+    AVFrame         *video_frame;            /**< reused video frame, its data is moved to a queue */
+    frame_pool      *frame_pool;             /**< pool the video decoder allocates its pictures from, owned by the appstate */
+    SDL_AtomicInt   *deinterlace_kernel;     /**< kernel the video decoder deinterlaces with, switched from the main thread */
+    pipeline_stats  *stats;                  /**< the video decoder records its decode times here */
 
     AVCodecContext  *audio_codec_ctx;        /**< decodec for decoding the audio stream */
     AVFrame         *audio_frame;            /**< reused audio frame, its data is copied to a queue */
     SwrContext      *resample_context;       /**< software resampler to make audio usable in SDL3 */
+
+    struct vob_index *vob_index;             /**< VOBU positions of the file, NULL to fall back to plain byte seeks */
+    struct mmap_reader *mmap_reader;         /**< memory mapped file the demuxer reads from, NULL when using the file protocol */
 };
 
 /**
@@ -120,6 +281,35 @@ static void destroy_media_context(struct media_context *ctx) {
     avcodec_free_context(&ctx->video_codec_ctx);
     avcodec_free_context(&ctx->audio_codec_ctx);
     avformat_close_input(&ctx->format_context);
+    close_mmap_reader(ctx->mmap_reader);
+    destroy_vob_index(ctx->vob_index);
+}
+
+/**
+ * @brief the file to play
+ *
+ * @return the path in VOB_PATH_ENV if it is set, FILEPATH otherwise
+ */
+static const char *vob_path(void) {
+    const char *path = SDL_getenv(VOB_PATH_ENV);
+    return path && *path ? path : FILEPATH;
+}
+
+/**
+ * @brief picks the stream of a type to play
+ *
+ * @param format_context opened file with its stream info found
+ * @param preferred index the stream has in the game's vob
+ * @param type type of stream wanted
+ * @return preferred if that stream is of the type, the file's best stream of the type otherwise, negative if it has none
+ */
+static int find_stream(AVFormatContext *format_context, const int preferred, const enum AVMediaType type) {
+    if ((unsigned int)preferred < format_context->nb_streams &&
+        format_context->streams[preferred]->codecpar->codec_type == type)
+    {
+        return preferred;
+    }
+    return av_find_best_stream(format_context, type, -1, -1, NULL, 0);
 }
 
 /**
@@ -128,12 +318,31 @@ static void destroy_media_context(struct media_context *ctx) {
  * //TODO hardcode decodecs
  *
  * @param media_ctx Pointer to the media context to initialize
+ * @param pool pool the video decoder allocates its pictures from
  * @return true on success, false on failure. On failure, no cleanup is performed.
  */
-static bool setup_file_context(struct media_context *media_ctx) {
+static bool setup_file_context(struct media_context *media_ctx, frame_pool *pool) {
+    const char *path = vob_path();
+
+    // maps the file and hands it to the demuxer through a custom io context, falls back to the file protocol on failure
+    const char *mmap_env = SDL_getenv(MMAP_INPUT_ENV);
+    if (!mmap_env || SDL_atoi(mmap_env) != 0) {
+        media_ctx->mmap_reader = open_mmap_reader(path);
+        if (media_ctx->mmap_reader) {
+            media_ctx->format_context = avformat_alloc_context();
+            if (!media_ctx->format_context) {
+                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't allocate format context");
+                return false;
+            }
+            media_ctx->format_context->pb = media_ctx->mmap_reader->io_context;
+            media_ctx->format_context->flags |= AVFMT_FLAG_CUSTOM_IO;
+        } else {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't map the file, falling back to buffered reads");
+        }
+    }
 
     // opens the file (only looks at header)
-    if (avformat_open_input(&media_ctx->format_context, FILEPATH, NULL, NULL) < 0) {
+    if (avformat_open_input(&media_ctx->format_context, path, NULL, NULL) < 0) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't open the file");
         return false;
     }
@@ -143,8 +352,15 @@ static bool setup_file_context(struct media_context *media_ctx) {
         return false;
     }
 
-    const AVCodecParameters *video_codec_par = media_ctx->format_context->streams[VIDEO_STREAM_INDEX]->codecpar;
-    const AVCodecParameters *audio_codec_par = media_ctx->format_context->streams[AUDIO_STREAM_INDEX]->codecpar;
+    media_ctx->video_stream = find_stream(media_ctx->format_context, VIDEO_STREAM_INDEX, AVMEDIA_TYPE_VIDEO);
+    media_ctx->audio_stream = find_stream(media_ctx->format_context, AUDIO_STREAM_INDEX, AVMEDIA_TYPE_AUDIO);
+    if (media_ctx->video_stream < 0 || media_ctx->audio_stream < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't find a video and an audio stream\n");
+        return false;
+    }
+
+    const AVCodecParameters *video_codec_par = media_ctx->format_context->streams[media_ctx->video_stream]->codecpar;
+    const AVCodecParameters *audio_codec_par = media_ctx->format_context->streams[media_ctx->audio_stream]->codecpar;
 
     //finds correct decodecs
     const AVCodec *video_codec = avcodec_find_decoder(video_codec_par->codec_id);
@@ -176,11 +392,24 @@ static bool setup_file_context(struct media_context *media_ctx) {
         return false;
     }
 
+    // lets the video decoder spread across cores, libavcodec picks whichever threading type the codec supports
+    const char *threads_env = SDL_getenv(DECODER_THREADS_ENV);
+    media_ctx->video_codec_ctx->thread_count = threads_env ? SDL_atoi(threads_env) : 0;
+    media_ctx->video_codec_ctx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+    media_ctx->video_codec_ctx->pkt_timebase = media_ctx->format_context->streams[media_ctx->video_stream]->time_base;
+
+    // decodes straight into pooled pictures, they travel through the frame queues without being copied
+    media_ctx->frame_pool = pool;
+    use_frame_pool(media_ctx->video_codec_ctx, pool);
+
     // Opens decoders
     if (avcodec_open2(media_ctx->video_codec_ctx, video_codec, NULL) < 0) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't open codec\n");
         return false;
     }
+    SDL_Log("video decoder using %d threads, %s threading\n", media_ctx->video_codec_ctx->thread_count,
+        media_ctx->video_codec_ctx->active_thread_type & FF_THREAD_FRAME ? "frame" :
+        media_ctx->video_codec_ctx->active_thread_type & FF_THREAD_SLICE ? "slice" : "no");
     if (avcodec_open2(media_ctx->audio_codec_ctx, audio_codec, NULL) < 0) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't open audio codec\n");
         return false;
@@ -218,12 +447,602 @@ static bool setup_file_context(struct media_context *media_ctx) {
         return false;
     }
 
+    // loads or builds the VOBU index, decoding still works without it so this isn't fatal
+    media_ctx->vob_index = load_vob_index(path);
+    if (!media_ctx->vob_index) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't load vob index, falling back to byte seeks\n");
+    }
+
     return true;
 }
 
 /**
- * @brief main decoding loop, segmented for easy early break
- * breaks on exit_flag 1 or -1 (for hard exit)
+ * @brief seeks to the start of a section of the file
+ * the start is snapped to the first VOBU of the section so decoding begins on a NAV pack with a known pts.
+ * the decoders aren't touched, send them a PACKET_FLUSH afterwards
+ *
+ * @param media_ctx file and decodec information
+ * @param start_offset_bytes requested start of the section
+ * @param end_offset_bytes end of the section
+ * @param current_offset_bytes set to the position that was seeked to
+ * @param start_pts set to the pts of the first frame of the section, AV_NOPTS_VALUE if unknown
+ * @return true on success, false otherwise
+ */
+static bool seek_to_section(const struct media_context *media_ctx, const uint32_t start_offset_bytes,
+                            const uint32_t end_offset_bytes, uint64_t *current_offset_bytes, int64_t *start_pts)
+{
+    *current_offset_bytes = start_offset_bytes;
+    *start_pts = AV_NOPTS_VALUE;
+    if (media_ctx->vob_index) {
+        const struct vobu_entry *vobu = find_vobu(media_ctx->vob_index, start_offset_bytes / DVD_SECTOR_SIZE);
+        if (vobu && (uint64_t)vobu->sector * DVD_SECTOR_SIZE < end_offset_bytes) {
+            *current_offset_bytes = (uint64_t)vobu->sector * DVD_SECTOR_SIZE;
+            *start_pts = vobu->start_pts;
+        }
+    }
+
+    //seeks to start of instructed sequence of bytes
+    if (av_seek_frame(media_ctx->format_context, -1, (int64_t)*current_offset_bytes, AVSEEK_FLAG_BYTE) < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't seek to the given byte offset\n");
+        return false;
+    }
+
+    if (media_ctx->mmap_reader) {
+        advise_mmap_range(media_ctx->mmap_reader, *current_offset_bytes, end_offset_bytes, true);
+    }
+    return true;
+}
+
+/**
+ * @brief tells the demuxer which streams are needed so the rest are skipped instead of read and thrown away
+ * subpicture and extra audio streams are never needed, video only when the section shows it
+ *
+ * @param media_ctx file and decodec information
+ * @param audio_only whether the section only needs audio
+ */
+static void select_streams(const struct media_context *media_ctx, const bool audio_only) {
+    for (unsigned int i = 0; i < media_ctx->format_context->nb_streams; i++) {
+        const bool needed = (int)i == media_ctx->audio_stream || ((int)i == media_ctx->video_stream && !audio_only);
+        media_ctx->format_context->streams[i]->discard = needed ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+    }
+}
+
+/**
+ * @brief moves the current position in the file past a packet
+ * uses the packet's own position when the demuxer knows it, so discarded packets and pack headers are accounted for
+ *
+ * @param packet packet that was just read
+ * @param current_offset_bytes position to update
+ */
+static void advance_offset(const AVPacket *packet, uint64_t *current_offset_bytes) {
+    if (packet->pos >= 0) {
+        *current_offset_bytes = (uint64_t)packet->pos + packet->size;
+    } else {
+        *current_offset_bytes += packet->size;
+    }
+}
+
+/**
+ * @brief reads the next packet of the file into the media context's packet
+ *
+ * @param media_ctx file and decodec information
+ * @return true if a packet was read, false at the end of the file or on error
+ */
+static bool read_packet(const struct media_context *media_ctx) {
+    TRACE_BEGIN(span);
+    const bool read = av_read_frame(media_ctx->format_context, media_ctx->packet) >= 0;
+    TRACE_END(span, "av_read_frame");
+    return read;
+}
+
+/**
+ * @brief whether the section being demuxed is still the one the main thread wants played
+ *
+ * @param args thread args passed through
+ * @return false once a new epoch has been published or on hard exit
+ */
+static bool section_is_live(const struct decoder_thread_args *args) {
+    return SDL_GetAtomicInt(args->exit_flag) == 0 && SDL_GetAtomicU32(args->epoch) == args->section.epoch;
+}
+
+/**
+ * @brief hands a packet or command to a decoder thread, waiting for room in its queue
+ * packets are given up on once the section is abandoned, commands always get through
+ *
+ * @param args thread args passed through
+ * @param worker decoder thread to send to
+ * @param command what the decoder should do
+ * @param packet packet to move into the queue for PACKET_DATA, NULL for commands
+ * @param target decode target for PACKET_FLUSH and PACKET_RETARGET, NULL otherwise
+ * @return true if it was queued, false if the section was abandoned first
+ */
+static bool send_packet(struct decoder_thread_args *args, struct stream_worker *worker, const enum packet_command command,
+                        AVPacket *packet, const struct decode_target *target)
+{
+    while (!push_packet(worker->queue, command, packet, target, PUSH_TIMEOUT_MS)) {
+        if (!section_is_live(args)) {
+            if (command == PACKET_DATA) {
+                return false;
+            }
+            // the section is being abandoned, makes room for the command
+            clear_packet_queue(worker->queue);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief sends a command to both decoder threads and waits until both have acknowledged it
+ *
+ * @param args thread args passed through
+ * @param command PACKET_SYNC or PACKET_END
+ */
+static void sync_workers(struct decoder_thread_args *args, const enum packet_command command) {
+    send_packet(args, &args->video_worker, command, NULL, NULL);
+    send_packet(args, &args->audio_worker, command, NULL, NULL);
+
+    SDL_WaitSemaphore(args->video_worker.ack);
+    SDL_WaitSemaphore(args->audio_worker.ack);
+}
+
+/**
+ * @brief drops everything still queued for the decoder threads and waits for them to go idle
+ * after this neither thread touches the live or standby buffers until it is sent more packets
+ *
+ * @param args thread args passed through
+ */
+static void idle_workers(struct decoder_thread_args *args) {
+    clear_packet_queue(args->video_worker.queue);
+    clear_packet_queue(args->audio_worker.queue);
+    sync_workers(args, PACKET_SYNC);
+}
+
+/**
+ * @brief sends the same flush or retarget command to both decoder threads
+ *
+ * @param args thread args passed through
+ * @param command PACKET_FLUSH or PACKET_RETARGET
+ * @param target where both decoders should send their output
+ */
+static void retarget_workers(struct decoder_thread_args *args, const enum packet_command command,
+                             const struct decode_target *target)
+{
+    send_packet(args, &args->video_worker, command, NULL, target);
+    send_packet(args, &args->audio_worker, command, NULL, target);
+}
+
+/**
+ * @brief video decoder thread, decodes packets from its queue into the current target's frame queue
+ * logs decode timings for every section when it is told the section ended
+ *
+ * @param data pointer to the stream_worker
+ * @return 0 on shutdown
+ */
+static int decode_video_stream(void *data) {
+    struct stream_worker *worker = data;
+    const struct media_context *media_ctx = worker->media_ctx;
+    const struct decode_target *target = NULL;
+    TRACE_THREAD("video decoder");
+    LOCK_PROFILE_THREAD("video decoder");
+
+    // any stage that couldn't be allocated is skipped, see struct video_filters
+    const char *ivtc_env = SDL_getenv(IVTC_ENV);
+    const struct video_filters filters = {
+        .ivtc = !ivtc_env || SDL_atoi(ivtc_env) != 0 ? create_telecine_filter(media_ctx->frame_pool) : NULL,
+        .deint = create_deinterlacer(media_ctx->frame_pool, media_ctx->deinterlace_kernel),
+        .tracker = create_damage_tracker(),
+    };
+
+    // decode timings for the section, logged once it has been fully decoded
+    Uint64 section_start_ns = SDL_GetTicksNS();
+    int64_t start_frame_num = 0;
+    Uint64 video_decode_ns = 0;
+    Uint64 first_frame_ns = 0;
+    int start_allocations = 0;
+
+    while (true) {
+        const void *entry_target;
+        const enum packet_command command = pop_packet(worker->queue, worker->packet, &entry_target);
+
+        switch (command) {
+            case PACKET_DATA: {
+                if (target && target->video_queue && SDL_GetAtomicInt(worker->exit_flag) != -1) {
+                    const Uint64 decode_start_ns = SDL_GetTicksNS();
+                    const int64_t frame_num = media_ctx->video_codec_ctx->frame_num;
+                    if (!decode_video(media_ctx->video_codec_ctx, worker->packet, media_ctx->video_frame,
+                        target->video_queue, target->start_pts, &target->tag, &filters))
+                    {
+                        SDL_SetAtomicInt(worker->exit_flag, -1);
+                    }
+                    TRACE_END(decode_start_ns, "decode_video");
+                    const Uint64 packet_ns = SDL_GetTicksNS() - decode_start_ns;
+                    video_decode_ns += packet_ns;
+                    stats_frames_decoded(media_ctx->stats, (int)(media_ctx->video_codec_ctx->frame_num - frame_num),
+                        (uint32_t)(packet_ns / SDL_NS_PER_US));
+
+                    if (!first_frame_ns && media_ctx->video_codec_ctx->frame_num != start_frame_num) {
+                        first_frame_ns = SDL_GetTicksNS() - section_start_ns;
+                    }
+                }
+                av_packet_unref(worker->packet);
+                break;
+            }
+            case PACKET_FLUSH:
+                avcodec_flush_buffers(media_ctx->video_codec_ctx);
+
+                // frames after a seek don't follow on from the ones before it
+                if (filters.ivtc) {
+                    reset_telecine_filter(filters.ivtc);
+                }
+                if (filters.deint) {
+                    reset_deinterlacer(filters.deint);
+                }
+                if (filters.tracker) {
+                    reset_damage_tracker(filters.tracker);
+                }
+
+                section_start_ns = SDL_GetTicksNS();
+                start_frame_num = media_ctx->video_codec_ctx->frame_num;
+                video_decode_ns = 0;
+                first_frame_ns = 0;
+                start_allocations = frame_pool_allocations(media_ctx->frame_pool);
+                target = entry_target;
+                break;
+
+            case PACKET_RETARGET:
+                target = entry_target;
+                break;
+
+            case PACKET_END:
+                if (target && target->video_queue && SDL_GetAtomicInt(worker->exit_flag) != -1) {
+                    // drains frames still held back by frame threading, they'd be lost at the next flush otherwise
+                    const Uint64 drain_start_ns = SDL_GetTicksNS();
+                    if (!decode_video(media_ctx->video_codec_ctx, NULL, media_ctx->video_frame, target->video_queue,
+                        target->start_pts, &target->tag, &filters))
+                    {
+                        SDL_SetAtomicInt(worker->exit_flag, -1);
+                    }
+                    TRACE_END(drain_start_ns, "decode_video drain");
+                    video_decode_ns += SDL_GetTicksNS() - drain_start_ns;
+
+                    const int64_t frames = media_ctx->video_codec_ctx->frame_num - start_frame_num;
+                    if (frames > 0) {
+                        SDL_Log("decoded %" PRId64 " frames at %.1f fps, first frame after %.2f ms\n", frames,
+                            video_decode_ns ? (double)frames * SDL_NS_PER_SECOND / (double)video_decode_ns : 0.0,
+                            (double)first_frame_ns / SDL_NS_PER_MS);
+
+                        // should drop to zero once the pool has warmed up
+                        const Uint64 section_ns = SDL_GetTicksNS() - section_start_ns;
+                        const int allocations = frame_pool_allocations(media_ctx->frame_pool) - start_allocations;
+                        SDL_Log("frame pool made %d allocations, %.1f per second\n", allocations,
+                            section_ns ? (double)allocations * SDL_NS_PER_SECOND / (double)section_ns : 0.0);
+                        SDL_Log("video queue depth %d frames, high water %d frames, %" PRIu32 " late frames skipped\n",
+                            frame_queue_depth(target->video_queue), frame_queue_high_water(target->video_queue),
+                            target->video_queue->late_frames);
+                        if (filters.ivtc) {
+                            log_telecine(filters.ivtc);
+                        }
+                        if (filters.deint) {
+                            log_deinterlacing(filters.deint);
+                        }
+                    }
+                }
+                SDL_SignalSemaphore(worker->ack);
+                break;
+
+            case PACKET_SYNC:
+                SDL_SignalSemaphore(worker->ack);
+                break;
+
+            case PACKET_QUIT:
+                destroy_telecine_filter(filters.ivtc);
+                destroy_deinterlacer(filters.deint);
+                destroy_damage_tracker(filters.tracker);
+                return 0;
+        }
+    }
+}
+
+/**
+ * @brief audio decoder thread, decodes packets from its queue into the current target's audio stream
+ *
+ * @param data pointer to the stream_worker
+ * @return 0 on shutdown
+ */
+static int decode_audio_stream(void *data) {
+    struct stream_worker *worker = data;
+    const struct media_context *media_ctx = worker->media_ctx;
+    const struct decode_target *target = NULL;
+    TRACE_THREAD("audio decoder");
+    LOCK_PROFILE_THREAD("audio decoder");
+
+    // resampler output, reused for every frame this thread decodes
+    struct pcm_scratch scratch = {0};
+
+    while (true) {
+        const void *entry_target;
+        const enum packet_command command = pop_packet(worker->queue, worker->packet, &entry_target);
+
+        switch (command) {
+            case PACKET_DATA: {
+                TRACE_BEGIN(span);
+                if (target && SDL_GetAtomicInt(worker->exit_flag) != -1 &&
+                    !decode_audio(media_ctx->audio_codec_ctx, worker->packet, media_ctx->audio_frame,
+                        media_ctx->resample_context, &scratch, target->audio_stream, target->audio_samples,
+                        target->capture, &target->tag))
+                {
+                    SDL_SetAtomicInt(worker->exit_flag, -1);
+                }
+                TRACE_END(span, "decode_audio");
+                av_packet_unref(worker->packet);
+                break;
+            }
+
+            case PACKET_FLUSH:
+                avcodec_flush_buffers(media_ctx->audio_codec_ctx);
+                target = entry_target;
+                break;
+
+            case PACKET_RETARGET:
+                target = entry_target;
+                break;
+
+            case PACKET_END:
+            case PACKET_SYNC:
+                // ac3 has no decoder delay, nothing to drain
+                SDL_SignalSemaphore(worker->ack);
+                break;
+
+            case PACKET_QUIT:
+                av_freep(&scratch.data);
+                return 0;
+        }
+    }
+}
+
+/**
+ * @brief creates a decoder thread along with its packet queue
+ *
+ * @param worker worker to populate
+ * @param name name of the thread
+ * @param function decode_video_stream or decode_audio_stream
+ * @param capacity max amount of packets to buffer for the thread
+ * @param media_ctx file and decodec information
+ * @param exit_flag flag to set to -1 on a decoding error
+ * @return true on success, false otherwise
+ */
+static bool start_stream_worker(struct stream_worker *worker, const char *name, const SDL_ThreadFunction function,
+                                const int capacity, const struct media_context *media_ctx, SDL_AtomicInt *exit_flag)
+{
+    worker->media_ctx = media_ctx;
+    worker->exit_flag = exit_flag;
+
+    worker->queue = create_packet_queue(capacity);
+    worker->ack = SDL_CreateSemaphore(0);
+    worker->packet = av_packet_alloc();
+    if (!worker->queue || !worker->ack || !worker->packet) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't allocate %s queue\n", name);
+        return false;
+    }
+
+    worker->thread = SDL_CreateThread(function, name, worker);
+    if (!worker->thread) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't create %s thread\n", name);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief stops a decoder thread and frees its queue
+ *
+ * @param worker worker to stop, can be partially started
+ */
+static void stop_stream_worker(struct stream_worker *worker) {
+    if (worker->thread) {
+        clear_packet_queue(worker->queue);
+        while (!push_packet(worker->queue, PACKET_QUIT, NULL, NULL, PUSH_TIMEOUT_MS)) {}
+        SDL_WaitThread(worker->thread, NULL);
+        worker->thread = NULL;
+    }
+    destroy_packet_queue(worker->queue);
+    SDL_DestroySemaphore(worker->ack);
+    av_packet_free(&worker->packet);
+}
+
+/**
+ * @brief decodes the start of the predicted next state into the standby buffers
+ * runs once the current section has been fully decoded, while its audio is still playing.
+ * the demuxer is left right after the pre-decoded packets so a committed prefetch can carry on from there
+ *
+ * @param args thread args passed through
+ * @param media_ctx file and decodec information
+ * @return true on success or if there was nothing to prefetch, false on error
+ */
+static bool prefetch_next_state(struct decoder_thread_args *args, const struct media_context *media_ctx) {
+    struct prefetch_buffers *prefetch = args->prefetch;
+    const STATE_ID next = args->section.predicted_next;
+
+    // throws away anything left from an earlier prediction, both decoders are idle at this point
+    prefetch->state = NO_STATE;
+    clear_frame_queue(prefetch->video_queue);
+    SDL_ClearAudioStream(prefetch->audio_stream);
+    SDL_SetAtomicU32(&prefetch->audio_samples, 0);
+
+    if (next == NO_STATE) {
+        return true;
+    }
+    const struct game_state *state = &GAME_STATES[next];
+
+    // cached audio only states start instantly anyway
+    if (state->audio_only && pcm_cache_contains(args->pcm_cache, next)) {
+        return true;
+    }
+
+    uint64_t offset_bytes;
+    if (!seek_to_section(media_ctx, state->start_offset_bytes, state->end_offset_bytes, &offset_bytes, &prefetch->start_pts)) {
+        return false;
+    }
+    args->prefetch_target.start_pts = prefetch->start_pts;
+    retarget_workers(args, PACKET_FLUSH, &args->prefetch_target);
+    select_streams(media_ctx, state->audio_only);
+
+    // measures how much has been demuxed on the stream the state is shown with
+    const int measured_stream = state->audio_only ? media_ctx->audio_stream : media_ctx->video_stream;
+    const AVRational time_base = media_ctx->format_context->streams[measured_stream]->time_base;
+    int64_t first_pts = AV_NOPTS_VALUE;
+    // each video packet decodes to at most one frame, stopping at the depth means the decoder never waits for room
+    int video_packets = 0;
+
+    while (section_is_live(args) && read_packet(media_ctx)) {
+
+        advance_offset(media_ctx->packet, &offset_bytes);
+        if (offset_bytes > state->end_offset_bytes) {
+            // the whole state is shorter than the prefetch, not worth special casing
+            av_packet_unref(media_ctx->packet);
+            return true;
+        }
+
+        const int stream_index = media_ctx->packet->stream_index;
+        const int64_t pts = media_ctx->packet->pts;
+
+        bool sent = true;
+        if (stream_index == media_ctx->audio_stream) {
+            sent = send_packet(args, &args->audio_worker, PACKET_DATA, media_ctx->packet, NULL);
+        } else if (stream_index == media_ctx->video_stream && !state->audio_only) {
+            sent = send_packet(args, &args->video_worker, PACKET_DATA, media_ctx->packet, NULL);
+            video_packets++;
+        }
+        av_packet_unref(media_ctx->packet);
+        if (!sent) {
+            return true;
+        }
+
+        // stops once enough has been demuxed to cover the transition, or the standby queue would be full
+        bool covered = video_packets >= frame_queue_depth(prefetch->video_queue);
+        if (stream_index == measured_stream && pts != AV_NOPTS_VALUE) {
+            if (first_pts == AV_NOPTS_VALUE) {
+                first_pts = pts;
+            } else if (av_rescale_q(pts - first_pts, time_base, (AVRational){ 1, 1000 }) >= PREFETCH_MS) {
+                covered = true;
+            }
+        }
+        if (covered) {
+            // waits for the decoders to finish what has been sent so the standby buffers are complete
+            sync_workers(args, PACKET_SYNC);
+            prefetch->resume_offset_bytes = offset_bytes;
+            prefetch->state = next;
+            return true;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief swaps the pre-decoded start of the section into the live buffers if it was predicted correctly,
+ * otherwise throws the standby buffers away. the moved audio is also captured if the live target captures.
+ * only call while both decoder threads are idle
+ *
+ * @param args thread args passed through
+ * @return true if the prefetched data was used, false if it was discarded
+ */
+static bool commit_prefetch(struct decoder_thread_args *args) {
+    struct prefetch_buffers *prefetch = args->prefetch;
+
+    if (prefetch->state != args->section.state) {
+        // wrong or no prediction, the buffers are cleared the next time something is prefetched
+        prefetch->state = NO_STATE;
+        return false;
+    }
+    prefetch->state = NO_STATE;
+
+    // this thread stands in as the live queue's producer while the video decoder is idle
+    const int moved_frames = move_frame_queue(args->video_queue, prefetch->video_queue, args->section.epoch);
+
+    // moves the standby audio into the live stream, unless the main thread has already moved on
+    SDL_LockAudioStream(args->audio_stream);
+    if (segment_is_live(&args->live_target.tag)) {
+        Uint8 pcm[PCM_MOVE_CHUNK_BYTES];
+        int read_bytes;
+        while ((read_bytes = SDL_GetAudioStreamData(prefetch->audio_stream, pcm, sizeof(pcm))) > 0) {
+            if (!SDL_PutAudioStreamData(args->audio_stream, pcm, read_bytes)) {
+                SDL_UnlockAudioStream(args->audio_stream);
+                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't move prefetched audio %s", SDL_GetError());
+                return false;
+            }
+            // the capture of an audio only section starts with the prefetched audio, the decoder appends the rest
+            if (args->live_target.capture) {
+                pcm_buffer_append(args->live_target.capture, pcm, (size_t)read_bytes,
+                    (uint32_t)(read_bytes / SDL_AUDIO_FRAMESIZE(PCM_FORMAT)));
+            }
+        }
+        add_audio_samples(args->total_audio_samples, SDL_GetAtomicU32(&prefetch->audio_samples));
+    }
+    SDL_UnlockAudioStream(args->audio_stream);
+
+    stats_prefetch_committed(args->stats, args->section.epoch, moved_frames);
+    return true;
+}
+
+/**
+ * @brief waits for the audio of the current section to finish playing, then asks the main thread for new instructions
+ *
+ * @param args thread args passed through
+ * @return true, returns early without requesting instructions if the section is abandoned
+ */
+static bool finish_section(struct decoder_thread_args *args) {
+
+    // waits for audio queue to empty, woken by the audio device every time it pulls from the stream
+    while (true) {
+        const uint32_t wakeups = gate_wakeups(args->gate);
+
+        if (!section_is_live(args)) {
+            return true;
+        }
+        if (SDL_GetAudioStreamAvailable(args->audio_stream) == 0) {
+            break;
+        }
+        wait_gate(args->gate, wakeups);
+    }
+
+    // potentially could cause issues if there is a video frame as the last packet, but it never seems to be the case
+    // the main thread ignores it if it has published another epoch since
+    args->request_instruction.user.code = (Sint32)args->section.epoch;
+    SDL_PushEvent(&args->request_instruction);
+    return true;
+}
+
+/**
+ * @brief plays an audio only section straight from the audio cache, no demuxing or decoding needed
+ *
+ * @param args thread args passed through
+ * @param media_ctx file and decodec information, used to prefetch the next state
+ * @param entry cached audio of the section
+ * @return true on clean exit, false otherwise
+ */
+static bool play_cached_section(struct decoder_thread_args *args, const struct media_context *media_ctx,
+                                const struct pcm_cache_entry *entry)
+{
+    SDL_LockAudioStream(args->audio_stream);
+    if (segment_is_live(&args->live_target.tag)) {
+        if (!SDL_PutAudioStreamData(args->audio_stream, entry->data, (int)entry->size)) {
+            SDL_UnlockAudioStream(args->audio_stream);
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't push cached audio to audio stream %s", SDL_GetError());
+            return false;
+        }
+        add_audio_samples(args->total_audio_samples, entry->samples);
+    }
+    SDL_UnlockAudioStream(args->audio_stream);
+
+    if (!prefetch_next_state(args, media_ctx)) {
+        return false;
+    }
+    return finish_section(args);
+}
+
+/**
+ * @brief main demuxing loop, hands packets to the decoder threads, segmented for easy early break
+ * breaks once a new epoch is published or on hard exit
  *
  * TODO check if end of file?
  *
@@ -232,52 +1051,60 @@ static bool setup_file_context(struct media_context *media_ctx) {
  * @param current_offset_bytes current position of the packet in the file
  * @return true on clean exit, false otherwise
  */
-static bool decode_loop(struct decoder_thread_args *args, const struct media_context *media_ctx, uint64_t *current_offset_bytes)  {
+static bool decode_loop(struct decoder_thread_args *args, const struct media_context *media_ctx, uint64_t *current_offset_bytes) {
+
+    // skips the video payload entirely for audio only sections
+    select_streams(media_ctx, args->section.audio_only);
+
+    // demux stats for the section, logged once it has been fully read
+    const Uint64 section_start_ns = SDL_GetTicksNS();
+    const int64_t section_start_bytes = avio_tell(media_ctx->format_context->pb);
 
     // while there is unparsed data left in the file
-    while (!SDL_GetAtomicInt(args->exit_flag) && av_read_frame(media_ctx->format_context, media_ctx->packet) >= 0) {
+    while (section_is_live(args) && read_packet(media_ctx)) {
 
         // increment the current offset
-        *current_offset_bytes += media_ctx->packet->size;
-        if (*current_offset_bytes > args->instructions->end_offset_bytes) {
+        advance_offset(media_ctx->packet, current_offset_bytes);
+        if (*current_offset_bytes > args->section.end_offset_bytes) {
             //the end of the section to decode has been reached
 
-            SDL_Log("end of section decoded \n");
+            SDL_Log("end of section decoded, read %" PRId64 " bytes in %.2f ms\n",
+                avio_tell(media_ctx->format_context->pb) - section_start_bytes,
+                (double)(SDL_GetTicksNS() - section_start_ns) / SDL_NS_PER_MS);
+            av_packet_unref(media_ctx->packet);
 
-            // waits for audio queue to empty
-            while (SDL_GetAudioStreamAvailable(args->audio_stream) > 0 ) {
+            // lets both decoders catch up, the video decoder also drains what frame threading held back
+            sync_workers(args, PACKET_END);
 
-                if (SDL_GetAtomicInt(args->exit_flag) != 0) {
-                    return true;
+            // the whole section was captured, keep it for the next time it plays.
+            // if a new epoch came in while the audio drained the capture is missing its end
+            if (args->live_target.capture) {
+                if (section_is_live(args)) {
+                    pcm_cache_insert(args->pcm_cache, args->section.state, args->live_target.capture);
+                } else {
+                    pcm_buffer_reset(args->live_target.capture);
                 }
-                SDL_Delay(1);
             }
 
-            // potentially could cause issues if there is a video frame as the last packet, but it never seems to be the case
-            SDL_PushEvent(&args->request_instruction);
-
-            SDL_SetAtomicInt(args->exit_flag, 1);
-            return true;
+            // uses the time the last of the audio takes to play to get a head start on the next state
+            if (!prefetch_next_state(args, media_ctx)) {
+                return false;
+            }
+            return finish_section(args);
         }
 
-        if (media_ctx->packet->stream_index == AUDIO_STREAM_INDEX) {
-            // if packet is in the audio stream, decode it
+        if (media_ctx->packet->stream_index == media_ctx->audio_stream) {
+            // if packet is in the audio stream, hand it to the audio decoder
 
-            if (!decode_audio(media_ctx->audio_codec_ctx, media_ctx->packet, media_ctx->audio_frame, media_ctx->resample_context,
-                args->audio_stream, args->total_audio_samples))
-            {
-                return false;
+            if (!send_packet(args, &args->audio_worker, PACKET_DATA, media_ctx->packet, NULL)) {
+                return true;
             }
 
-        } else if (media_ctx->packet->stream_index == VIDEO_STREAM_INDEX) {
-            // packet is in video stream, decode it
+        } else if (media_ctx->packet->stream_index == media_ctx->video_stream && !args->section.audio_only) {
+            // packet is in video stream, hand it to the video decoder
 
-            if (args->instructions->audio_only) {
-                av_packet_unref(media_ctx->packet);
-            } else {
-                if (!decode_video(media_ctx->video_codec_ctx, media_ctx->packet, media_ctx->video_frame, args->video_queue)) {
-                    return false;
-                }
+            if (!send_packet(args, &args->video_worker, PACKET_DATA, media_ctx->packet, NULL)) {
+                return true;
             }
         }
         av_packet_unref(media_ctx->packet);
@@ -287,49 +1114,111 @@ static bool decode_loop(struct decoder_thread_args *args, const struct media_con
 
 int play_file(void *data) {
     struct decoder_thread_args *args = data;
+    TRACE_THREAD("demuxer");
+    LOCK_PROFILE_THREAD("demuxer");
 
     // Sets up media context struct
     struct media_context media_ctx = {0};
-    if (!setup_file_context(&media_ctx)) {
+    if (!setup_file_context(&media_ctx, args->video_queue->pool)) {
         destroy_media_context(&media_ctx);
         //FIXME free args and cleanup?
         return -1;
     }
+    media_ctx.deinterlace_kernel = args->deinterlace_kernel;
+    media_ctx.stats = args->stats;
+
+    // starts the decoder threads, this thread only demuxes from here on
+    if (!start_stream_worker(&args->video_worker, "video decoder", decode_video_stream, VIDEO_PACKET_CAP, &media_ctx, args->exit_flag) ||
+        !start_stream_worker(&args->audio_worker, "audio decoder", decode_audio_stream, AUDIO_PACKET_CAP, &media_ctx, args->exit_flag))
+    {
+        stop_stream_worker(&args->video_worker);
+        stop_stream_worker(&args->audio_worker);
+        destroy_media_context(&media_ctx);
+        return -1;
+    }
+
+    uint32_t generation = 0;
 
-    //plays a section of the file specified by instructions, setting exit flag to one exits out
-    while (SDL_GetAtomicInt(args->exit_flag) != -1 ) {
+    // plays the section the main thread last published, publishing a new epoch abandons it straight away
+    do {
 
         //TODO check validity of instructions
 
-        //resets exit flag
-        SDL_SetAtomicInt(args->exit_flag, 0);
-        //keeps main thread from changing gamestate while decoding
-        SDL_LockMutex(args->instructions->mutex);
+        // copies the instructions, the main thread may already be publishing the next ones
+        LOCK_MUTEX(args->instructions_mutex, LOCK_INSTRUCTIONS);
+        args->section = *args->instructions;
+        UNLOCK_MUTEX(args->instructions_mutex, LOCK_INSTRUCTIONS);
+        stats_section_started(args->stats, args->section.epoch);
 
-        //seeks to start of instructed sequence of bytes
-        if (av_seek_frame(media_ctx.format_context, -1, args->instructions->start_offset_bytes, AVSEEK_FLAG_BYTE) < 0) {
-            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't seek to the given byte offset\n");
-            break;
+        uint64_t current_offset_bytes = 0;
+        const struct pcm_cache_entry *cached = NULL;
+        args->live_target.tag.epoch = args->section.epoch;
+        args->live_target.capture = NULL;
+
+        // the time waiting for these instructions isn't a decode stall
+        restart_frame_queue(args->video_queue);
+
+        // audio only sections are replayed from the cache when possible, otherwise captured into it,
+        // including whatever part of them was prefetched
+        if (args->section.audio_only) {
+            cached = pcm_cache_lookup(args->pcm_cache, args->section.state);
+            if (!cached) {
+                pcm_buffer_reset(&args->pcm_capture);
+                args->live_target.capture = &args->pcm_capture;
+            }
         }
-        uint64_t current_offset_bytes = args->instructions->start_offset_bytes;
 
-        avcodec_flush_buffers(media_ctx.audio_codec_ctx);
-        avcodec_flush_buffers(media_ctx.video_codec_ctx);
+        if (cached) {
+            // nothing is demuxed, a prefetch of some other state is thrown away
+            args->prefetch->state = NO_STATE;
+
+        } else if (commit_prefetch(args)) {
+            // the start of this section is already queued, carry on from where the prefetch stopped
+            current_offset_bytes = args->prefetch->resume_offset_bytes;
 
-        if (!decode_loop(args, &media_ctx, &current_offset_bytes)) {
+            args->live_target.start_pts = args->prefetch->start_pts;
+            retarget_workers(args, PACKET_RETARGET, &args->live_target);
+
+        } else {
+            if (!seek_to_section(&media_ctx, args->section.start_offset_bytes,
+                args->section.end_offset_bytes, &current_offset_bytes, &args->live_target.start_pts))
+            {
+                break;
+            }
+            retarget_workers(args, PACKET_FLUSH, &args->live_target);
+        }
+
+        // starts reading in the predicted next state while this one plays
+        if (media_ctx.mmap_reader && args->section.predicted_next != NO_STATE) {
+            const uint32_t next_start = GAME_STATES[args->section.predicted_next].start_offset_bytes;
+            advise_mmap_range(media_ctx.mmap_reader, next_start, next_start + WILLNEED_BYTES, false);
+        }
+
+        bool ok;
+        if (cached) {
+            ok = play_cached_section(args, &media_ctx, cached);
+        } else {
+            ok = decode_loop(args, &media_ctx, &current_offset_bytes);
+        }
+
+        // neither decoder may touch the live target again until the next section retargets them
+        idle_workers(args);
+        if (!ok) {
+            SDL_SetAtomicInt(args->exit_flag, -1);
             break;
         }
 
-        // this lifts the mutex lock so the main thread can change the values;
-        SDL_UnlockMutex(args->instructions->mutex);
-        //TODO potentiallu make this a signal instead of an arbitrary wait time? (main thread would need to grab mutex first pottentially
-        SDL_Delay(4); // gives time for main thread to grab mutex
-    }
+        // parks until the main thread publishes new instructions, straight through if it already has
+    } while (park_thread(args->gate, &generation));
 
     // there is no new instructions or there was an error
     // either way clean up
     // TODO is decoder args getting cleaned up?
 
+    stop_stream_worker(&args->video_worker);
+    stop_stream_worker(&args->audio_worker);
     destroy_media_context(&media_ctx);
+    destroy_pcm_cache(args->pcm_cache);
+    pcm_buffer_reset(&args->pcm_capture);
     return 0;
-}
\ No newline at end of file
+}
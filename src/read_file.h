@@ -12,21 +12,40 @@
 #define READ_FILE_H
 
 #include <init.h>
+#include <game_states.h>
 #include <stdbool.h>
 #include <stdint.h>
 
+/**
+ * @struct prefetch_buffers
+ * @brief standby buffers holding the start of the predicted next state, decoded while the current state finishes playing.
+ * only ever touched by the decoder thread, it commits them itself when the predicted state gets published
+ */
+struct prefetch_buffers {
+    STATE_ID state;                         /**< state held in the buffers, NO_STATE if they are empty or stale */
+    uint64_t resume_offset_bytes;           /**< position in the file right after the pre-decoded packets */
+    int64_t start_pts;                      /**< pts of the first frame of the pre-decoded state */
+
+    frame_queue *video_queue;               /**< standby video frames */
+    SDL_AudioStream *audio_stream;          /**< standby resampled audio, not bound to a device */
+    SDL_AtomicU32 audio_samples;            /**< amount of samples in the standby audio stream */
+};
+
 /**
  * @struct decoder_instructions
- * @brief contains mutex controlled variables that change when the gamestate us updated.
- * these are subsets of the game_state struct and should only be changed from the main thread when changing gamestate
+ * @brief contains variables that change when the gamestate us updated.
+ * these are subsets of the game_state struct, published by the main thread under the instructions mutex
+ * and copied by the decoder whenever it starts a section
  */
 struct decoder_instructions {
 
+    STATE_ID state;                         /**< the game state being decoded */
     bool audio_only;                        /**< whether the next section only needs decoded audio */
     uint32_t start_offset_bytes;            /**< the point in the file to start decoding from */
     uint32_t end_offset_bytes;              /**< the end of the current chunk */
 
-    SDL_Mutex *mutex;                       /**< mutex will be held by decoder until its exit flag is triggered */
+    STATE_ID predicted_next;                /**< state to pre-decode once the current chunk is demuxed, NO_STATE to skip */
+    uint32_t epoch;                         /**< segment epoch the instructions were published with */
 };
 
 // TODO make function to cleanup decoder_instructions
@@ -12,19 +12,27 @@
 #include <stdint.h>
 
 #include <frame_queue.h>
+#include <frame_pool.h>
 #include <render.h>
 #include <init.h>
+#include <audio_clock.h>
+#include <frame_pacer.h>
+#include <frame_damage.h>
+#include <pipeline_stats.h>
+#include <trace.h>
+#include <lock_profile.h>
+#include <hud.h>
 
 #define TIMEOUT_DELAY_MS 50
-#define NUM_CHANNELS 2 // stereo
-#define BYTES_PER_SAMPLE 2 // 16 bit
 
-#define SAMPLES_TO_MS  (1000.0 / 48000) //sample rate is 48000 / second
-#define PTS_TO_MS      (1000.0 / 90000.0) // time base is 1 / 90000 * 1000 for ms
+#define PTS_TO_MS      (1000.0 / 90000.0) // mpeg time base, only used if the decoder didn't tag the frame with one
 
-#define AUDIO_LATENCY_MS 200 // hardware latency, 200ms seems to be good, can be adjusted if needed
 #define LAG_TOLERANCE_MS 20.0 // won't drop a frame in only a small amount behind
 
+#define STATS_FRAMES 300 // frames between logs of the upload and present times, about 10 seconds
+
+#define MAX_PARTIAL_UPLOAD 0.5 // share of a frame changed above which one full upload beats several partial ones
+
 /**
  * @struct render_thread_args
  * @brief Struct containing nesesary information for the render thread
@@ -35,14 +43,35 @@ struct render_thread_args {
 
     SDL_Window *window;                   /**< main window for the app */
     SDL_Renderer *renderer;               /**< main renderer for the app */
-    SDL_Texture *texture;                 /**< reused texture to avoid repeate declarations and memory churn */
+    SDL_Texture *const *textures;         /**< ring of reused textures to avoid repeate declarations and memory churn */
 
     frame_queue *queue;                   /**< queue of avframes to render */
-    SDL_AtomicU32 *total_audio_samples;   /**< total amount of audio samples pushed to the audio queue, used for syncing */
-    SDL_AudioStream *audio_stream;        /**< audio stream where audio packets are queued */
+    audio_clock *clock;                   /**< playback position of the audio device, video is synced to it */
+    frame_pacer *pacer;                   /**< schedules frames onto the display's vblanks */
+    pipeline_stats *stats;                /**< presented and dropped frames are recorded here */
+    hud *hud;                             /**< performance overlay, NULL if it couldn't be created */
+    SDL_AtomicInt *show_hud;              /**< nonzero while the hud is drawn, toggled from the main thread */
 
     const struct game_state **game_state; /**< pointer to the pointer to the current game state, not to be changed from this thread */ //TODO figure out if this is needed
-    SDL_Mutex *state_mutex;               /**< mutex to keep the main thread from changing teh game state mid-rendercycle */
+    SDL_AtomicU32 *epoch;                 /**< segment epoch being played, frames tagged with any other are stale */
+};
+
+/**
+ * @struct render_state
+ * @brief what the render thread carries from one frame to the next, only touched by the render thread
+ */
+struct render_state {
+    uint32_t seen_epoch;                  /**< the last segment epoch rendered in */
+    int next_texture;                     /**< index of the texture in the ring the next frame is uploaded into */
+    int shown_texture;                    /**< texture the frame on screen was drawn from, -1 before the first */
+    struct frame_damage stale[BASE_TEXTURE_COUNT]; /**< what changed since each texture was last uploaded into */
+
+    Uint64 upload_ns;                     /**< time spent uploading frames since the stats were last logged */
+    Uint64 present_ns;                    /**< time spent drawing and presenting frames since the stats were last logged, includes waiting on vsync */
+    uint32_t timed_frames;                /**< frames the times above cover */
+    uint64_t uploaded_bytes;              /**< picture bytes uploaded since the stats were last logged */
+    uint64_t skipped_bytes;               /**< picture bytes left out of uploads because they didn't change */
+    uint32_t static_frames;               /**< frames drawn again from the texture on screen without an upload */
 };
 
 bool create_render_thread(app_state *appstate) {
@@ -59,16 +88,28 @@ bool create_render_thread(app_state *appstate) {
     args->exit_flag = &appstate->stop_render_thread;
     args->renderer = appstate->renderer;
     args->window = appstate->window;
-    args->texture = appstate->base_texture;
+    args->textures = appstate->base_textures;
     args->queue = appstate->render_queue;
-    args->total_audio_samples = &appstate->total_audio_samples;
-    args->audio_stream = appstate->audio_stream;
+    args->clock = appstate->audio_clock;
+    args->pacer = create_frame_pacer(appstate->renderer, appstate->window);
+    if (!args->pacer) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't allocate frame pacer\n");
+        return false;
+    }
     args->game_state = &appstate->current_game_state;
-    args->state_mutex = appstate->renderer_mutex;
+    args->epoch = &appstate->segment_epoch;
+    args->stats = &appstate->stats;
+    args->show_hud = &appstate->show_hud;
+
+    // playback carries on without it
+    args->hud = create_hud(appstate->renderer, &appstate->stats, appstate->render_queue);
+    if (!args->hud) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't create hud %s\n", SDL_GetError());
+    }
 
-    //starts decoder thread
-    appstate->decoder_thread = SDL_CreateThread(render_frames, "decoder", args);
-    if (!appstate->decoder_thread) {
+    //starts render thread
+    appstate->render_thread = SDL_CreateThread(render_frames, "renderer", args);
+    if (!appstate->render_thread) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't allocate render thread\n");
         return false;
     }
@@ -76,99 +117,349 @@ bool create_render_thread(app_state *appstate) {
     return true;
 }
 
+/**
+ * @brief copies one plane of a frame into locked texture memory row by row, the frame's rows are padded wider
+ *
+ * @param dst first row of the plane in the texture
+ * @param dst_pitch bytes per row in the texture
+ * @param src first row of the plane in the frame
+ * @param src_pitch bytes per row in the frame
+ * @param width bytes to copy per row
+ * @param height rows to copy
+ */
+static void copy_plane(Uint8 *dst, const int dst_pitch, const Uint8 *src, const int src_pitch, const int width, const int height) {
+    for (int row = 0; row < height; row++) {
+        SDL_memcpy(dst + (size_t)row * dst_pitch, src + (size_t)row * src_pitch, width);
+    }
+}
+
+/**
+ * @brief writes a 4:2:0 frame straight into a streaming IYUV texture's memory
+ * the locked memory holds the Y plane followed by the U and V planes at half the pitch
+ *
+ * @param texture texture to upload into, not being drawn from by the previous frame
+ * @param frame decoded frame to upload
+ * @return true on success, false otherwise
+ */
+static bool upload_frame(SDL_Texture *texture, const AVFrame *frame) {
+    void *pixels;
+    int pitch;
+    if (!SDL_LockTexture(texture, NULL, &pixels, &pitch)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't lock video texture %s\n", SDL_GetError());
+        return false;
+    }
+
+    const int width = SDL_min(frame->width, texture->w);
+    const int height = SDL_min(frame->height, texture->h);
+    const int chroma_pitch = (pitch + 1) / 2;
+
+    Uint8 *y_plane = pixels;
+    Uint8 *u_plane = y_plane + (size_t)pitch * texture->h;
+    Uint8 *v_plane = u_plane + (size_t)chroma_pitch * ((texture->h + 1) / 2);
+
+    copy_plane(y_plane, pitch, frame->data[0], frame->linesize[0], width, height);
+    copy_plane(u_plane, chroma_pitch, frame->data[1], frame->linesize[1], (width + 1) / 2, (height + 1) / 2);
+    copy_plane(v_plane, chroma_pitch, frame->data[2], frame->linesize[2], (width + 1) / 2, (height + 1) / 2);
+
+    SDL_UnlockTexture(texture);
+    return true;
+}
+
+/**
+ * @brief picture bytes of the part of a frame that fits in the texture
+ *
+ * @param texture texture the frame is uploaded into
+ * @param frame decoded frame
+ * @return bytes of all three planes
+ */
+static uint64_t picture_bytes(const SDL_Texture *texture, const AVFrame *frame) {
+    const int width = SDL_min(frame->width, texture->w);
+    const int height = SDL_min(frame->height, texture->h);
+    return (uint64_t)width * height + 2 * (uint64_t)((width + 1) / 2) * ((height + 1) / 2);
+}
+
+/**
+ * @brief uploads the changed part of a frame, one rect per run of changed bands, or all of it if most of it changed
+ *
+ * @param texture texture to upload into
+ * @param frame decoded frame to upload
+ * @param damage what changed since the texture was last uploaded into
+ * @param uploaded_bytes set to the picture bytes uploaded
+ * @return true on success, false otherwise
+ */
+static bool upload_damage(SDL_Texture *texture, const AVFrame *frame, const struct frame_damage *damage,
+                          uint64_t *uploaded_bytes)
+{
+    const int width = SDL_min(frame->width, texture->w);
+    const int height = SDL_min(frame->height, texture->h);
+    const int bands = (height + DAMAGE_TILE - 1) / DAMAGE_TILE;
+
+    // how much changed, frames taller than the bands are tracked for are always uploaded whole
+    uint64_t damaged_pixels = 0;
+    for (int band = 0; band < bands && band < MAX_DAMAGE_BANDS; band++) {
+        const int right = SDL_min(damage->right[band], width);
+        if (right > damage->left[band]) {
+            damaged_pixels += (uint64_t)(right - damage->left[band]) * (SDL_min((band + 1) * DAMAGE_TILE, height) - band * DAMAGE_TILE);
+        }
+    }
+    if (bands > MAX_DAMAGE_BANDS || (double)damaged_pixels > (double)width * height * MAX_PARTIAL_UPLOAD) {
+        *uploaded_bytes = picture_bytes(texture, frame);
+        return upload_frame(texture, frame);
+    }
+
+    *uploaded_bytes = 0;
+    int band = 0;
+    while (band < bands) {
+        if (damage->left[band] == damage->right[band]) {
+            band++;
+            continue;
+        }
+
+        // merges the run of changed bands starting here into one rect
+        int left = damage->left[band];
+        int right = damage->right[band];
+        int end = band + 1;
+        while (end < bands && damage->left[end] != damage->right[end]) {
+            left = SDL_min(left, damage->left[end]);
+            right = SDL_max(right, damage->right[end]);
+            end++;
+        }
+        right = SDL_min(right, width);
+
+        if (right > left) {
+            const SDL_Rect rect = {
+                .x = left,
+                .y = band * DAMAGE_TILE,
+                .w = right - left,
+                .h = SDL_min(end * DAMAGE_TILE, height) - band * DAMAGE_TILE,
+            };
+            if (!SDL_UpdateYUVTexture(texture, &rect,
+                frame->data[0] + (size_t)rect.y * frame->linesize[0] + rect.x, frame->linesize[0],                   // Y plane
+                frame->data[1] + (size_t)(rect.y / 2) * frame->linesize[1] + rect.x / 2, frame->linesize[1],         // U plane
+                frame->data[2] + (size_t)(rect.y / 2) * frame->linesize[2] + rect.x / 2, frame->linesize[2]))        // V plane
+            {
+                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't update video texture %s\n", SDL_GetError());
+                return false;
+            }
+            *uploaded_bytes += (uint64_t)rect.w * rect.h + 2 * (uint64_t)((rect.w + 1) / 2) * ((rect.h + 1) / 2);
+        }
+        band = end;
+    }
+    return true;
+}
+
+/**
+ * @brief folds a frame's damage into every texture, each now differs from the newest frame by at least that much.
+ * dropped frames count too, the damage of the frame after them is relative to them
+ *
+ * @param state render state holding the textures' damage
+ * @param damage what changed in the frame
+ */
+static void age_textures(struct render_state *state, const struct frame_damage *damage) {
+    for (int i = 0; i < BASE_TEXTURE_COUNT; i++) {
+        add_damage(&state->stale[i], damage);
+    }
+}
+
+/**
+ * @brief logs the average upload and present times and the pacing statistics every STATS_FRAMES frames
+ *
+ * @param args thread args passed through
+ * @param state render state holding the times
+ */
+static void log_render_stats(const struct render_thread_args *args, struct render_state *state) {
+    if (++state->timed_frames < STATS_FRAMES) {
+        return;
+    }
+
+    const uint64_t total_bytes = state->uploaded_bytes + state->skipped_bytes;
+    SDL_Log("%s renderer: upload %.3f ms, present %.3f ms per frame, %" PRIu32 " static frames, "
+        "%.1f%% of picture bytes skipped (%" PRIu64 " bytes)\n", SDL_GetRendererName(args->renderer),
+        (double)state->upload_ns / state->timed_frames / SDL_NS_PER_MS,
+        (double)state->present_ns / state->timed_frames / SDL_NS_PER_MS, state->static_frames,
+        total_bytes ? 100.0 * (double)state->skipped_bytes / (double)total_bytes : 0.0, state->skipped_bytes);
+
+    state->upload_ns = 0;
+    state->present_ns = 0;
+    state->timed_frames = 0;
+    state->uploaded_bytes = 0;
+    state->skipped_bytes = 0;
+    state->static_frames = 0;
+
+    log_frame_pacing(args->pacer);
+}
+
+/**
+ * @brief draws everything that goes on top of the base layer
+ *
+ * @param args all nesesary information in a render_thread_args struct
+ */
+static void render_overlays(const struct render_thread_args *args) {
+    //TODO render button selector
+
+    if (args->hud && SDL_GetAtomicInt(args->show_hud) && !draw_hud(args->hud)) {
+        // the video matters more than the numbers
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't draw hud %s, hiding it\n", SDL_GetError());
+        SDL_SetAtomicInt(args->show_hud, 0);
+    }
+}
+
+/**
+ * @brief draws a texture of the base layer over the whole window with the overlays on top, ready to present
+ *
+ * @param args all nesesary information in a render_thread_args struct
+ * @param texture texture to draw
+ */
+static void draw_frame(const struct render_thread_args *args, SDL_Texture *texture) {
+    SDL_RenderClear(args->renderer);
+    SDL_RenderTexture(args->renderer, texture, NULL, NULL);  // whole texture to window
+    render_overlays(args);
+}
+
 /**
  * @brief renders the base layer frame decoded from the fuile
  * @param args all nesesary information in a render_thread_args struct
+ * @param state carried between frames, picks up new segment epochs and the next texture in the ring
  * @return true on success, false otherwise
  */
-static bool render_base_layer(const struct render_thread_args *args) {
-    /* waits for queue mutex */
-    SDL_LockMutex(args->queue->mutex);
+static bool render_base_layer(const struct render_thread_args *args, struct render_state *state) {
+    // a new segment starts on time, the decoder shouldn't keep skipping for the old one's lag
+    const uint32_t epoch = SDL_GetAtomicU32(args->epoch);
+    if (epoch != state->seen_epoch) {
+        state->seen_epoch = epoch;
+        report_frame_lag(args->queue, 0.0, 0.0);
+        restart_frame_pacer(args->pacer);
+    }
 
     // exit early if there are no decoded frames, this is not anormal, sections of the file can contain only audio
-    if (args->queue->size == 0) {
-        if (!SDL_WaitConditionTimeout(args->queue->not_empty, args->queue->mutex, TIMEOUT_DELAY_MS)) {
-            SDL_UnlockMutex(args->queue->mutex);
-            return true;
+    TRACE_BEGIN(wait_span);
+    const bool has_frame = wait_for_frame(args->queue, TIMEOUT_DELAY_MS);
+    TRACE_END(wait_span, "wait_for_frame");
+    if (!has_frame) {
+        // nothing is presented through audio only sections, keeps the hud live on top of the last frame
+        if (args->hud && SDL_GetAtomicInt(args->show_hud) && state->shown_texture >= 0) {
+            draw_frame(args, args->textures[state->shown_texture]);
+            SDL_RenderPresent(args->renderer);
         }
+        return true;
     }
 
-    AVFrame *current_frame = dequeue_frame(args->queue);
-    SDL_UnlockMutex(args->queue->mutex);
+    uint32_t frame_epoch;
+    struct frame_damage damage;
+    AVFrame *current_frame = dequeue_frame(args->queue, &frame_epoch, &damage);
     if (!current_frame) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "error dequeueing frame");
         return false;
     }
+    age_textures(state, &damage);
+
+    // left over from a state that was changed away from
+    if (frame_epoch != epoch) {
+        release_frame(args->queue->pool, &current_frame);
+        stats_frame_dropped(args->stats);
+        return true;
+    }
 
     // sync audio and video
     {
-        const uint32_t queued_samples = SDL_GetAudioStreamQueued(args->audio_stream) / (NUM_CHANNELS * BYTES_PER_SAMPLE);
-        const uint32_t played_audio_samples = SDL_GetAtomicU32(args->total_audio_samples) - queued_samples;
+        const double pts_to_ms = current_frame->time_base.den ? av_q2d(current_frame->time_base) * 1000.0 : PTS_TO_MS;
 
         // timestamps of current audio and video frames in ms
-        const double audio_time_ms = played_audio_samples * SAMPLES_TO_MS + AUDIO_LATENCY_MS;
-        const double video_time_ms = (double)current_frame->best_effort_timestamp * PTS_TO_MS;
-
-        if (video_time_ms > audio_time_ms ) {
-            // delay until audio catches up
-            const Uint32 delay = (uint32_t)(video_time_ms - audio_time_ms);
-            if (delay > 100) {
-                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "large frame delay of %" PRId32, delay);
-            }
-            SDL_Delay((uint32_t)(video_time_ms - audio_time_ms));
-        } else if (audio_time_ms - video_time_ms > LAG_TOLERANCE_MS) {
-            // drop frame if audio is ahead of video
-            SDL_Log("dropping frame");
-            av_frame_free(&current_frame);
+        const double audio_time_ms = audio_clock_now_ms(args->clock);
+        const double video_time_ms = (double)current_frame->best_effort_timestamp * pts_to_ms;
+
+        // lets the decoder skip work once it falls behind, and go back to full quality once caught up
+        report_frame_lag(args->queue, audio_time_ms - video_time_ms, audio_time_ms);
+        if (args->hud && SDL_GetAtomicInt(args->show_hud)) {
+            record_hud_drift(args->hud, audio_time_ms - video_time_ms);
+        }
+
+        // holds the frame until its vblank comes up, or drops it if that has already gone by
+        TRACE_BEGIN(pace_span);
+        const enum pace_decision decision = schedule_frame(args->pacer, video_time_ms - audio_time_ms, video_time_ms, LAG_TOLERANCE_MS);
+        TRACE_END(pace_span, "schedule_frame");
+        if (decision == PACE_DROP) {
+            release_frame(args->queue->pool, &current_frame);
+            stats_frame_dropped(args->stats);
+            return true;
+        }
+
+        // the state may have changed while waiting
+        if (SDL_GetAtomicU32(args->epoch) != epoch) {
+            release_frame(args->queue->pool, &current_frame);
+            stats_frame_dropped(args->stats);
             return true;
         }
     }
 
-    // render the frame
-    SDL_UpdateYUVTexture(args->texture, NULL,
-        current_frame->data[0], current_frame->linesize[0],   // Y plane
-        current_frame->data[1], current_frame->linesize[1],   // U plane
-        current_frame->data[2], current_frame->linesize[2]);  // V plane
+    const Uint64 upload_start_ns = SDL_GetTicksNS();
+    SDL_Texture *texture;
+
+    if (state->shown_texture >= 0 && damage_is_empty(&state->stale[state->shown_texture])) {
+        // nothing changed since the frame on screen, draws it again without uploading
+        texture = args->textures[state->shown_texture];
+        state->skipped_bytes += picture_bytes(texture, current_frame);
+        state->static_frames++;
+        release_frame(args->queue->pool, &current_frame);
+
+    } else {
+        // uploads into the next texture in the ring, the one the last frame was drawn from can still be in use
+        const int index = state->next_texture;
+        texture = args->textures[index];
+        state->next_texture = (state->next_texture + 1) % BASE_TEXTURE_COUNT;
+
+        uint64_t uploaded_bytes = 0;
+        const uint64_t frame_bytes = picture_bytes(texture, current_frame);
+        const bool uploaded = upload_damage(texture, current_frame, &state->stale[index], &uploaded_bytes);
+        TRACE_END(upload_start_ns, "upload");
+        release_frame(args->queue->pool, &current_frame);
+        if (!uploaded) {
+            return false;
+        }
 
-    SDL_RenderClear(args->renderer);
-    SDL_RenderTexture(args->renderer, args->texture, NULL, NULL);  // whole texture to window
+        clear_damage(&state->stale[index]);
+        state->shown_texture = index;
+        state->uploaded_bytes += uploaded_bytes;
+        state->skipped_bytes += frame_bytes - uploaded_bytes;
+    }
+
+    // render the frame
+    const Uint64 present_start_ns = SDL_GetTicksNS();
+    draw_frame(args, texture);
+    TRACE_BEGIN(present_span);
     SDL_RenderPresent(args->renderer);
+    TRACE_END(present_span, "SDL_RenderPresent");
+    frame_presented(args->pacer);
+    stats_frame_presented(args->stats, epoch, (uint32_t)((present_start_ns - upload_start_ns) / SDL_NS_PER_US));
 
-    SDL_FlushRenderer(args->renderer);
-    av_frame_free(&current_frame);
+    state->upload_ns += present_start_ns - upload_start_ns;
+    state->present_ns += SDL_GetTicksNS() - present_start_ns;
+    log_render_stats(args, state);
     return true;
 }
 
 int render_frames(void *data) {
     const struct render_thread_args *args = (struct render_thread_args *) data;
+    TRACE_THREAD("renderer");
+    LOCK_PROFILE_THREAD("renderer");
 
-    // exit flag at -1 will hard exit thread
-    while (SDL_GetAtomicInt(args->exit_flag) != -1) {
+    struct render_state state = { .seen_epoch = SDL_GetAtomicU32(args->epoch), .shown_texture = -1 };
 
-        SDL_LockMutex(args->state_mutex);
-        SDL_SetAtomicInt(args->exit_flag, 0);
-
-        while (SDL_GetAtomicInt(args->exit_flag) == 0) {
-            // main render loop
-
-            if (!render_base_layer(args)) {
-                SDL_SetAtomicInt(args->exit_flag, -1);
-                break;
-            }
+    // nothing has been uploaded into the textures yet
+    for (int i = 0; i < BASE_TEXTURE_COUNT; i++) {
+        set_full_damage(&state.stale[i]);
+    }
 
-            //TODO render button selector
+    // exit flag at -1 will hard exit thread, gamestate changes are picked up from the frames' epochs
+    while (SDL_GetAtomicInt(args->exit_flag) == 0) {
+        // main render loop
 
-            //TIDI render hud conditionally
+        if (!render_base_layer(args, &state)) {
+            SDL_SetAtomicInt(args->exit_flag, -1);
+            break;
         }
-
-        //reuns when the main thread sets the exit flag and changes the gamestate
-        SDL_UnlockMutex(args->state_mutex);
-        SDL_Delay(1); //gives time for the main thread to grab mutex
     }
 
-    //ensures no double unlock on hard exit
-    SDL_TryLockMutex(args->state_mutex);
-
-    SDL_UnlockMutex(args->state_mutex);
+    destroy_hud(args->hud);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,336 @@
+/**
+ * @file telecine.c
+ *
+ * helper functions for the telecine_filter struct
+ *
+ * in a 3:2 pulled down top field first stream the decoded frames of one cycle carry the fields
+ * AtAb BtBb BtCb CtDb DtDb. BtCb and CtDb are combed, weaving their top field with the previous frame's
+ * bottom field gives BtBb again, a repeat, and CtCb, the missing film frame. Only luma is used to decide
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavutil/frame.h>
+
+#include <telecine.h>
+#include <frame_pool.h>
+
+#define CADENCE_CYCLE 5          // decoded frames per 3:2 cycle, they hold four film frames
+#define FILM_LOCK_HITS 2         // repeats a cycle apart before the cadence is trusted
+#define COMB_DIFF 12             // how far past both its neighbours a pixel has to be to count as combed
+#define COMB_ROW_STEP 4          // rows sampled, every other row of a field
+#define MIN_COMBED_SHARE 0.005   // share of sampled pixels that have to be combed for a frame to count as combed
+#define REPEAT_MAX_DIFF 2.0      // mean difference between two fields below which one repeats the other
+
+telecine_filter *create_telecine_filter(frame_pool *pool) {
+    telecine_filter *ivtc = calloc(1, sizeof(telecine_filter));
+    if (!ivtc) return NULL;
+
+    ivtc->pool = pool;
+    ivtc->previous = av_frame_alloc();
+    ivtc->output = av_frame_alloc();
+    if (!ivtc->previous || !ivtc->output) {
+        destroy_telecine_filter(ivtc);
+        return NULL;
+    }
+    reset_telecine_filter(ivtc);
+    return ivtc;
+}
+
+/**
+ * @brief counts the combed pixels of the frame two fields weave into, sampling every other row of the second field
+ *
+ * @param first plane holding the first field
+ * @param first_linesize its linesize
+ * @param second plane holding the second field, can be the same as first
+ * @param second_linesize its linesize
+ * @param width pixels per row
+ * @param height rows in the plane
+ * @param first_parity parity of the first field's rows, 0 for top field first
+ * @param sampled set to the amount of pixels checked
+ * @return combed pixels
+ */
+static int64_t count_combing(const uint8_t *first, const int first_linesize, const uint8_t *second,
+                             const int second_linesize, const int width, const int height, const int first_parity,
+                             int64_t *sampled)
+{
+    int64_t combed = 0;
+    *sampled = 0;
+
+    // rows of the second field with a first field row on both sides
+    for (int y = first_parity ? 2 : 1; y + 1 < height; y += COMB_ROW_STEP) {
+        const uint8_t *above = first + (size_t)(y - 1) * first_linesize;
+        const uint8_t *row = second + (size_t)y * second_linesize;
+        const uint8_t *below = first + (size_t)(y + 1) * first_linesize;
+
+        for (int x = 0; x < width; x++) {
+            const int up = row[x] - above[x];
+            const int down = row[x] - below[x];
+            combed += (up > COMB_DIFF && down > COMB_DIFF) || (up < -COMB_DIFF && down < -COMB_DIFF);
+        }
+        *sampled += width;
+    }
+    return combed;
+}
+
+/**
+ * @brief mean difference between the same field of two planes, sampling every other row
+ *
+ * @param a first plane
+ * @param a_linesize its linesize
+ * @param b second plane
+ * @param b_linesize its linesize
+ * @param width pixels per row
+ * @param height rows in the planes
+ * @param parity parity of the field's rows
+ * @return mean absolute difference per pixel
+ */
+static double field_difference(const uint8_t *a, const int a_linesize, const uint8_t *b, const int b_linesize,
+                               const int width, const int height, const int parity)
+{
+    int64_t difference = 0;
+    int64_t sampled = 0;
+
+    for (int y = parity; y < height; y += COMB_ROW_STEP) {
+        const uint8_t *a_row = a + (size_t)y * a_linesize;
+        const uint8_t *b_row = b + (size_t)y * b_linesize;
+        for (int x = 0; x < width; x++) {
+            difference += abs(a_row[x] - b_row[x]);
+        }
+        sampled += width;
+    }
+    return sampled ? (double)difference / (double)sampled : 0.0;
+}
+
+/**
+ * @brief takes a reference to a frame's picture to match the next frame against
+ *
+ * @param ivtc filter to keep it in
+ * @param frame frame whose picture to keep, left as it is
+ */
+static void keep_previous(telecine_filter *ivtc, const AVFrame *frame) {
+    av_frame_unref(ivtc->previous);
+
+    for (int i = 0; i < AV_NUM_DATA_POINTERS; i++) {
+        if (frame->buf[i]) {
+            ivtc->previous->buf[i] = av_buffer_ref(frame->buf[i]);
+            if (!ivtc->previous->buf[i]) {
+                // nothing to match against then, the next frame is queued as decoded
+                av_frame_unref(ivtc->previous);
+                return;
+            }
+        }
+        ivtc->previous->data[i] = frame->data[i];
+        ivtc->previous->linesize[i] = frame->linesize[i];
+    }
+    ivtc->previous->extended_data = ivtc->previous->data;
+    ivtc->previous->format = frame->format;
+    ivtc->previous->width = frame->width;
+    ivtc->previous->height = frame->height;
+}
+
+/**
+ * @brief replaces a frame's picture with its first field woven with the previous frame's second field
+ * the decoded picture becomes the previous one
+ *
+ * @param ivtc filter holding the previous frame
+ * @param frame decoded frame
+ * @param first_parity parity of the first field's rows, 0 for top field first
+ * @return true on success, false if no picture could be had, the frame is then left as it was
+ */
+static bool weave_with_previous(telecine_filter *ivtc, AVFrame *frame, const int first_parity) {
+    AVFrame *output = ivtc->output;
+    output->format = frame->format;
+    output->width = frame->width;
+    output->height = frame->height;
+    if (!acquire_picture(ivtc->pool, output)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't allocate field matched picture\n");
+        av_frame_unref(output);
+        return false;
+    }
+
+    const AVFrame *previous = ivtc->previous;
+    for (int plane = 0; plane < 3; plane++) {
+        const int width = plane ? (frame->width + 1) / 2 : frame->width;
+        const int height = plane ? (frame->height + 1) / 2 : frame->height;
+
+        // chroma rows alternate between the fields too
+        for (int y = 0; y < height; y++) {
+            const AVFrame *source = (y & 1) == first_parity ? frame : previous;
+            memcpy(output->data[plane] + (size_t)y * output->linesize[plane],
+                source->data[plane] + (size_t)y * source->linesize[plane], width);
+        }
+    }
+
+    av_frame_unref(ivtc->previous);
+    move_picture(ivtc->previous, frame);
+    move_picture(frame, output);
+    av_frame_unref(output);
+    return true;
+}
+
+/**
+ * @brief forgets the cadence, timestamps are passed through again
+ *
+ * @param ivtc filter to unlock
+ */
+static void lose_cadence(telecine_filter *ivtc) {
+    if (ivtc->film) {
+        SDL_Log("lost 3:2 pulldown cadence\n");
+    }
+    ivtc->film = false;
+    ivtc->cadence_hits = 0;
+    ivtc->since_pulldown = 0;
+}
+
+/**
+ * @brief puts a kept film frame on the 24p timeline, four frames in the time of the five decoded ones
+ *
+ * @param ivtc filter holding the cadence
+ * @param frame frame to retime
+ */
+static void respace_film_frame(telecine_filter *ivtc, AVFrame *frame) {
+    if (ivtc->film_origin_pts == AV_NOPTS_VALUE) {
+        ivtc->film_origin_pts = frame->best_effort_timestamp;
+        ivtc->film_frames = 0;
+    }
+    if (ivtc->film_origin_pts == AV_NOPTS_VALUE || ivtc->frame_duration <= 0) {
+        return;
+    }
+
+    const int64_t film_pts = ivtc->film_origin_pts +
+        ivtc->film_frames * ivtc->frame_duration * CADENCE_CYCLE / (CADENCE_CYCLE - 1);
+    frame->pts = film_pts;
+    frame->best_effort_timestamp = film_pts;
+    frame->duration = ivtc->frame_duration * CADENCE_CYCLE / (CADENCE_CYCLE - 1);
+    ivtc->film_frames++;
+}
+
+enum telecine_decision inverse_telecine(telecine_filter *ivtc, AVFrame *frame) {
+    if (frame->format != AV_PIX_FMT_YUV420P) {
+        return TELECINE_KEEP;
+    }
+    ivtc->total_frames++;
+
+    // the 24p timeline is spaced from the decoded frame rate
+    const int64_t pts = frame->best_effort_timestamp;
+    if (pts != AV_NOPTS_VALUE && ivtc->last_pts != AV_NOPTS_VALUE && pts > ivtc->last_pts) {
+        ivtc->frame_duration = pts - ivtc->last_pts;
+    }
+    ivtc->last_pts = pts;
+
+    if (!(frame->flags & AV_FRAME_FLAG_INTERLACED)) {
+        // soft pulldown, the decoder already hands out the film frames and only the display would repeat fields
+        if (frame->repeat_pict > 0) {
+            ivtc->soft_frames++;
+        }
+
+        // progressive frames don't take part in a hard telecine cadence
+        lose_cadence(ivtc);
+        av_frame_unref(ivtc->previous);
+        ivtc->previous_matched = false;
+        return TELECINE_KEEP;
+    }
+
+    const int first_parity = (frame->flags & AV_FRAME_FLAG_TOP_FIELD_FIRST) ? 0 : 1;
+    const AVFrame *previous = ivtc->previous;
+    const bool has_previous = previous->data[0] && previous->format == frame->format &&
+        previous->width == frame->width && previous->height == frame->height;
+
+    if (++ivtc->since_pulldown > 2 * CADENCE_CYCLE) {
+        lose_cadence(ivtc);
+    }
+
+    bool combed = false;
+    bool match = false;
+    bool repeat = false;
+    int64_t sampled;
+    const int64_t combing = count_combing(frame->data[0], frame->linesize[0], frame->data[0], frame->linesize[0],
+        frame->width, frame->height, first_parity, &sampled);
+    combed = (double)combing > (double)sampled * MIN_COMBED_SHARE;
+
+    if (combed && has_previous) {
+        // the first field may belong with the previous frame's second field
+        const int64_t matched_combing = count_combing(frame->data[0], frame->linesize[0], previous->data[0],
+            previous->linesize[0], frame->width, frame->height, first_parity, &sampled);
+        match = matched_combing * 2 < combing;
+
+        // and if the previous frame was shown as decoded, its first field was already shown with that second field
+        repeat = match && !ivtc->previous_matched && field_difference(frame->data[0], frame->linesize[0],
+            previous->data[0], previous->linesize[0], frame->width, frame->height, first_parity) < REPEAT_MAX_DIFF;
+    }
+
+    if (repeat) {
+        ivtc->cadence_hits = ivtc->since_pulldown == CADENCE_CYCLE ? ivtc->cadence_hits + 1 : 1;
+        ivtc->since_pulldown = 0;
+        if (!ivtc->film && ivtc->cadence_hits >= FILM_LOCK_HITS) {
+            SDL_Log("locked onto 3:2 pulldown, rebuilding 24p film\n");
+            ivtc->film = true;
+            ivtc->film_origin_pts = AV_NOPTS_VALUE;
+        }
+
+        if (ivtc->film) {
+            // its second field is still needed, the next frame's first field belongs with it
+            av_frame_unref(ivtc->previous);
+            move_picture(ivtc->previous, frame);
+            ivtc->previous_matched = true;
+            ivtc->dropped_frames++;
+            return TELECINE_DROP;
+        }
+    }
+
+    if (match && weave_with_previous(ivtc, frame, first_parity)) {
+        ivtc->matched_frames++;
+        combed = false;
+    } else {
+        match = false;
+        keep_previous(ivtc, frame);
+    }
+    ivtc->previous_matched = match;
+
+    if (ivtc->film) {
+        // film frames are progressive once matched, the deinterlacer would only soften them.
+        // combed ones are left to it, the cadence may be breaking
+        if (!combed) {
+            frame->flags &= ~(AV_FRAME_FLAG_INTERLACED | AV_FRAME_FLAG_TOP_FIELD_FIRST);
+        }
+        respace_film_frame(ivtc, frame);
+    }
+    return TELECINE_KEEP;
+}
+
+void reset_telecine_filter(telecine_filter *ivtc) {
+    av_frame_unref(ivtc->previous);
+    ivtc->previous_matched = false;
+    lose_cadence(ivtc);
+    ivtc->last_pts = AV_NOPTS_VALUE;
+    ivtc->film_origin_pts = AV_NOPTS_VALUE;
+    ivtc->film_frames = 0;
+}
+
+void log_telecine(telecine_filter *ivtc) {
+    if (ivtc->total_frames) {
+        SDL_Log("inverse telecine: %" PRIu32 " of %" PRIu32 " frames soft pulled down, %" PRIu32 " field matched, "
+            "%" PRIu32 " repeats dropped, %s\n", ivtc->soft_frames, ivtc->total_frames, ivtc->matched_frames,
+            ivtc->dropped_frames, ivtc->film ? "locked onto film" : "no film cadence");
+    }
+    ivtc->matched_frames = 0;
+    ivtc->dropped_frames = 0;
+    ivtc->soft_frames = 0;
+    ivtc->total_frames = 0;
+}
+
+void destroy_telecine_filter(telecine_filter *ivtc) {
+    if (!ivtc) return;
+
+    av_frame_free(&ivtc->previous);
+    av_frame_free(&ivtc->output);
+    free(ivtc);
+}
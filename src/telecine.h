@@ -0,0 +1,99 @@
+/**
+ * @file telecine.h
+ *
+ * Inverse telecine run on the video decoder thread between decoding and deinterlacing.
+ * Soft pulled down film, marked with MPEG-2's repeat_first_field, already decodes into progressive 24p
+ * frames and is only counted. Hard telecined film, where the repeated fields were encoded as 30i frames,
+ * is field matched: a combed frame whose first field fits the previous frame's second field is rebuilt
+ * from the two, and once the 3:2 cadence is locked the frame that only repeats the one before it is
+ * dropped and the rest are respaced onto an even 24p timeline
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#ifndef TELECINE_H
+#define TELECINE_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <libavutil/frame.h>
+
+#include <frame_pool.h>
+
+/**
+ * @enum telecine_decision
+ * @brief what to do with a frame once it has been through the filter
+ */
+enum telecine_decision {
+    TELECINE_KEEP,  /**< queue the frame, its picture and timestamps may have been replaced */
+    TELECINE_DROP,  /**< the frame only repeats the one before it, throw it away */
+};
+
+/**
+ * @struct telecine_filter
+ * @brief field matching and cadence state, owned by the video decoder thread
+ */
+typedef struct telecine_filter {
+    frame_pool *pool;              /**< pool matched pictures are taken from */
+    AVFrame *previous;             /**< picture of the last frame as decoded, blank after a reset */
+    AVFrame *output;               /**< blank frame the next matched picture is built in */
+    bool previous_matched;         /**< the last frame wasn't shown as decoded, so it can't be repeated by this one */
+
+    int since_pulldown;            /**< frames since the last one that repeated the frame before it */
+    int cadence_hits;              /**< repeats in a row that came exactly a cadence cycle apart */
+    bool film;                     /**< locked onto a 3:2 cadence, repeats are dropped and timestamps respaced */
+
+    int64_t last_pts;              /**< timestamp of the last frame as decoded, AV_NOPTS_VALUE after a reset */
+    int64_t frame_duration;        /**< timestamp difference between decoded frames, 0 until measured */
+    int64_t film_origin_pts;       /**< timestamp of the first frame kept since locking, AV_NOPTS_VALUE until there is one */
+    int64_t film_frames;           /**< frames kept since then */
+
+    uint32_t matched_frames;       /**< frames rebuilt from two decoded frames since the stats were last logged */
+    uint32_t dropped_frames;       /**< repeats dropped since then */
+    uint32_t soft_frames;          /**< soft pulled down frames passed through since then */
+    uint32_t total_frames;         /**< frames filtered since then */
+} telecine_filter;
+
+/**
+ * @brief creates a filter with nothing to match against and no cadence
+ *
+ * @param pool pool matched pictures are taken from
+ * @return *telecine_filter - pointer to the created filter, or NULL on failure
+ */
+telecine_filter *create_telecine_filter(frame_pool *pool);
+
+/**
+ * @brief field matches a decoded frame against the one before it and decides if it is worth queueing
+ * frames it rebuilds or recognizes as film come out progressive, everything else is left for the deinterlacer
+ *
+ * @param ivtc filter to run
+ * @param frame decoded frame, its picture and timestamps may be replaced
+ * @return TELECINE_DROP if the frame repeats the last one kept, TELECINE_KEEP otherwise
+ */
+enum telecine_decision inverse_telecine(telecine_filter *ivtc, AVFrame *frame);
+
+/**
+ * @brief drops the previous frame and the cadence, call whenever the frames stop following on from each other
+ *
+ * @param ivtc filter to reset
+ */
+void reset_telecine_filter(telecine_filter *ivtc);
+
+/**
+ * @brief logs how much film was found since the last call and starts over
+ *
+ * @param ivtc filter to log
+ */
+void log_telecine(telecine_filter *ivtc);
+
+/**
+ * @brief destroys a filter, releasing the pictures it holds
+ *
+ * @param ivtc filter to destroy, can be NULL
+ */
+void destroy_telecine_filter(telecine_filter *ivtc);
+
+#endif //TELECINE_H
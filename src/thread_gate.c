@@ -0,0 +1,84 @@
+/**
+ * @file thread_gate.c
+ *
+ * publish / park handoff between the main thread and a worker thread
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+
+#include <thread_gate.h>
+#include <lock_profile.h>
+
+thread_gate *create_thread_gate(SDL_AtomicInt *exit_flag) {
+    thread_gate *gate = calloc(1, sizeof(thread_gate));
+    if (!gate) return NULL;
+
+    gate->exit_flag = exit_flag;
+    gate->mutex = SDL_CreateMutex();
+    gate->changed = SDL_CreateCondition();
+    if (!gate->mutex || !gate->changed) {
+        destroy_thread_gate(gate);
+        return NULL;
+    }
+    return gate;
+}
+
+void publish_generation(thread_gate *gate) {
+    LOCK_MUTEX(gate->mutex, LOCK_THREAD_GATE);
+
+    // also counts as a wakeup, so a worker waiting on outside events notices the new work too
+    gate->generation++;
+    gate->wakeups++;
+    BROADCAST_CONDITION(gate->changed, LOCK_THREAD_GATE);
+
+    UNLOCK_MUTEX(gate->mutex, LOCK_THREAD_GATE);
+}
+
+bool park_thread(thread_gate *gate, uint32_t *generation) {
+    LOCK_MUTEX(gate->mutex, LOCK_THREAD_GATE);
+
+    while (gate->generation == *generation && SDL_GetAtomicInt(gate->exit_flag) != -1) {
+        WAIT_CONDITION(gate->changed, gate->mutex, -1, LOCK_THREAD_GATE);
+    }
+    *generation = gate->generation;
+
+    UNLOCK_MUTEX(gate->mutex, LOCK_THREAD_GATE);
+    return SDL_GetAtomicInt(gate->exit_flag) != -1;
+}
+
+void wake_gate(thread_gate *gate) {
+    LOCK_MUTEX(gate->mutex, LOCK_THREAD_GATE);
+
+    gate->wakeups++;
+    BROADCAST_CONDITION(gate->changed, LOCK_THREAD_GATE);
+
+    UNLOCK_MUTEX(gate->mutex, LOCK_THREAD_GATE);
+}
+
+uint32_t gate_wakeups(thread_gate *gate) {
+    LOCK_MUTEX(gate->mutex, LOCK_THREAD_GATE);
+    const uint32_t wakeups = gate->wakeups;
+    UNLOCK_MUTEX(gate->mutex, LOCK_THREAD_GATE);
+    return wakeups;
+}
+
+void wait_gate(thread_gate *gate, const uint32_t seen_wakeups) {
+    LOCK_MUTEX(gate->mutex, LOCK_THREAD_GATE);
+
+    while (gate->wakeups == seen_wakeups && SDL_GetAtomicInt(gate->exit_flag) != -1) {
+        WAIT_CONDITION(gate->changed, gate->mutex, -1, LOCK_THREAD_GATE);
+    }
+    UNLOCK_MUTEX(gate->mutex, LOCK_THREAD_GATE);
+}
+
+void destroy_thread_gate(thread_gate *gate) {
+    if (!gate) return;
+
+    SDL_DestroyMutex(gate->mutex);
+    SDL_DestroyCondition(gate->changed);
+    free(gate);
+}
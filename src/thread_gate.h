@@ -0,0 +1,88 @@
+/**
+ * @file thread_gate.h
+ *
+ * Hands new work from the main thread to a worker thread without either waiting on the other.
+ * The main thread publishes whatever the worker reads next and bumps the generation, the worker
+ * picks it up whenever it next parks. No sleeps and no lost wakeups either way
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#ifndef THREAD_GATE_H
+#define THREAD_GATE_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @struct thread_gate
+ * @brief publish / park handoff for a single worker thread
+ */
+typedef struct thread_gate {
+    SDL_Mutex *mutex;          /**< guards everything below */
+    SDL_Condition *changed;    /**< broadcast whenever anything below changes or the worker should recheck its exit flag */
+
+    SDL_AtomicInt *exit_flag;  /**< the worker's exit flag, 0 to keep working, -1 for hard exit */
+    uint32_t generation;       /**< bumped by the main thread every time it publishes new work */
+    uint32_t wakeups;          /**< bumped by wake_gate, lets the worker wait on outside events without missing any */
+} thread_gate;
+
+/**
+ * @brief creates a gate for a worker thread
+ *
+ * @param exit_flag the worker's exit flag
+ * @return pointer to the gate, or NULL on failure
+ */
+thread_gate *create_thread_gate(SDL_AtomicInt *exit_flag);
+
+/**
+ * @brief publishes a new generation and wakes the worker wherever it waits on the gate, called from the main thread
+ * never waits for the worker, whatever it reads next has to be published before this is called
+ *
+ * @param gate the worker's gate
+ */
+void publish_generation(thread_gate *gate);
+
+/**
+ * @brief parks the calling worker until a generation newer than the one it ran with is published, called from the worker
+ * returns straight away if one already was
+ *
+ * @param gate the worker's gate
+ * @param generation the last generation the worker ran with, updated to the new one
+ * @return true to keep working, false on hard exit
+ */
+bool park_thread(thread_gate *gate, uint32_t *generation);
+
+/**
+ * @brief wakes anything waiting in wait_gate, safe to call from any thread including audio callbacks
+ *
+ * @param gate gate to wake
+ */
+void wake_gate(thread_gate *gate);
+
+/**
+ * @brief reads the wakeup counter before checking the condition wait_gate is used for
+ *
+ * @param gate gate to read
+ * @return the current wakeup count
+ */
+uint32_t gate_wakeups(thread_gate *gate);
+
+/**
+ * @brief waits until wake_gate or publish_generation is called after the given wakeup count was read, or on hard exit
+ *
+ * @param gate gate to wait on
+ * @param seen_wakeups wakeup count read with gate_wakeups before the condition was checked
+ */
+void wait_gate(thread_gate *gate, uint32_t seen_wakeups);
+
+/**
+ * @brief destroys a gate
+ *
+ * @param gate gate to destroy, can be NULL
+ */
+void destroy_thread_gate(thread_gate *gate);
+
+#endif //THREAD_GATE_H
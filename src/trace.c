@@ -0,0 +1,180 @@
+/**
+ * @file trace.c
+ *
+ * per thread span buffers and the Chrome trace export, see trace.h
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#ifdef AIRBUD_TRACE
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <trace.h>
+
+#define TRACE_EVENTS 65536    // spans kept per thread, a power of two, minutes of playback on the busiest thread
+#define TRACE_THREADS 16      // threads that can record, spans from any past that are dropped
+#define TRACE_NAME_BYTES 32
+
+static const char TRACE_PATH_ENV[] = "AIRBUD_TRACE_PATH"; // where export_trace writes to
+static const char DEFAULT_TRACE_PATH[] = "airbud_trace.json";
+
+/**
+ * @struct trace_event
+ * @brief one span, times in SDL_GetTicksNS nanoseconds
+ */
+struct trace_event {
+    const char *name;        /**< what was being done, a string literal */
+    Uint64 start_ns;         /**< when it started */
+    Uint64 end_ns;           /**< when it ended */
+};
+
+/**
+ * @struct trace_buffer
+ * @brief ring of the latest spans of one thread, only written by that thread
+ */
+struct trace_buffer {
+    char thread_name[TRACE_NAME_BYTES];  /**< name shown in the trace */
+    SDL_AtomicU32 written;               /**< spans ever recorded, the next one goes at written % TRACE_EVENTS, stored after the span */
+    struct trace_event events[TRACE_EVENTS]; /**< the latest spans */
+};
+
+// buffers are never freed, the export can run after their threads have exited
+static struct trace_buffer *buffers[TRACE_THREADS];
+static SDL_AtomicInt buffer_count;
+static SDL_TLSID current_buffer;
+
+/**
+ * @brief creates a buffer for the calling thread and publishes it to the export
+ *
+ * @param name thread name, NULL to use the thread id
+ * @return the buffer, or NULL if there are too many threads or it couldn't be allocated
+ */
+static struct trace_buffer *register_thread(const char *name) {
+    const int slot = SDL_AddAtomicInt(&buffer_count, 1);
+    if (slot >= TRACE_THREADS) {
+        return NULL;
+    }
+
+    struct trace_buffer *buffer = calloc(1, sizeof(struct trace_buffer));
+    if (!buffer) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't allocate trace buffer\n");
+        return NULL;
+    }
+
+    if (name) {
+        SDL_strlcpy(buffer->thread_name, name, sizeof(buffer->thread_name));
+    } else {
+        SDL_snprintf(buffer->thread_name, sizeof(buffer->thread_name), "thread %" SDL_PRIu64, SDL_GetCurrentThreadID());
+    }
+    SDL_SetAtomicU32(&buffer->written, 0);
+
+    SDL_SetTLS(&current_buffer, buffer, NULL);
+    SDL_SetAtomicPointer((void **)&buffers[slot], buffer);
+    return buffer;
+}
+
+void trace_thread(const char *name) {
+    struct trace_buffer *buffer = SDL_GetTLS(&current_buffer);
+    if (buffer) {
+        SDL_strlcpy(buffer->thread_name, name, sizeof(buffer->thread_name));
+        return;
+    }
+    register_thread(name);
+}
+
+void trace_span(const char *name, const Uint64 start_ns) {
+    const Uint64 end_ns = SDL_GetTicksNS();
+
+    struct trace_buffer *buffer = SDL_GetTLS(&current_buffer);
+    if (!buffer) {
+        buffer = register_thread(NULL);
+        if (!buffer) return;
+    }
+
+    // only this thread writes, the count is stored after the span so the export never reads a half written one
+    const uint32_t written = SDL_GetAtomicU32(&buffer->written);
+    struct trace_event *event = &buffer->events[written & (TRACE_EVENTS - 1)];
+    event->name = name;
+    event->start_ns = start_ns;
+    event->end_ns = end_ns;
+    SDL_SetAtomicU32(&buffer->written, written + 1);
+}
+
+/**
+ * @brief copies out the spans of a buffer that weren't overwritten while copying
+ *
+ * @param buffer buffer to copy, may be recording at the same time
+ * @param events TRACE_EVENTS spans to copy into, oldest first
+ * @return amount of spans copied
+ */
+static uint32_t snapshot_buffer(struct trace_buffer *buffer, struct trace_event *events) {
+    const uint32_t end = SDL_GetAtomicU32(&buffer->written);
+    const uint32_t start = end > TRACE_EVENTS ? end - TRACE_EVENTS : 0;
+    for (uint32_t i = start; i != end; i++) {
+        events[i - start] = buffer->events[i & (TRACE_EVENTS - 1)];
+    }
+
+    // spans recorded since the copy started reused the slots of the oldest ones
+    const uint32_t overwritten = SDL_GetAtomicU32(&buffer->written) - end;
+    const uint32_t count = end - start;
+    if (overwritten >= count) {
+        return 0;
+    }
+    SDL_memmove(events, events + overwritten, (count - overwritten) * sizeof(struct trace_event));
+    return count - overwritten;
+}
+
+bool export_trace(void) {
+    const char *path = SDL_getenv(TRACE_PATH_ENV);
+    if (!path) {
+        path = DEFAULT_TRACE_PATH;
+    }
+
+    struct trace_event *events = malloc(TRACE_EVENTS * sizeof(struct trace_event));
+    FILE *file = events ? fopen(path, "w") : NULL;
+    if (!file) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't export trace to %s\n", path);
+        free(events);
+        return false;
+    }
+
+    // ts and dur are in microseconds
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"airbud\"}}");
+
+    uint32_t total = 0;
+    const int count = SDL_min(SDL_GetAtomicInt(&buffer_count), TRACE_THREADS);
+    for (int tid = 0; tid < count; tid++) {
+        struct trace_buffer *buffer = SDL_GetAtomicPointer((void **)&buffers[tid]);
+        if (!buffer) continue;
+
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+            tid, buffer->thread_name);
+
+        const uint32_t spans = snapshot_buffer(buffer, events);
+        for (uint32_t i = 0; i < spans; i++) {
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                events[i].name, tid, (double)events[i].start_ns / SDL_NS_PER_US,
+                (double)(events[i].end_ns - events[i].start_ns) / SDL_NS_PER_US);
+        }
+        total += spans;
+    }
+    fprintf(file, "\n]}\n");
+
+    free(events);
+    const bool ok = fclose(file) == 0;
+    if (ok) {
+        SDL_Log("exported %" PRIu32 " trace spans to %s\n", total, path);
+    } else {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't write trace to %s\n", path);
+    }
+    return ok;
+}
+
+#endif //AIRBUD_TRACE
@@ -0,0 +1,63 @@
+/**
+ * @file trace.h
+ *
+ * Spans of what each pipeline thread was doing and when, exported as a Chrome trace that Perfetto or
+ * chrome://tracing can open. Every thread records into a buffer of its own without locking, keeping only its
+ * latest TRACE_EVENTS spans. Only compiled in when AIRBUD_TRACE is defined, otherwise every macro is a no-op
+ *
+ * usage:
+ *     TRACE_BEGIN(span);
+ *     decode_video(...);
+ *     TRACE_END(span, "decode_video");
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#ifdef AIRBUD_TRACE
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+
+#define TRACE_THREAD(name) trace_thread(name)
+#define TRACE_BEGIN(span) const Uint64 span = SDL_GetTicksNS()
+#define TRACE_END(span, name) trace_span(name, span)
+#define TRACE_EXPORT() export_trace()
+
+/**
+ * @brief names the calling thread in the trace, call first thing on every thread that records spans
+ * threads that never call it show up under their thread id
+ *
+ * @param name name to show, copied
+ */
+void trace_thread(const char *name);
+
+/**
+ * @brief records a span on the calling thread's buffer, ending now
+ *
+ * @param name what was being done, has to be a string literal, only the pointer is kept
+ * @param start_ns SDL_GetTicksNS when it started
+ */
+void trace_span(const char *name, Uint64 start_ns);
+
+/**
+ * @brief writes every thread's recorded spans as Chrome trace JSON to AIRBUD_TRACE_PATH, airbud_trace.json by default
+ * safe to call while the threads are still recording, spans overwritten during the export are left out
+ *
+ * @return true on success, false otherwise
+ */
+bool export_trace(void);
+
+#else
+
+#define TRACE_THREAD(name) ((void)0)
+#define TRACE_BEGIN(span) ((void)0)
+#define TRACE_END(span, name) ((void)0)
+#define TRACE_EXPORT() ((void)0)
+
+#endif //AIRBUD_TRACE
+
+#endif //TRACE_H
@@ -0,0 +1,352 @@
+/**
+ * @file vob_index.c
+ *
+ * Builds, saves and loads the VOBU index of a vob file.
+ * Each VOBU starts with a NAV pack holding a PCI packet (presentation times)
+ * and a DSI packet (relative sector addresses), so the whole file can be walked
+ * by reading one sector per VOBU and jumping to the next NAV pack.
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#include <SDL3/SDL.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <vob_index.h>
+
+#define INDEX_MAGIC 0x58494241 // "ABIX" little endian
+#define INDEX_VERSION 2
+#define CHECKED_NAV_PACKS 8    // NAV packs hashed to tell a rewritten vob of the same size from the one indexed
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+// byte offsets inside a NAV pack, fixed by the DVD-Video spec
+#define SYSTEM_HEADER_OFFSET 0x0E
+#define PCI_PACKET_OFFSET    0x26
+#define PCI_SUBSTREAM_OFFSET 0x2C
+#define PCI_S_PTM_OFFSET     0x39
+#define PCI_E_PTM_OFFSET     0x3D
+#define DSI_PACKET_OFFSET    0x400
+#define DSI_SUBSTREAM_OFFSET 0x406
+#define DSI_VOBU_EA_OFFSET   0x40F
+#define DSI_1STREF_EA_OFFSET 0x413
+
+/**
+ * @brief reads a big endian 32 bit value
+ * @param data pointer to the first byte
+ * @return the value
+ */
+static uint32_t read_be32(const uint8_t *data) {
+    return (uint32_t)data[0] << 24 | (uint32_t)data[1] << 16 | (uint32_t)data[2] << 8 | data[3];
+}
+
+/**
+ * @brief checks for an mpeg start code followed by the given stream id
+ * @param data pointer to the first byte of the start code
+ * @param stream_id id that should follow 00 00 01
+ * @return true if the start code matches
+ */
+static bool has_start_code(const uint8_t *data, const uint8_t stream_id) {
+    return data[0] == 0x00 && data[1] == 0x00 && data[2] == 0x01 && data[3] == stream_id;
+}
+
+/**
+ * @brief checks if a sector is a NAV pack (pack header, system header, PCI and DSI packets)
+ * @param sector one full sector of data
+ * @return true if the sector is a NAV pack
+ */
+static bool is_nav_pack(const uint8_t *sector) {
+    return has_start_code(sector, 0xBA)
+        && has_start_code(sector + SYSTEM_HEADER_OFFSET, 0xBB)
+        && has_start_code(sector + PCI_PACKET_OFFSET, 0xBF) && sector[PCI_SUBSTREAM_OFFSET] == 0x00
+        && has_start_code(sector + DSI_PACKET_OFFSET, 0xBF) && sector[DSI_SUBSTREAM_OFFSET] == 0x01;
+}
+
+/**
+ * @brief appends an entry to the index, growing it when needed
+ * @param index index to append to
+ * @param capacity current capacity of the entries array, updated on growth
+ * @param entry entry to append
+ * @return true on success, false on allocation failure
+ */
+static bool append_entry(struct vob_index *index, uint32_t *capacity, const struct vobu_entry *entry) {
+    if (index->count == *capacity) {
+        const uint32_t new_capacity = *capacity ? *capacity * 2 : 1024;
+        struct vobu_entry *entries = realloc(index->entries, sizeof(struct vobu_entry) * new_capacity);
+        if (!entries) {
+            return false;
+        }
+        index->entries = entries;
+        *capacity = new_capacity;
+    }
+    index->entries[index->count++] = *entry;
+    return true;
+}
+
+/**
+ * @brief walks the NAV packs of a vob file and builds its index
+ * uses the VOBU end address from the DSI packet to jump straight to the next NAV pack,
+ * falling back to a sector by sector scan if a jump doesn't land on one
+ *
+ * @param file opened vob file
+ * @param index empty index to populate
+ * @return true on success, false otherwise
+ */
+static bool build_vob_index(SDL_IOStream *file, struct vob_index *index) {
+    const Sint64 file_size = SDL_GetIOSize(file);
+    if (file_size < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't get vob size %s\n", SDL_GetError());
+        return false;
+    }
+    const uint32_t sector_count = (uint32_t)(file_size / DVD_SECTOR_SIZE);
+
+    uint8_t sector_data[DVD_SECTOR_SIZE];
+    uint32_t capacity = 0;
+    uint32_t sector = 0;
+
+    while (sector < sector_count) {
+        if (SDL_SeekIO(file, (Sint64)sector * DVD_SECTOR_SIZE, SDL_IO_SEEK_SET) < 0 ||
+            SDL_ReadIO(file, sector_data, DVD_SECTOR_SIZE) != DVD_SECTOR_SIZE)
+        {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't read vob sector %" PRIu32 "\n", sector);
+            return false;
+        }
+
+        if (!is_nav_pack(sector_data)) {
+            sector++;
+            continue;
+        }
+
+        const uint32_t vobu_ea = read_be32(sector_data + DSI_VOBU_EA_OFFSET);
+        const uint32_t first_ref_ea = read_be32(sector_data + DSI_1STREF_EA_OFFSET);
+
+        const struct vobu_entry entry = {
+            .sector = sector,
+            .last_sector = vobu_ea ? sector + vobu_ea : sector,
+            .iframe_end_sector = first_ref_ea ? sector + first_ref_ea : 0,
+            .start_pts = read_be32(sector_data + PCI_S_PTM_OFFSET),
+            .end_pts = read_be32(sector_data + PCI_E_PTM_OFFSET),
+        };
+        if (!append_entry(index, &capacity, &entry)) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't grow vob index\n");
+            return false;
+        }
+
+        sector = entry.last_sector + 1;
+    }
+
+    SDL_Log("indexed %" PRIu32 " VOBUs over %" PRIu32 " sectors\n", index->count, sector_count);
+    return true;
+}
+
+/**
+ * @struct vob_identity
+ * @brief what a cached index has to match to belong to the vob next to it
+ */
+struct vob_identity {
+    Uint64 size;                  /**< size of the vob file in bytes */
+    Sint64 modify_time;           /**< last modification time of the vob file, 0 if it couldn't be read */
+};
+
+/**
+ * @brief hashes the NAV packs the first entries of an index point at, FNV-1a
+ * @param vob_file opened vob file
+ * @param index index whose entries to hash the NAV packs of
+ * @param checksum set to the hash
+ * @return true on success, false if a NAV pack couldn't be read
+ */
+static bool checksum_nav_packs(SDL_IOStream *vob_file, const struct vob_index *index, Uint32 *checksum) {
+    uint8_t sector_data[DVD_SECTOR_SIZE];
+    Uint32 hash = FNV_OFFSET_BASIS;
+
+    for (uint32_t i = 0; i < index->count && i < CHECKED_NAV_PACKS; i++) {
+        if (SDL_SeekIO(vob_file, (Sint64)index->entries[i].sector * DVD_SECTOR_SIZE, SDL_IO_SEEK_SET) < 0 ||
+            SDL_ReadIO(vob_file, sector_data, DVD_SECTOR_SIZE) != DVD_SECTOR_SIZE)
+        {
+            return false;
+        }
+        for (size_t byte = 0; byte < DVD_SECTOR_SIZE; byte++) {
+            hash = (hash ^ sector_data[byte]) * FNV_PRIME;
+        }
+    }
+    *checksum = hash;
+    return true;
+}
+
+/**
+ * @brief reads a cached index, rejecting it if it was built for a different format or vob.
+ * the vob has to have the same size and modification time, and the same bytes in its first NAV packs
+ * @param index_path path to the cached index
+ * @param vob_file opened vob file
+ * @param vob identity of the vob file
+ * @param index empty index to populate
+ * @return true if a valid cache was loaded, false otherwise
+ */
+static bool read_index_file(const char *index_path, SDL_IOStream *vob_file, const struct vob_identity *vob,
+                            struct vob_index *index)
+{
+    SDL_IOStream *file = SDL_IOFromFile(index_path, "rb");
+    if (!file) {
+        return false;
+    }
+
+    Uint32 magic, version, cached_checksum, count;
+    Uint64 cached_size;
+    Sint64 cached_modify_time;
+    if (!SDL_ReadU32LE(file, &magic) || !SDL_ReadU32LE(file, &version) ||
+        !SDL_ReadU64LE(file, &cached_size) || !SDL_ReadS64LE(file, &cached_modify_time) ||
+        !SDL_ReadU32LE(file, &cached_checksum) || !SDL_ReadU32LE(file, &count) ||
+        magic != INDEX_MAGIC || version != INDEX_VERSION || cached_size != vob->size ||
+        cached_modify_time != vob->modify_time || count == 0)
+    {
+        SDL_CloseIO(file);
+        return false;
+    }
+
+    index->entries = malloc(sizeof(struct vobu_entry) * count);
+    if (!index->entries) {
+        SDL_CloseIO(file);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        struct vobu_entry *entry = &index->entries[i];
+        if (!SDL_ReadU32LE(file, &entry->sector) || !SDL_ReadU32LE(file, &entry->last_sector) ||
+            !SDL_ReadU32LE(file, &entry->iframe_end_sector) || !SDL_ReadU32LE(file, &entry->start_pts) ||
+            !SDL_ReadU32LE(file, &entry->end_pts))
+        {
+            free(index->entries);
+            index->entries = NULL;
+            SDL_CloseIO(file);
+            return false;
+        }
+    }
+    index->count = count;
+    SDL_CloseIO(file);
+
+    // a copy or an edit can keep the size and the time, not the contents
+    Uint32 checksum;
+    if (!checksum_nav_packs(vob_file, index, &checksum) || checksum != cached_checksum) {
+        free(index->entries);
+        index->entries = NULL;
+        index->count = 0;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief saves an index next to the vob so later runs can skip the scan
+ * @param index_path path to write to
+ * @param vob_file opened vob file, its first NAV packs are hashed into the cache
+ * @param vob identity of the vob file
+ * @param index index to save
+ * @return true on success, false otherwise
+ */
+static bool write_index_file(const char *index_path, SDL_IOStream *vob_file, const struct vob_identity *vob,
+                             const struct vob_index *index)
+{
+    Uint32 checksum;
+    if (!checksum_nav_packs(vob_file, index, &checksum)) {
+        return false;
+    }
+
+    SDL_IOStream *file = SDL_IOFromFile(index_path, "wb");
+    if (!file) {
+        return false;
+    }
+
+    bool ok = SDL_WriteU32LE(file, INDEX_MAGIC) && SDL_WriteU32LE(file, INDEX_VERSION) &&
+              SDL_WriteU64LE(file, vob->size) && SDL_WriteS64LE(file, vob->modify_time) &&
+              SDL_WriteU32LE(file, checksum) && SDL_WriteU32LE(file, index->count);
+
+    for (uint32_t i = 0; ok && i < index->count; i++) {
+        const struct vobu_entry *entry = &index->entries[i];
+        ok = SDL_WriteU32LE(file, entry->sector) && SDL_WriteU32LE(file, entry->last_sector) &&
+             SDL_WriteU32LE(file, entry->iframe_end_sector) && SDL_WriteU32LE(file, entry->start_pts) &&
+             SDL_WriteU32LE(file, entry->end_pts);
+    }
+
+    if (!SDL_CloseIO(file)) {
+        ok = false;
+    }
+    if (!ok) {
+        // don't leave a truncated cache behind
+        SDL_RemovePath(index_path);
+    }
+    return ok;
+}
+
+struct vob_index *load_vob_index(const char *vob_path) {
+
+    SDL_IOStream *vob_file = SDL_IOFromFile(vob_path, "rb");
+    if (!vob_file) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't open vob for indexing %s\n", SDL_GetError());
+        return NULL;
+    }
+    const Sint64 vob_size = SDL_GetIOSize(vob_file);
+
+    char *index_path = NULL;
+    if (vob_size < 0 || SDL_asprintf(&index_path, "%s.idx", vob_path) < 0) {
+        SDL_CloseIO(vob_file);
+        return NULL;
+    }
+
+    struct vob_index *index = calloc(1, sizeof(struct vob_index));
+    if (!index) {
+        SDL_free(index_path);
+        SDL_CloseIO(vob_file);
+        return NULL;
+    }
+
+    // a vob whose time can't be read is only checked by size and contents
+    struct vob_identity vob = { .size = (Uint64)vob_size };
+    SDL_PathInfo vob_info;
+    if (SDL_GetPathInfo(vob_path, &vob_info)) {
+        vob.modify_time = vob_info.modify_time;
+    }
+
+    if (!read_index_file(index_path, vob_file, &vob, index)) {
+        // cache is missing or stale, rebuild it
+        if (!build_vob_index(vob_file, index) || index->count == 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't build vob index\n");
+            destroy_vob_index(index);
+            SDL_free(index_path);
+            SDL_CloseIO(vob_file);
+            return NULL;
+        }
+        if (!write_index_file(index_path, vob_file, &vob, index)) {
+            // not fatal, the index will just be rebuilt next run
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "couldn't save vob index to %s\n", index_path);
+        }
+    }
+
+    SDL_free(index_path);
+    SDL_CloseIO(vob_file);
+    return index;
+}
+
+const struct vobu_entry *find_vobu(const struct vob_index *index, const uint32_t sector) {
+    // binary search for the first entry with entry.sector >= sector
+    uint32_t low = 0;
+    uint32_t high = index->count;
+
+    while (low < high) {
+        const uint32_t mid = low + (high - low) / 2;
+        if (index->entries[mid].sector < sector) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low < index->count ? &index->entries[low] : NULL;
+}
+
+void destroy_vob_index(struct vob_index *index) {
+    if (!index) return;
+
+    free(index->entries);
+    free(index);
+}
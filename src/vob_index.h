@@ -0,0 +1,68 @@
+/**
+ * @file vob_index.h
+ *
+ * Persistent index of the VOBUs (video object units) in a vob file.
+ * Built once by walking the NAV packs of the file, then cached next to it
+ * so every game state can be entered at an exact VOBU start with a known PTS.
+ *
+ * @author Michael Metsker
+ * @version 1.0
+ */
+
+#ifndef VOB_INDEX_H
+#define VOB_INDEX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** every pack in a vob is exactly one sector, the game states' offsets are counted in them too */
+#define DVD_SECTOR_SIZE 2048
+
+/**
+ * @struct vobu_entry
+ * @brief location and timing of a single VOBU, read from its NAV pack
+ */
+struct vobu_entry {
+    uint32_t sector;              /**< sector of the NAV pack that starts the VOBU */
+    uint32_t last_sector;         /**< last sector that belongs to the VOBU */
+    uint32_t iframe_end_sector;   /**< last sector of the first I-frame in the VOBU, 0 if unknown */
+    uint32_t start_pts;           /**< presentation time of the first frame, 90kHz */
+    uint32_t end_pts;             /**< presentation time after the last frame, 90kHz */
+};
+
+/**
+ * @struct vob_index
+ * @brief sorted array of every VOBU in a vob file
+ */
+struct vob_index {
+    struct vobu_entry *entries;   /**< entries sorted by sector */
+    uint32_t count;               /**< amount of entries */
+};
+
+/**
+ * @brief loads the cached index of a vob file, building and saving it if it is missing or stale
+ * the cache lives next to the file as "<path>.idx", and is stale unless the vob's size, modification time
+ * and first NAV packs all match the ones it was built from
+ *
+ * @param vob_path path to the vob file
+ * @return pointer to the index, or NULL on failure
+ */
+struct vob_index *load_vob_index(const char *vob_path);
+
+/**
+ * @brief finds the first VOBU that starts at or after the given sector
+ *
+ * @param index index to search
+ * @param sector sector to search from
+ * @return pointer to the entry, or NULL if no VOBU starts at or after the sector
+ */
+const struct vobu_entry *find_vobu(const struct vob_index *index, uint32_t sector);
+
+/**
+ * @brief frees a vob_index and its entries
+ *
+ * @param index index to destroy, can be NULL
+ */
+void destroy_vob_index(struct vob_index *index);
+
+#endif //VOB_INDEX_H